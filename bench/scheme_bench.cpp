@@ -0,0 +1,258 @@
+// Throughput of the interpreter core: calls and arithmetic, allocation, branching, the tokenizer
+// and reader, printing, starting from a prelude, parallel-map, memoization and strings.
+// Evaluation benchmarks run on both engines.
+//
+// Pass --benchmark_format=json (or --benchmark_out=<file> --benchmark_out_format=json) for
+// output that can be compared across releases, with tools/compare.py from Google Benchmark.
+
+#include "image.h"
+#include "parallel.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+#include <string>
+
+static InterpreterOptions MakeOptions(const benchmark::State& state) {
+    InterpreterOptions options;
+    options.engine = (state.range(0) == 0 ? Engine::kTree : Engine::kBytecode);
+    return options;
+}
+
+static void SetEngineLabel(benchmark::State& state) {
+    state.SetLabel(state.range(0) == 0 ? "tree" : "bytecode");
+}
+
+// Defines the program once, then evaluates the call over and over.
+static void RunEval(benchmark::State& state, const char* definition, const std::string& call) {
+    Interpreter interpreter(MakeOptions(state));
+    interpreter.Run(definition);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(interpreter.Run(call));
+    }
+    SetEngineLabel(state);
+}
+
+static void BM_Fib(benchmark::State& state) {
+    RunEval(state, "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+            "(fib " + std::to_string(state.range(1)) + ")");
+}
+BENCHMARK(BM_Fib)->ArgsProduct({{0, 1}, {15, 20}})->Unit(benchmark::kMicrosecond);
+
+static void BM_Tak(benchmark::State& state) {
+    RunEval(state,
+            "(define (tak x y z)"
+            "  (if (not (< y x)) z"
+            "      (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))",
+            "(tak 18 12 6)");
+}
+BENCHMARK(BM_Tak)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// tak memoized in a cache of range(1) entries that starts empty every time; too small a cache
+// keeps evicting results the recursion needs again.
+static void BM_MemoTak(benchmark::State& state) {
+    Interpreter interpreter(MakeOptions(state));
+    const std::string definition =
+        "(define tak (memoize (lambda (x y z)"
+        "  (if (not (< y x)) z"
+        "      (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)))) " +
+        std::to_string(state.range(1)) + "))";
+    for (auto _ : state) {
+        interpreter.Run(definition);
+        benchmark::DoNotOptimize(interpreter.Run("(tak 18 12 6)"));
+    }
+    SetEngineLabel(state);
+}
+BENCHMARK(BM_MemoTak)->ArgsProduct({{0, 1}, {16, 4096}})->Unit(benchmark::kMicrosecond);
+
+static void BM_Ackermann(benchmark::State& state) {
+    RunEval(state,
+            "(define (ack m n)"
+            "  (if (= m 0) (+ n 1)"
+            "      (if (= n 0) (ack (- m 1) 1) (ack (- m 1) (ack m (- n 1))))))",
+            "(ack 2 " + std::to_string(state.range(1)) + ")");
+}
+BENCHMARK(BM_Ackermann)->ArgsProduct({{0, 1}, {9, 50}})->Unit(benchmark::kMicrosecond);
+
+// A tail-recursive loop consing n cells.
+static void BM_Cons(benchmark::State& state) {
+    RunEval(state, "(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+            "(null? (build " + std::to_string(state.range(1)) + " '()))");
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_Cons)->ArgsProduct({{0, 1}, {1000, 100000}})->Unit(benchmark::kMicrosecond);
+
+// n calls to list with 8 arguments each.
+static void BM_List(benchmark::State& state) {
+    RunEval(state,
+            "(define (lists n) (if (= n 0) 0 ((lambda (l) (lists (- n 1)))"
+            "                                  (list n 1 2 3 4 5 6 7))))",
+            "(lists " + std::to_string(state.range(1)) + ")");
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_List)->ArgsProduct({{0, 1}, {1000}})->Unit(benchmark::kMicrosecond);
+
+// Counts the spaces in a string of n bytes with string-ref, then joins two halves of it.
+static void BM_String(benchmark::State& state) {
+    Interpreter interpreter(MakeOptions(state));
+    interpreter.Run("(define text \"" + std::string(state.range(1), ' ') + "\")");
+    interpreter.Run(
+        "(define (spaces i n)"
+        "  (if (= i (string-length text)) n"
+        "      (spaces (+ i 1) (if (= (char->integer (string-ref text i)) 32) (+ n 1) n))))");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(interpreter.Run(
+            "(string-length (string-append (substring text 0 (spaces 0 0)) text))"));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(1));
+    SetEngineLabel(state);
+}
+BENCHMARK(BM_String)->ArgsProduct({{0, 1}, {1000}})->Unit(benchmark::kMicrosecond);
+
+// (if (= x 0) 0 (if (= x 1) 1 ... x)), depth ifs deep, taking the last branch.
+static void BM_DeepIf(benchmark::State& state) {
+    const int depth = state.range(1);
+    std::string body = "x";
+    for (int i = depth - 1; i >= 0; --i) {
+        const std::string number = std::to_string(i);
+        body = "(if (= x " + number + ") " + number + " " + body + ")";
+    }
+    const std::string definition = "(define (choose x) " + body + ")";
+    RunEval(state, definition.c_str(), "(choose " + std::to_string(depth) + ")");
+}
+BENCHMARK(BM_DeepIf)->ArgsProduct({{0, 1}, {10, 1000}})->Unit(benchmark::kMicrosecond);
+
+// About size bytes of top-level forms mixing every kind of token.
+static std::string MakeSource(size_t size) {
+    static const char kForms[] =
+        "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))\n"
+        "(define table '((alpha . 1) (beta . -22) (gamma . 3.25) (delta . 4e10)))\n"
+        "(list-ref (quote (#t #f 123456789012345678901234567890 x-y? set-car!)) 2)\n";
+    std::string source;
+    while (source.size() < size) {
+        source += kForms;
+    }
+    return source;
+}
+
+static void BM_Tokenize(benchmark::State& state) {
+    const std::string source = MakeSource(state.range(0));
+    for (auto _ : state) {
+        Tokenizer tokenizer(source);
+        size_t count = 0;
+        for (; !tokenizer.IsEnd(); tokenizer.Next()) {
+            benchmark::DoNotOptimize(tokenizer.GetToken());
+            ++count;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Tokenize)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+static void BM_TokenizeStream(benchmark::State& state) {
+    const std::string source = MakeSource(state.range(0));
+    for (auto _ : state) {
+        std::istringstream in(source);
+        Tokenizer tokenizer(&in);
+        for (; !tokenizer.IsEnd(); tokenizer.Next()) {
+            benchmark::DoNotOptimize(tokenizer.GetToken());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_TokenizeStream)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+// Reads every form of the source into the heap of an interpreter, collecting after each pass.
+static void BM_Read(benchmark::State& state) {
+    const std::string source = MakeSource(state.range(0));
+    Interpreter interpreter;
+    CurrentHeapGuard guard(&interpreter.GetHeap());
+    for (auto _ : state) {
+        Tokenizer tokenizer(source);
+        while (!tokenizer.IsEnd()) {
+            benchmark::DoNotOptimize(Read(&tokenizer));
+        }
+        interpreter.GetHeap().MaybeCollect();
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Read)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+// Prints a list of n small numbers.
+static void BM_ListToString(benchmark::State& state) {
+    Interpreter interpreter;
+    interpreter.Run("(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+    interpreter.Run("(define l (build " + std::to_string(state.range(0)) + " '()))");
+    const Value list = interpreter.GetScope()->GetVariable(Intern("l"));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ListToString(list));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ListToString)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+// A prelude of n functions and n constant lists, as source and as an image of its definitions.
+static std::string MakePrelude(size_t n) {
+    std::string source;
+    for (size_t i = 0; i != n; ++i) {
+        const std::string id = std::to_string(i);
+        source += "(define (f" + id + " x y) (if (< x y) (+ x " + id + ") (f" + id +
+                  " (- x 1) y)))\n";
+        source += "(define l" + id + " '(" + id + " alpha (beta 2.5) #t))\n";
+    }
+    return source;
+}
+
+static void RunPrelude(Interpreter* interpreter, const std::string& source) {
+    std::istringstream in(source);
+    std::ostringstream out;
+    interpreter->Run(&in, &out);
+}
+
+static void BM_LoadSource(benchmark::State& state) {
+    const std::string source = MakePrelude(state.range(1));
+    for (auto _ : state) {
+        Interpreter interpreter(MakeOptions(state));
+        RunPrelude(&interpreter, source);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    SetEngineLabel(state);
+}
+BENCHMARK(BM_LoadSource)->ArgsProduct({{0, 1}, {1000}})->Unit(benchmark::kMillisecond);
+
+static void BM_LoadImage(benchmark::State& state) {
+    Interpreter warm(MakeOptions(state));
+    RunPrelude(&warm, MakePrelude(state.range(1)));
+    std::ostringstream out;
+    SaveImage(warm, &out);
+    const std::string image = out.str();
+    for (auto _ : state) {
+        Interpreter interpreter(MakeOptions(state));
+        LoadImage(&interpreter, image);
+    }
+    state.SetBytesProcessed(state.iterations() * image.size());
+    SetEngineLabel(state);
+}
+BENCHMARK(BM_LoadImage)->ArgsProduct({{0, 1}, {1000}})->Unit(benchmark::kMillisecond);
+
+// (fib 15) for each of 64 elements, on a pool of range(0) threads besides the calling one.
+static void BM_ParallelMap(benchmark::State& state) {
+    WorkStealingPool pool(state.range(0));
+    InterpreterOptions options;
+    options.pool = &pool;
+    Interpreter interpreter(options);
+    interpreter.Run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    interpreter.Run("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))");
+    interpreter.Run("(define xs (range 64 '()))");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(interpreter.Run("(parallel-map (lambda (x) (fib 15)) xs)"));
+    }
+    state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_ParallelMap)->Arg(0)->Arg(1)->Arg(3)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
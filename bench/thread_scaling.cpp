@@ -0,0 +1,79 @@
+// Runs one Interpreter per thread on the same workload and reports how throughput scales with
+// the number of threads. Interpreters share nothing mutable, so the efficiency column should
+// stay close to 1 up to the number of physical cores.
+//
+//   thread_scaling [max_threads] [iterations_per_thread]
+
+#include "scheme.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static const char* const kPrelude[] = {
+    "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+    "(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+    "(define (sum l acc) (if (null? l) acc (sum (cdr l) (+ acc (car l)))))",
+    "(define (fill h i n)"
+    "  (if (< i n) ((lambda () (hash-set! h i (* i i)) (fill h (+ i 1) n))) h))",
+};
+
+// Computing, allocating, hashing and reading, so that every shared structure is exercised.
+static const char* const kWorkload[] = {
+    "(fib 18)",
+    "(sum (build 2000 '()) 0)",
+    "(hash-count (fill (make-hash-table) 0 500))",
+    "(quote (alpha beta gamma (delta epsilon) zeta eta theta iota kappa lambda mu))",
+};
+
+static void RunWorkload(int iterations) {
+    Interpreter interpreter;
+    for (const char* form : kPrelude) {
+        interpreter.Run(form);
+    }
+    for (int i = 0; i != iterations; ++i) {
+        for (const char* form : kWorkload) {
+            interpreter.Run(form);
+        }
+    }
+}
+
+static double Measure(int num_threads, int iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i != num_threads; ++i) {
+        threads.emplace_back(RunWorkload, iterations);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    const int max_threads = (argc > 1 ? std::atoi(argv[1]) : hardware);
+    const int iterations = (argc > 2 ? std::atoi(argv[2]) : 50);
+
+    std::printf("%8s %12s %14s %11s\n", "threads", "seconds", "workloads/s", "efficiency");
+    std::vector<int> thread_counts;
+    for (int num_threads = 1; num_threads < max_threads; num_threads *= 2) {
+        thread_counts.push_back(num_threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    double single = 0;
+    for (int num_threads : thread_counts) {
+        const double seconds = Measure(num_threads, iterations);
+        const double throughput = num_threads * iterations / seconds;
+        if (num_threads == 1) {
+            single = throughput;
+        }
+        std::printf("%8d %12.3f %14.1f %11.2f\n", num_threads, seconds, throughput,
+                    throughput / (single * num_threads));
+    }
+    return 0;
+}
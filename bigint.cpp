@@ -0,0 +1,397 @@
+#include "bigint.h"
+#include <algorithm>
+#include <utility>
+
+using Limbs = std::vector<uint32_t>;
+
+// Below this many limbs in the shorter operand, Karatsuba's extra additions cost more than the
+// multiplications they save.
+static constexpr size_t kKaratsubaThreshold = 32;
+
+static constexpr uint64_t kBase = uint64_t(1) << 32;
+
+static void Trim(Limbs* limbs) {
+    while (!limbs->empty() && limbs->back() == 0) {
+        limbs->pop_back();
+    }
+}
+
+static int CompareMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return (lhs.size() < rhs.size() ? -1 : 1);
+    }
+    for (size_t i = lhs.size(); i-- != 0;) {
+        if (lhs[i] != rhs[i]) {
+            return (lhs[i] < rhs[i] ? -1 : 1);
+        }
+    }
+    return 0;
+}
+
+static Limbs AddMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+    const Limbs& longer = (lhs.size() < rhs.size() ? rhs : lhs);
+    const Limbs& shorter = (lhs.size() < rhs.size() ? lhs : rhs);
+    Limbs result(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i != longer.size(); ++i) {
+        carry += uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+        result[i] = uint32_t(carry);
+        carry >>= 32;
+    }
+    result.back() = uint32_t(carry);
+    Trim(&result);
+    return result;
+}
+
+static Limbs SubtractMagnitudes(const Limbs& lhs, const Limbs& rhs) {  // lhs >= rhs
+    Limbs result(lhs.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i != lhs.size(); ++i) {
+        int64_t difference = int64_t(lhs[i]) - (i < rhs.size() ? rhs[i] : 0) - borrow;
+        borrow = (difference < 0);
+        result[i] = uint32_t(difference + (borrow ? kBase : 0));
+    }
+    Trim(&result);
+    return result;
+}
+
+// target[0, size) += addend[0, length), with length <= size. Returns the carry out.
+static uint32_t AddInPlace(uint32_t* target, size_t size, const uint32_t* addend, size_t length) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i != length; ++i) {
+        carry += uint64_t(target[i]) + addend[i];
+        target[i] = uint32_t(carry);
+        carry >>= 32;
+    }
+    for (; carry != 0 && i != size; ++i) {
+        carry += target[i];
+        target[i] = uint32_t(carry);
+        carry >>= 32;
+    }
+    return uint32_t(carry);
+}
+
+// target[0, size) -= subtrahend[0, length), which must not exceed it.
+static void SubtractInPlace(uint32_t* target, size_t size, const uint32_t* subtrahend,
+                            size_t length) {
+    int64_t borrow = 0;
+    size_t i = 0;
+    for (; i != length; ++i) {
+        int64_t difference = int64_t(target[i]) - subtrahend[i] - borrow;
+        borrow = (difference < 0);
+        target[i] = uint32_t(difference + (borrow ? kBase : 0));
+    }
+    for (; borrow != 0 && i != size; ++i) {
+        borrow = (target[i] == 0);
+        --target[i];
+    }
+}
+
+static void MultiplyMagnitudes(const uint32_t* lhs, size_t n, const uint32_t* rhs, size_t m,
+                               uint32_t* result);
+
+static void Schoolbook(const uint32_t* lhs, size_t n, const uint32_t* rhs, size_t m,
+                       uint32_t* result) {
+    std::fill(result, result + n + m, 0);
+    for (size_t i = 0; i != n; ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j != m; ++j) {
+            carry += uint64_t(lhs[i]) * rhs[j] + result[i + j];
+            result[i + j] = uint32_t(carry);
+            carry >>= 32;
+        }
+        result[i + m] = uint32_t(carry);
+    }
+}
+
+// With lhs = a1 B^k + a0 and rhs = b1 B^k + b0, lhs * rhs = z2 B^2k + z1 B^k + z0 where
+// z0 = a0 b0, z2 = a1 b1 and z1 = (a0 + a1)(b0 + b1) - z0 - z2: three half-size products
+// instead of four. n >= m.
+static void Karatsuba(const uint32_t* lhs, size_t n, const uint32_t* rhs, size_t m,
+                      uint32_t* result) {
+    const size_t k = (n + 1) / 2;
+    if (m <= k) {
+        // rhs has no upper half: lhs * rhs = a1 rhs B^k + a0 rhs.
+        MultiplyMagnitudes(lhs, k, rhs, m, result);
+        std::fill(result + k + m, result + n + m, 0);
+        Limbs upper(n - k + m);
+        MultiplyMagnitudes(lhs + k, n - k, rhs, m, upper.data());
+        AddInPlace(result + k, n + m - k, upper.data(), upper.size());
+        return;
+    }
+    MultiplyMagnitudes(lhs, k, rhs, k, result);                     // z0 in [0, 2k)
+    MultiplyMagnitudes(lhs + k, n - k, rhs + k, m - k, result + 2 * k);  // z2 in [2k, n + m)
+
+    Limbs lhs_sum(k + 1), rhs_sum(k + 1);
+    std::copy(lhs, lhs + k, lhs_sum.begin());
+    lhs_sum[k] = AddInPlace(lhs_sum.data(), k, lhs + k, n - k);
+    std::copy(rhs, rhs + k, rhs_sum.begin());
+    rhs_sum[k] = AddInPlace(rhs_sum.data(), k, rhs + k, m - k);
+
+    Limbs middle(2 * k + 2);
+    MultiplyMagnitudes(lhs_sum.data(), k + 1, rhs_sum.data(), k + 1, middle.data());
+    SubtractInPlace(middle.data(), middle.size(), result, 2 * k);
+    SubtractInPlace(middle.data(), middle.size(), result + 2 * k, n + m - 2 * k);
+    // z1 < B^(n + m - k), so the limbs of middle beyond that are zero.
+    AddInPlace(result + k, n + m - k, middle.data(), std::min(middle.size(), n + m - k));
+}
+
+// result[0, n + m) = lhs * rhs.
+static void MultiplyMagnitudes(const uint32_t* lhs, size_t n, const uint32_t* rhs, size_t m,
+                               uint32_t* result) {
+    if (n < m) {
+        std::swap(lhs, rhs);
+        std::swap(n, m);
+    }
+    if (m < kKaratsubaThreshold) {
+        Schoolbook(lhs, n, rhs, m, result);
+    } else {
+        Karatsuba(lhs, n, rhs, m, result);
+    }
+}
+
+// Divides in place and returns the remainder.
+static uint32_t DivideBySmall(Limbs* limbs, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (size_t i = limbs->size(); i-- != 0;) {
+        const uint64_t current = (remainder << 32) | (*limbs)[i];
+        (*limbs)[i] = uint32_t(current / divisor);
+        remainder = current % divisor;
+    }
+    Trim(limbs);
+    return uint32_t(remainder);
+}
+
+static void MultiplyAddSmall(Limbs* limbs, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for (uint32_t& limb : *limbs) {
+        carry += uint64_t(limb) * factor;
+        limb = uint32_t(carry);
+        carry >>= 32;
+    }
+    if (carry != 0) {
+        limbs->push_back(uint32_t(carry));
+    }
+}
+
+static int LeadingZeros(uint32_t limb) {
+    int count = 0;
+    for (uint32_t bit = uint32_t(1) << 31; (limb & bit) == 0; bit >>= 1) {
+        ++count;
+    }
+    return count;
+}
+
+// Knuth's algorithm D (TAOCP 4.3.1). The divisor has at least two limbs and does not exceed
+// the dividend.
+static void DivideMagnitudes(const Limbs& dividend, const Limbs& divisor, Limbs* quotient,
+                             Limbs* remainder) {
+    const size_t m = dividend.size(), n = divisor.size();
+    // Normalize so that the top bit of the divisor is set, which keeps the estimates of each
+    // quotient digit at most two too large.
+    const int shift = LeadingZeros(divisor.back());
+    const auto shifted = [shift](const Limbs& limbs, size_t i) -> uint32_t {
+        const uint32_t high = limbs[i] << shift;
+        return (shift == 0 || i == 0 ? high : high | (limbs[i - 1] >> (32 - shift)));
+    };
+    Limbs v(n), u(m + 1);
+    for (size_t i = 0; i != n; ++i) {
+        v[i] = shifted(divisor, i);
+    }
+    for (size_t i = 0; i != m; ++i) {
+        u[i] = shifted(dividend, i);
+    }
+    u[m] = (shift == 0 ? 0 : dividend[m - 1] >> (32 - shift));
+
+    quotient->assign(m - n + 1, 0);
+    for (size_t j = m - n + 1; j-- != 0;) {
+        const uint64_t numerator = (uint64_t(u[j + n]) << 32) | u[j + n - 1];
+        uint64_t digit = numerator / v[n - 1];
+        uint64_t rest = numerator % v[n - 1];
+        while (digit >= kBase || digit * v[n - 2] > ((rest << 32) | u[j + n - 2])) {
+            --digit;
+            rest += v[n - 1];
+            if (rest >= kBase) {
+                break;
+            }
+        }
+        // u[j, j + n] -= digit * v
+        int64_t borrow = 0;
+        for (size_t i = 0; i != n; ++i) {
+            const uint64_t product = digit * v[i];
+            const int64_t difference = int64_t(u[i + j]) - borrow - int64_t(product & 0xffffffff);
+            u[i + j] = uint32_t(difference);
+            borrow = int64_t(product >> 32) - (difference >> 32);
+        }
+        const int64_t top = int64_t(u[j + n]) - borrow;
+        u[j + n] = uint32_t(top);
+        if (top < 0) {  // the estimate was one too large: add v back
+            --digit;
+            uint64_t carry = 0;
+            for (size_t i = 0; i != n; ++i) {
+                carry += uint64_t(u[i + j]) + v[i];
+                u[i + j] = uint32_t(carry);
+                carry >>= 32;
+            }
+            u[j + n] += uint32_t(carry);
+        }
+        (*quotient)[j] = uint32_t(digit);
+    }
+    Trim(quotient);
+
+    remainder->resize(n);
+    for (size_t i = 0; i != n; ++i) {
+        (*remainder)[i] = (shift == 0 ? u[i] : (u[i] >> shift) | (u[i + 1] << (32 - shift)));
+    }
+    Trim(remainder);
+}
+
+// Truncating division of magnitudes; the divisor is not zero.
+static void DivMod(const Limbs& dividend, const Limbs& divisor, Limbs* quotient,
+                   Limbs* remainder) {
+    if (CompareMagnitudes(dividend, divisor) < 0) {
+        quotient->clear();
+        *remainder = dividend;
+    } else if (divisor.size() == 1) {
+        *quotient = dividend;
+        const uint32_t rest = DivideBySmall(quotient, divisor[0]);
+        remainder->clear();
+        if (rest != 0) {
+            remainder->push_back(rest);
+        }
+    } else {
+        DivideMagnitudes(dividend, divisor, quotient, remainder);
+    }
+}
+
+BigInt::BigInt(bool negative, Limbs limbs) : limbs_(std::move(limbs)) {
+    Trim(&limbs_);
+    negative_ = negative && !limbs_.empty();
+}
+
+BigInt::BigInt(int64_t value) : negative_(value < 0) {
+    // Negating in unsigned arithmetic is defined for INT64_MIN too.
+    uint64_t magnitude = (value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value));
+    for (; magnitude != 0; magnitude >>= 32) {
+        limbs_.push_back(uint32_t(magnitude));
+    }
+}
+
+BigInt BigInt::Parse(std::string_view digits) {
+    bool negative = false;
+    if (!digits.empty() && (digits[0] == '+' || digits[0] == '-')) {
+        negative = (digits[0] == '-');
+        digits.remove_prefix(1);
+    }
+    // Nine decimal digits at a time, the most that fit in a limb.
+    Limbs limbs;
+    size_t chunk = digits.size() % 9;
+    if (chunk == 0) {
+        chunk = 9;
+    }
+    for (size_t pos = 0; pos != digits.size(); pos += chunk, chunk = 9) {
+        uint32_t factor = 1, value = 0;
+        for (size_t i = pos; i != pos + chunk; ++i) {
+            factor *= 10;
+            value = value * 10 + (digits[i] - '0');
+        }
+        MultiplyAddSmall(&limbs, factor, value);
+    }
+    return BigInt(negative, std::move(limbs));
+}
+
+bool BigInt::FitsInt64() const {
+    if (limbs_.size() <= 1) {
+        return true;
+    }
+    if (limbs_.size() > 2) {
+        return false;
+    }
+    const uint64_t magnitude = (uint64_t(limbs_[1]) << 32) | limbs_[0];
+    return magnitude <= (negative_ ? uint64_t(1) << 63 : (uint64_t(1) << 63) - 1);
+}
+
+int64_t BigInt::ToInt64() const {
+    uint64_t magnitude = 0;
+    for (size_t i = limbs_.size(); i-- != 0;) {
+        magnitude = (magnitude << 32) | limbs_[i];
+    }
+    return int64_t(negative_ ? uint64_t(0) - magnitude : magnitude);
+}
+
+double BigInt::ToDouble() const {
+    double result = 0;
+    for (size_t i = limbs_.size(); i-- != 0;) {
+        result = result * double(kBase) + limbs_[i];
+    }
+    return (negative_ ? -result : result);
+}
+
+std::string BigInt::ToString() const {
+    if (limbs_.empty()) {
+        return "0";
+    }
+    // Nine decimal digits at a time, least significant first.
+    std::vector<uint32_t> chunks;
+    Limbs rest = limbs_;
+    while (!rest.empty()) {
+        chunks.push_back(DivideBySmall(&rest, 1000000000));
+    }
+    std::string result = (negative_ ? "-" : "");
+    result += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- != 0;) {
+        const std::string digits = std::to_string(chunks[i]);
+        result.append(9 - digits.size(), '0');
+        result += digits;
+    }
+    return result;
+}
+
+BigInt BigInt::operator-() const {
+    return BigInt(!negative_, limbs_);
+}
+
+BigInt operator+(const BigInt& lhs, const BigInt& rhs) {
+    if (lhs.negative_ == rhs.negative_) {
+        return BigInt(lhs.negative_, AddMagnitudes(lhs.limbs_, rhs.limbs_));
+    }
+    if (CompareMagnitudes(lhs.limbs_, rhs.limbs_) >= 0) {
+        return BigInt(lhs.negative_, SubtractMagnitudes(lhs.limbs_, rhs.limbs_));
+    }
+    return BigInt(rhs.negative_, SubtractMagnitudes(rhs.limbs_, lhs.limbs_));
+}
+
+BigInt operator-(const BigInt& lhs, const BigInt& rhs) {
+    return lhs + -rhs;
+}
+
+BigInt operator*(const BigInt& lhs, const BigInt& rhs) {
+    if (lhs.IsZero() || rhs.IsZero()) {
+        return BigInt();
+    }
+    Limbs product(lhs.limbs_.size() + rhs.limbs_.size());
+    MultiplyMagnitudes(lhs.limbs_.data(), lhs.limbs_.size(), rhs.limbs_.data(),
+                       rhs.limbs_.size(), product.data());
+    return BigInt(lhs.negative_ != rhs.negative_, std::move(product));
+}
+
+BigInt operator/(const BigInt& lhs, const BigInt& rhs) {
+    Limbs quotient, remainder;
+    DivMod(lhs.limbs_, rhs.limbs_, &quotient, &remainder);
+    return BigInt(lhs.negative_ != rhs.negative_, std::move(quotient));
+}
+
+BigInt operator%(const BigInt& lhs, const BigInt& rhs) {
+    Limbs quotient, remainder;
+    DivMod(lhs.limbs_, rhs.limbs_, &quotient, &remainder);
+    return BigInt(lhs.negative_, std::move(remainder));
+}
+
+int Compare(const BigInt& lhs, const BigInt& rhs) {
+    if (lhs.negative_ != rhs.negative_) {
+        return (lhs.negative_ ? -1 : 1);
+    }
+    const int magnitude = CompareMagnitudes(lhs.limbs_, rhs.limbs_);
+    return (lhs.negative_ ? -magnitude : magnitude);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An arbitrary-precision integer: a sign and a magnitude in base 2^32, least significant limb
+// first and without leading zero limbs, so zero has no limbs (and is never negative).
+class BigInt {
+    bool negative_ = false;
+    std::vector<uint32_t> limbs_;
+
+    BigInt(bool negative, std::vector<uint32_t> limbs);
+
+public:
+    BigInt() = default;
+    explicit BigInt(int64_t);
+
+    static BigInt Parse(std::string_view digits);  // [+-]?[0-9]+
+
+    bool IsZero() const {
+        return limbs_.empty();
+    }
+
+    bool IsNegative() const {
+        return negative_;
+    }
+
+    bool FitsInt64() const;
+    int64_t ToInt64() const;  // must fit
+    double ToDouble() const;
+    std::string ToString() const;
+
+    BigInt operator-() const;
+
+    friend BigInt operator+(const BigInt&, const BigInt&);
+    friend BigInt operator-(const BigInt&, const BigInt&);
+    friend BigInt operator*(const BigInt&, const BigInt&);
+    // Truncates towards zero, like int64_t division. The divisor must not be zero.
+    friend BigInt operator/(const BigInt&, const BigInt&);
+    friend BigInt operator%(const BigInt&, const BigInt&);
+
+    friend int Compare(const BigInt&, const BigInt&);  // negative, zero or positive
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "object.h"
+#include "scheme.h"
+
+struct Procedure;
+
+// Instructions of the VM, each followed by its operands in the instruction stream. Stack
+// effects are noted as (popped -- pushed).
+enum Op : int32_t {
+    kConst,               // index: ( -- constants[index])
+    kLocal,               // depth slot symbol: ( -- value); symbol names an unbound slot
+    kGlobal,              // slot symbol: ( -- value); a slot of the global scope
+    kDefineLocal,         // slot: (value -- ())
+    kDefineGlobal,        // slot: (value -- ())
+    kSetLocal,            // depth slot: (value -- ())
+    kSetGlobal,           // slot symbol: (value -- ())
+    kPop,                 // (value -- )
+    kJump,                // target
+    kJumpIfFalse,         // target: (value -- )
+    kJumpIfFalseElsePop,  // target: (value -- value) if it is #f, (value -- ) otherwise
+    kJumpIfTrueElsePop,   // target: (value -- value) unless it is #f, (value -- ) otherwise
+    kClosure,             // procedure: ( -- lambda)
+    kCall,                // argc form: (function args... -- result)
+    kTailCall,            // argc form: (function args... -- ), returns the callee's result
+    kBuiltin,             // command argc: (args... -- result)
+    kReturn,              // (result -- )
+    // Builtins with two arguments, with a fast path for fixnums; anything else goes to the
+    // command, so errors are the same as with kBuiltin.
+    kAdd,                 // command: (lhs rhs -- result)
+    kSubtract,
+    kMultiply,
+    kNumEqual,
+    kLess,
+    kGreater,
+    kLessOrEqual,
+    kGreaterOrEqual,
+    kNumOps
+};
+
+// The fast path of kAdd to kGreaterOrEqual, shared by both engines: false unless both operands
+// are fixnums and the result is exact, in which case the command has to be called instead.
+inline bool TryFixnumOp(Op op, const Value& lhs, const Value& rhs, Value* result) {
+    if (!lhs.IsFixnum() || !rhs.IsFixnum()) {
+        return false;
+    }
+    const int64_t x = lhs.GetFixnum(), y = rhs.GetFixnum();
+    switch (op) {
+        case kAdd:  // fixnums have 63 bits: sums and differences fit in an int64_t
+            *result = GetNumberConstant(x + y);
+            return true;
+        case kSubtract:
+            *result = GetNumberConstant(x - y);
+            return true;
+        case kMultiply: {
+            int64_t product;
+            if (!CheckedMultiply(x, y, &product)) {
+                return false;
+            }
+            *result = GetNumberConstant(product);
+            return true;
+        }
+        case kNumEqual:
+            *result = Value::FromBoolean(x == y);
+            return true;
+        case kLess:
+            *result = Value::FromBoolean(x < y);
+            return true;
+        case kGreater:
+            *result = Value::FromBoolean(x > y);
+            return true;
+        case kLessOrEqual:
+            *result = Value::FromBoolean(x <= y);
+            return true;
+        case kGreaterOrEqual:
+            *result = Value::FromBoolean(x >= y);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The bytecode of a lambda body or a top-level form. Operands refer to the tables below by
+// index; jump targets are offsets into words.
+struct Code {
+    std::vector<int32_t> words;
+    std::vector<Value> constants;  // they belong to the source (see Procedure::expressions)
+    std::vector<const Symbol*> symbols;
+    std::vector<Command> commands;
+    std::vector<std::shared_ptr<const Procedure>> procedures;
+
+    void Emit(int32_t word) {
+        words.push_back(word);
+    }
+
+    int32_t AddConstant(const Value& value) {
+        constants.push_back(value);
+        return constants.size() - 1;
+    }
+
+    int32_t AddSymbol(const Symbol* symbol) {
+        symbols.push_back(symbol);
+        return symbols.size() - 1;
+    }
+
+    int32_t AddCommand(Command command) {
+        commands.push_back(command);
+        return commands.size() - 1;
+    }
+
+    int32_t AddProcedure(const std::shared_ptr<const Procedure>& procedure) {
+        procedures.push_back(procedure);
+        return procedures.size() - 1;
+    }
+
+    // Emits a jump and returns where its target goes, for PatchJump.
+    size_t EmitJump(Op op) {
+        Emit(op);
+        Emit(-1);
+        return words.size() - 1;
+    }
+
+    void PatchJump(size_t at) {  // the jump at `at` goes to the next instruction emitted
+        words[at] = words.size();
+    }
+};
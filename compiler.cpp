@@ -0,0 +1,964 @@
+#include "compiler.h"
+#include "bytecode.h"
+#include "error.h"
+#include "profiler.h"
+#include "scheme.h"
+#include <map>
+#include <unordered_map>
+
+// Variables of one lambda, its arguments followed by the defines found in its body, mapped to
+// their slots in the Scope created by each call.
+struct Frame {
+    const Frame* parent;
+    std::unordered_map<size_t, size_t> slots;  // by symbol id
+    mutable bool makes_closures = false;  // set while compiling the body
+    std::shared_ptr<FrameLayout> layout = std::make_shared<FrameLayout>();
+
+    void Add(const Symbol* symbol) {
+        if (slots.insert(std::make_pair(symbol->GetId(), slots.size())).second) {
+            layout->slots.push_back(symbol);
+        }
+    }
+};
+
+// The layout of the global scope that the code being compiled is for, set by the entry points
+// at the end of the file. Every compile function receives the frame, but that is nullptr at the
+// top level, so the layout is kept here rather than in it.
+static thread_local GlobalLayout* globals = nullptr;
+
+class GlobalsGuard {
+    GlobalLayout* previous_;
+
+public:
+    explicit GlobalsGuard(GlobalLayout* layout) : previous_(globals) {
+        globals = layout;
+    }
+
+    ~GlobalsGuard() {
+        globals = previous_;
+    }
+};
+
+// Returns false if symbol does not refer to a local variable.
+static bool Resolve(const Frame* frame, const Symbol* symbol, size_t* depth, size_t* slot) {
+    for (*depth = 0; frame != nullptr; frame = frame->parent, ++*depth) {
+        const auto iter = frame->slots.find(symbol->GetId());
+        if (iter != frame->slots.end()) {
+            *slot = iter->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static Scope* GetFrame(Scope* scope, size_t depth) {
+    for (; depth != 0; --depth) {
+        scope = scope->GetParent();
+    }
+    return scope;
+}
+
+static std::vector<const Symbol*> ToSymbols(const Value& object) {
+    std::vector<const Symbol*> symbols;
+    for (const auto& element : UnfoldList(object)) {
+        const Symbol* symbol = As<Symbol>(element);
+        if (symbol == nullptr) {
+            throw RuntimeError(std::string("Expected symbol, but got: ") + ToString(element));
+        }
+        symbols.push_back(symbol);
+    }
+    return symbols;
+}
+
+// The instruction for a builtin called with two arguments, kBuiltin if it has no fast path.
+static Op FindBinaryOp(const Symbol* name) {
+    static const std::unordered_map<size_t, Op> ops = [] {
+        std::unordered_map<size_t, Op> ops;
+        ops[Intern("+")->GetId()] = kAdd;
+        ops[Intern("-")->GetId()] = kSubtract;
+        ops[Intern("*")->GetId()] = kMultiply;
+        ops[Intern("=")->GetId()] = kNumEqual;
+        ops[Intern("<")->GetId()] = kLess;
+        ops[Intern(">")->GetId()] = kGreater;
+        ops[Intern("<=")->GetId()] = kLessOrEqual;
+        ops[Intern(">=")->GetId()] = kGreaterOrEqual;
+        return ops;
+    }();
+    const auto iter = ops.find(name->GetId());
+    return (iter != ops.end() ? iter->second : kBuiltin);
+}
+
+// and/or: every operand but the last jumps to the end if it decides the result.
+static void EmitShortCircuit(Code* code, const std::vector<std::shared_ptr<Node>>& args,
+                             Op jump, const Value& empty) {
+    if (args.empty()) {
+        code->Emit(kConst);
+        code->Emit(code->AddConstant(empty));
+        return;
+    }
+    std::vector<size_t> to_end;
+    for (size_t i = 0; i != args.size(); ++i) {
+        args[i]->Emit(code);
+        if (i + 1 != args.size()) {
+            to_end.push_back(code->EmitJump(jump));
+        }
+    }
+    for (size_t at : to_end) {
+        code->PatchJump(at);
+    }
+}
+
+// A lambda body or a top-level form, returning the value of the last node.
+static std::shared_ptr<const Code> Assemble(const std::vector<std::shared_ptr<Node>>& nodes) {
+    std::shared_ptr<Code> code(new Code);
+    for (size_t i = 0; i != nodes.size(); ++i) {
+        if (i != 0) {
+            code->Emit(kPop);
+        }
+        nodes[i]->Emit(code.get());
+    }
+    code->Emit(kReturn);
+    return code;
+}
+
+class ConstNode : public Node {
+    Value value_;
+
+public:
+    ConstNode(const Value& value) : value_(value) {
+    }
+
+    const Value& GetValue() const {
+        return value_;
+    }
+
+    Value Eval(Interpreter*, Scope*) const override {
+        return value_;
+    }
+
+    void Emit(Code* code) const override {
+        code->Emit(kConst);
+        code->Emit(code->AddConstant(value_));
+    }
+};
+
+class LocalRefNode : public Node {
+    const Symbol* symbol_;  // for error messages
+    size_t depth_, slot_;
+
+public:
+    LocalRefNode(const Symbol* symbol, size_t depth, size_t slot)
+        : symbol_(symbol), depth_(depth), slot_(slot) {
+    }
+
+    // Slots of internal defines hold Value::Unbound() until the define is evaluated.
+    Value Eval(Interpreter*, Scope* scope) const override {
+        const Value& value = GetFrame(scope, depth_)->GetSlot(slot_);
+        if (value.IsUnbound()) {
+            throw NameError(std::string("No such variable: ") + symbol_->GetName());
+        }
+        return value;
+    }
+
+    void Emit(Code* code) const override {
+        code->Emit(kLocal);
+        code->Emit(depth_);
+        code->Emit(slot_);
+        code->Emit(code->AddSymbol(symbol_));
+    }
+};
+
+class GlobalRefNode : public Node {
+    const Symbol* symbol_;  // interned, never freed
+    size_t slot_;
+
+public:
+    GlobalRefNode(const Symbol* symbol) : symbol_(symbol), slot_(globals->Add(symbol)) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope*) const override {
+        const Value* binding = interpreter->GetScope()->FindVariable(slot_);
+        if (binding == nullptr) {
+            throw NameError(std::string("No such variable: ") + symbol_->GetName());
+        }
+        return *binding;
+    }
+
+    void Emit(Code* code) const override {
+        code->Emit(kGlobal);
+        code->Emit(slot_);
+        code->Emit(code->AddSymbol(symbol_));
+    }
+};
+
+class IfNode : public Node {
+    std::shared_ptr<Node> condition_, then_, else_;  // else_ may be nullptr
+
+public:
+    IfNode(const std::shared_ptr<Node>& condition, const std::shared_ptr<Node>& then_branch,
+           const std::shared_ptr<Node>& else_branch)
+        : condition_(condition), then_(then_branch), else_(else_branch) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        if (AsBoolean(condition_->Eval(interpreter, scope))) {
+            return then_->Eval(interpreter, scope);
+        } else if (else_ != nullptr) {
+            return else_->Eval(interpreter, scope);
+        } else {
+            return nullptr;
+        }
+    }
+
+    void Emit(Code* code) const override {
+        condition_->Emit(code);
+        const size_t to_else = code->EmitJump(kJumpIfFalse);
+        then_->Emit(code);
+        const size_t to_end = code->EmitJump(kJump);
+        code->PatchJump(to_else);
+        if (else_ != nullptr) {
+            else_->Emit(code);
+        } else {
+            code->Emit(kConst);
+            code->Emit(code->AddConstant(nullptr));
+        }
+        code->PatchJump(to_end);
+    }
+};
+
+// Defines inside a lambda always bind local variables of that lambda (see CollectDefines).
+class LocalDefineNode : public Node {
+    size_t slot_;
+    std::shared_ptr<Node> value_;
+
+public:
+    LocalDefineNode(size_t slot, const std::shared_ptr<Node>& value) : slot_(slot), value_(value) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        scope->GetSlot(slot_) = value_->Eval(interpreter, scope);
+        return nullptr;
+    }
+
+    void Emit(Code* code) const override {
+        value_->Emit(code);
+        code->Emit(kDefineLocal);
+        code->Emit(slot_);
+    }
+};
+
+class GlobalDefineNode : public Node {
+    size_t slot_;
+    std::shared_ptr<Node> value_;
+
+public:
+    GlobalDefineNode(const Symbol* symbol, const std::shared_ptr<Node>& value)
+        : slot_(globals->Add(symbol)), value_(value) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        Value value = value_->Eval(interpreter, scope);
+        interpreter->CheckModifiable(interpreter->GetScope(), "define");
+        interpreter->GetScope()->SetVariable(slot_, value);
+        return nullptr;
+    }
+
+    void Emit(Code* code) const override {
+        value_->Emit(code);
+        code->Emit(kDefineGlobal);
+        code->Emit(slot_);
+    }
+};
+
+class LocalSetNode : public Node {
+    size_t depth_, slot_;
+    std::shared_ptr<Node> value_;
+
+public:
+    LocalSetNode(size_t depth, size_t slot, const std::shared_ptr<Node>& value)
+        : depth_(depth), slot_(slot), value_(value) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        Value value = value_->Eval(interpreter, scope);
+        Scope* frame = GetFrame(scope, depth_);
+        if (depth_ != 0) {  // the frame of the current call is always the interpreter's own
+            interpreter->CheckModifiable(frame, "set!");
+        }
+        frame->GetSlot(slot_) = value;
+        return nullptr;
+    }
+
+    void Emit(Code* code) const override {
+        value_->Emit(code);
+        code->Emit(kSetLocal);
+        code->Emit(depth_);
+        code->Emit(slot_);
+    }
+};
+
+class GlobalSetNode : public Node {
+    const Symbol* symbol_;  // interned, never freed
+    size_t slot_;
+    std::shared_ptr<Node> value_;
+
+public:
+    GlobalSetNode(const Symbol* symbol, const std::shared_ptr<Node>& value)
+        : symbol_(symbol), slot_(globals->Add(symbol)), value_(value) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        Value value = value_->Eval(interpreter, scope);
+        interpreter->CheckModifiable(interpreter->GetScope(), "set!");
+        Value* ptr = interpreter->GetScope()->FindVariable(slot_);
+        if (ptr == nullptr) {
+            throw NameError(std::string("Variable doesn't yet exist: ") + symbol_->GetName());
+        }
+        *ptr = value;
+        return nullptr;
+    }
+
+    void Emit(Code* code) const override {
+        value_->Emit(code);
+        code->Emit(kSetGlobal);
+        code->Emit(slot_);
+        code->Emit(code->AddSymbol(symbol_));
+    }
+};
+
+class LambdaNode : public Node {
+    std::shared_ptr<const Procedure> procedure_;
+
+public:
+    LambdaNode(const std::shared_ptr<const Procedure>& procedure) : procedure_(procedure) {
+    }
+
+    Value Eval(Interpreter*, Scope* scope) const override {
+        return Value(Make<Lambda>(procedure_, scope));
+    }
+
+    void Emit(Code* code) const override {
+        code->Emit(kClosure);
+        code->Emit(code->AddProcedure(procedure_));
+    }
+};
+
+// A call in tail position returns Value::TailCall() and leaves the lambda and its arguments to
+// the interpreter instead of making the call; the Lambda::Call that evaluates the enclosing
+// body makes it.
+class CallNode : public Node {
+    Value form_;  // for error messages
+    std::shared_ptr<Node> function_;
+    std::vector<std::shared_ptr<Node>> args_;
+    bool tail_;
+
+public:
+    CallNode(const Value& form, const std::shared_ptr<Node>& function,
+             const std::vector<std::shared_ptr<Node>>& args, bool tail)
+        : form_(form), function_(function), args_(args), tail_(tail) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        Value function = function_->Eval(interpreter, scope);
+        Lambda* lambda = As<Lambda>(function);
+        if (lambda == nullptr) {
+            throw RuntimeError(std::string("Cannot evaluate: ") + ToString(form_));
+        }
+        std::vector<Value> args = interpreter->TakeArgs();
+        args.reserve(args_.size());
+        Roots roots(&interpreter->GetHeap());
+        roots.Add(function);
+        roots.Add(&args);
+        for (const auto& arg : args_) {
+            args.push_back(arg->Eval(interpreter, scope));
+        }
+        if (tail_ && lambda->GetMemo() == nullptr) {  // which must see what the call returns
+            interpreter->SetTailCall(lambda, &args);  // leaves the previous tail call's in args
+            interpreter->GiveBackArgs(&args);
+            return Value::TailCall();
+        }
+        const Value result = lambda->Call(interpreter, args);
+        interpreter->GiveBackArgs(&args);
+        return result;
+    }
+
+    void Emit(Code* code) const override {
+        function_->Emit(code);
+        for (const auto& arg : args_) {
+            arg->Emit(code);
+        }
+        code->Emit(tail_ ? kTailCall : kCall);
+        code->Emit(args_.size());
+        code->Emit(code->AddConstant(form_));
+    }
+};
+
+class BuiltinCallNode : public Node {
+    Command command_;
+    std::vector<std::shared_ptr<Node>> args_;
+
+public:
+    BuiltinCallNode(Command command, const std::vector<std::shared_ptr<Node>>& args)
+        : command_(command), args_(args) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        std::vector<Value> args = interpreter->TakeArgs();
+        args.reserve(args_.size());
+        Roots roots(&interpreter->GetHeap());
+        roots.Add(&args);
+        for (const auto& arg : args_) {
+            args.push_back(arg->Eval(interpreter, scope));
+        }
+        if (Profiler* profiler = interpreter->GetProfiler()) {
+            profiler->CountBuiltin(command_);
+        }
+        const Value result = command_(interpreter, args);
+        interpreter->GiveBackArgs(&args);
+        return result;
+    }
+
+    void Emit(Code* code) const override {
+        for (const auto& arg : args_) {
+            arg->Emit(code);
+        }
+        code->Emit(kBuiltin);
+        code->Emit(code->AddCommand(command_));
+        code->Emit(args_.size());
+    }
+};
+
+// A builtin with a fixnum fast path (see FindBinaryOp) called with two arguments. Operands of
+// any other type go to the command, as with BuiltinCallNode.
+class BinaryBuiltinNode : public Node {
+    Op op_;
+    Command command_;
+    std::shared_ptr<Node> lhs_, rhs_;
+
+public:
+    BinaryBuiltinNode(Op op, Command command, const std::shared_ptr<Node>& lhs,
+                      const std::shared_ptr<Node>& rhs)
+        : op_(op), command_(command), lhs_(lhs), rhs_(rhs) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        const Value lhs = lhs_->Eval(interpreter, scope);
+        Value rhs;
+        {
+            Roots roots(&interpreter->GetHeap());
+            roots.Add(lhs);
+            rhs = rhs_->Eval(interpreter, scope);
+        }
+        if (Profiler* profiler = interpreter->GetProfiler()) {
+            profiler->CountBuiltin(command_);
+        }
+        Value result;
+        if (TryFixnumOp(op_, lhs, rhs, &result)) {
+            return result;
+        }
+        std::vector<Value> args = interpreter->TakeArgs();
+        args.push_back(lhs);
+        args.push_back(rhs);
+        result = command_(interpreter, args);
+        interpreter->GiveBackArgs(&args);
+        return result;
+    }
+
+    void Emit(Code* code) const override {
+        lhs_->Emit(code);
+        rhs_->Emit(code);
+        code->Emit(op_);
+        code->Emit(code->AddCommand(command_));
+    }
+};
+
+class AndNode : public Node {
+    std::vector<std::shared_ptr<Node>> args_;
+
+public:
+    AndNode(const std::vector<std::shared_ptr<Node>>& args) : args_(args) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        Value result = GetBooleanConstant(true);
+        for (const auto& arg : args_) {
+            result = arg->Eval(interpreter, scope);
+            if (!AsBoolean(result)) {
+                break;
+            }
+        }
+        return result;
+    }
+
+    void Emit(Code* code) const override {
+        EmitShortCircuit(code, args_, kJumpIfFalseElsePop, GetBooleanConstant(true));
+    }
+};
+
+class OrNode : public Node {
+    std::vector<std::shared_ptr<Node>> args_;
+
+public:
+    OrNode(const std::vector<std::shared_ptr<Node>>& args) : args_(args) {
+    }
+
+    Value Eval(Interpreter* interpreter, Scope* scope) const override {
+        Value result = GetBooleanConstant(false);
+        for (const auto& arg : args_) {
+            result = arg->Eval(interpreter, scope);
+            if (AsBoolean(result)) {
+                break;
+            }
+        }
+        return result;
+    }
+
+    void Emit(Code* code) const override {
+        EmitShortCircuit(code, args_, kJumpIfTrueElsePop, GetBooleanConstant(false));
+    }
+};
+
+// Nodes that evaluate to a constant are folded into the nodes that use them as they are built,
+// so (* 60 60 24) or (if (< 0 1) a b) costs nothing at run time.
+static bool IsConstant(const std::shared_ptr<Node>& node, Value* value) {
+    const ConstNode* constant = dynamic_cast<const ConstNode*>(node.get());
+    if (constant == nullptr) {
+        return false;
+    }
+    *value = constant->GetValue();
+    return true;
+}
+
+static bool FoldFixnumOp(Op op, const Value& lhs, const Value& rhs, Value* result) {
+    return TryFixnumOp(op, lhs, rhs, result) && result->IsFixnum();
+}
+
+// A call of not, or of an arithmetic or comparison builtin on fixnums, with constant arguments.
+// Only calls whose results are fixnums or booleans are folded, so constants stay immediate or
+// part of the source; calls that would overflow or fail are left to do so at run time.
+static std::shared_ptr<Node> FoldBuiltin(const Symbol* name,
+                                         const std::vector<std::shared_ptr<Node>>& args) {
+    static const Symbol* const not_symbol = Intern("not");
+    std::vector<Value> values(args.size());
+    for (size_t i = 0; i != args.size(); ++i) {
+        if (!IsConstant(args[i], &values[i])) {
+            return nullptr;
+        }
+    }
+    Value result;
+    const Op op = FindBinaryOp(name);
+    if (name == not_symbol) {
+        if (values.size() != 1) {
+            return nullptr;
+        }
+        result = Not(values[0]);
+    } else if (op == kAdd || op == kMultiply) {
+        result = GetNumberConstant(op == kAdd ? 0 : 1);
+        for (const Value& value : values) {
+            if (!FoldFixnumOp(op, result, value, &result)) {
+                return nullptr;
+            }
+        }
+    } else if (op == kSubtract) {
+        if (values.empty() || !values[0].IsFixnum()) {
+            return nullptr;
+        }
+        result = values[0];
+        for (size_t i = 1; i != values.size(); ++i) {
+            if (!FoldFixnumOp(op, result, values[i], &result)) {
+                return nullptr;
+            }
+        }
+    } else if (op != kBuiltin) {  // a comparison, of the first argument with the others for =
+        result = GetBooleanConstant(true);
+        for (size_t i = 0; i != values.size(); ++i) {
+            Value holds = GetBooleanConstant(true);
+            if (!values[i].IsFixnum() ||
+                (i != 0 && !TryFixnumOp(op, values[op == kNumEqual ? 0 : i - 1], values[i],
+                                        &holds))) {
+                return nullptr;
+            }
+            if (holds.IsFalse()) {
+                result = holds;
+            }
+        }
+    } else {
+        return nullptr;
+    }
+    return std::shared_ptr<Node>(new ConstNode(result));
+}
+
+// An expression in tail position is the last thing its lambda evaluates: calls there are made
+// by Lambda::Call after the frame is done with (see CallNode), so loops run in constant stack.
+static std::shared_ptr<Node> CompileExpression(const Value&, const Frame*, bool tail = false);
+
+// Compiles the operands of and (decisive false) or or (decisive true), the elements of list from
+// 1 on, that matter: constants that do not decide the result are dropped unless they are last,
+// and a constant that does ends the list, so that the operands after it are never compiled.
+static std::shared_ptr<Node> CompileShortCircuit(const std::vector<Value>& list,
+                                                 const Frame* frame, bool tail, bool decisive,
+                                                 std::vector<std::shared_ptr<Node>>* args) {
+    for (size_t i = 1; i != list.size(); ++i) {
+        const bool last = (i + 1 == list.size());
+        std::shared_ptr<Node> arg = CompileExpression(list[i], frame, tail && last);
+        Value value;
+        if (IsConstant(arg, &value)) {
+            if (AsBoolean(value) == decisive) {
+                args->push_back(arg);
+                break;
+            }
+            if (!last) {
+                continue;
+            }
+        }
+        args->push_back(arg);
+    }
+    if (args->empty()) {
+        return std::shared_ptr<Node>(new ConstNode(GetBooleanConstant(!decisive)));
+    }
+    return args->size() == 1 ? args->front() : nullptr;  // (and x) is x
+}
+
+static std::vector<std::shared_ptr<Node>> CompileAll(
+    const std::vector<Value>& list, size_t begin, const Frame* frame, bool tail = false) {
+    std::vector<std::shared_ptr<Node>> nodes;
+    for (size_t i = begin; i < list.size(); ++i) {
+        nodes.push_back(CompileExpression(list[i], frame, tail && i + 1 == list.size()));
+    }
+    return nodes;
+}
+
+// Adds to frame every variable a define inside expression would bind, not looking into nested
+// lambdas, so that references compiled before the define already resolve to the local variable.
+static void CollectDefines(const Value& expression, Frame* frame) {
+    const Cell* cell = As<Cell>(expression);
+    if (cell == nullptr) {
+        return;
+    }
+    Value rest = cell->GetSecond();
+    static const Symbol* const quote = Intern("quote");
+    static const Symbol* const lambda = Intern("lambda");
+    static const Symbol* const define = Intern("define");
+    static const Symbol* const define_memo = Intern("define-memo");
+    const Object* head = cell->GetFirst().GetObject();
+    if (head == quote || head == lambda) {
+        return;
+    }
+    const Cell* target = As<Cell>(rest);
+    if ((head == define || head == define_memo) && target != nullptr) {
+        const Value defined = target->GetFirst();
+        if (const Symbol* symbol = As<Symbol>(defined)) {
+            frame->Add(symbol);
+            rest = target->GetSecond();
+        } else if (const Cell* signature = As<Cell>(defined)) {
+            if (const Symbol* func = As<Symbol>(signature->GetFirst())) {
+                frame->Add(func);
+            }
+            return;
+        }
+    }
+    while (const Cell* element = As<Cell>(rest)) {
+        CollectDefines(element->GetFirst(), frame);
+        rest = element->GetSecond();
+    }
+}
+
+static std::shared_ptr<const Procedure> CompileBody(const std::string& name,
+                                                    const std::vector<const Symbol*>& args,
+                                                    const std::vector<Value>& list,
+                                                    size_t body_begin, const Frame* parent) {
+    std::shared_ptr<Procedure> procedure(new Procedure);
+    procedure->name = name;
+    Frame frame{parent, {}};
+    if (parent != nullptr) {
+        frame.layout->parent = parent->layout;
+        parent->makes_closures = true;
+    }
+    for (const Symbol* arg : args) {
+        if (frame.slots.count(arg->GetId()) != 0) {
+            throw SyntaxError("Duplicate argument name: " + arg->GetName());
+        }
+        frame.Add(arg);
+        procedure->arg_names.push_back(arg->GetName());
+    }
+    for (size_t i = body_begin; i < list.size(); ++i) {
+        CollectDefines(list[i], &frame);
+    }
+    procedure->num_slots = frame.slots.size();
+    procedure->expressions.assign(list.begin() + body_begin, list.end());
+    procedure->body = CompileAll(list, body_begin, &frame, true);
+    procedure->makes_closures = frame.makes_closures;
+    procedure->code = Assemble(procedure->body);
+    procedure->layout = frame.layout;
+    return procedure;
+}
+
+static std::shared_ptr<Node> CompileLambda(const std::string& name,
+                                           const std::vector<const Symbol*>& args,
+                                           const std::vector<Value>& list,
+                                           size_t body_begin, const Frame* parent) {
+    return std::shared_ptr<Node>(
+        new LambdaNode(CompileBody(name, args, list, body_begin, parent)));
+}
+
+static std::shared_ptr<Node> CompileDefine(const Symbol* symbol,
+                                           const std::shared_ptr<Node>& value, const Frame* frame) {
+    if (frame == nullptr) {
+        return std::shared_ptr<Node>(new GlobalDefineNode(symbol, value));
+    }
+    return std::shared_ptr<Node>(new LocalDefineNode(frame->slots.at(symbol->GetId()), value));
+}
+
+// (lambda args body...), named after the variable a define binds it to.
+static std::shared_ptr<Node> CompileLambdaForm(const std::string& name,
+                                               const std::vector<Value>& list,
+                                               const Frame* frame) {
+    if (list.size() < 3) {
+        throw SyntaxError("Invalid lambda");
+    }
+    std::vector<const Symbol*> args;
+    try {
+        args = ToSymbols(list[1]);
+    } catch (const RuntimeError&) {
+        throw SyntaxError("Invalid lambda");
+    }
+    return CompileLambda(name, args, list, 2, frame);
+}
+
+static bool IsLambdaForm(const Value& value) {
+    static const Symbol* const lambda = Intern("lambda");
+    const Cell* cell = As<Cell>(value);
+    return cell != nullptr && cell->GetFirst().GetObject() == lambda;
+}
+
+// Special forms receive the whole form, the head included.
+using SpecialForm = std::shared_ptr<Node> (*)(const std::vector<Value>&, const Frame*,
+                                              bool tail);
+
+static std::map<std::string, SpecialForm> MakeSpecialForms() {
+    std::map<std::string, SpecialForm> forms;
+    forms["quote"] = [](const std::vector<Value>& list,
+                        const Frame*, bool) -> std::shared_ptr<Node> {
+        if (list.size() != 2) {
+            throw SyntaxError("Invalid quote");
+        }
+        return std::shared_ptr<Node>(new ConstNode(list[1]));
+    };
+    forms["if"] = [](const std::vector<Value>& list,
+                     const Frame* frame, bool tail) -> std::shared_ptr<Node> {
+        const size_t n = list.size();
+        if (n != 3 && n != 4) {
+            throw SyntaxError("Invalid if");
+        }
+        std::shared_ptr<Node> condition = CompileExpression(list[1], frame);
+        Value value;
+        // The dead branch is not compiled at all, so that its lambdas neither make the frame look
+        // captured nor its variables take global slots.
+        if (IsConstant(condition, &value)) {
+            if (AsBoolean(value)) {
+                return CompileExpression(list[2], frame, tail);
+            }
+            return n == 4 ? CompileExpression(list[3], frame, tail)
+                          : std::shared_ptr<Node>(new ConstNode(nullptr));
+        }
+        std::shared_ptr<Node> then_branch = CompileExpression(list[2], frame, tail);
+        std::shared_ptr<Node> else_branch;
+        if (n == 4) {
+            else_branch = CompileExpression(list[3], frame, tail);
+        }
+        return std::shared_ptr<Node>(new IfNode(condition, then_branch, else_branch));
+    };
+    forms["define"] = [](const std::vector<Value>& list,
+                         const Frame* frame, bool) -> std::shared_ptr<Node> {
+        const size_t n = list.size();
+        if (n <= 1) {
+            throw SyntaxError("Invalid define");
+        }
+        if (Symbol* symbol = As<Symbol>(list[1])) {
+            if (n != 3) {
+                throw SyntaxError("Invalid define");
+            }
+            if (IsLambdaForm(list[2])) {
+                return CompileDefine(
+                    symbol, CompileLambdaForm(symbol->GetName(), UnfoldList(list[2]), frame),
+                    frame);
+            }
+            return CompileDefine(symbol, CompileExpression(list[2], frame), frame);
+        }
+        if (n < 3) {
+            throw SyntaxError("Invalid define");
+        }
+        std::vector<const Symbol*> symbols;
+        try {
+            symbols = ToSymbols(list[1]);
+        } catch (const RuntimeError&) {
+            throw SyntaxError("Invalid define");
+        }
+        if (symbols.empty()) {
+            throw SyntaxError("Invalid define");
+        }
+        const Symbol* func = symbols.front();
+        symbols.erase(symbols.begin());
+        return CompileDefine(func, CompileLambda(func->GetName(), symbols, list, 2, frame), frame);
+    };
+    // (define-memo (name args...) body...) defines name as (memoize (lambda (args...) body...)).
+    forms["define-memo"] = [](const std::vector<Value>& list,
+                              const Frame* frame, bool) -> std::shared_ptr<Node> {
+        std::vector<const Symbol*> symbols;
+        if (list.size() >= 3) {
+            try {
+                symbols = ToSymbols(list[1]);
+            } catch (const RuntimeError&) {
+            }
+        }
+        if (symbols.empty()) {
+            throw SyntaxError("Invalid define-memo");
+        }
+        const Symbol* func = symbols.front();
+        symbols.erase(symbols.begin());
+        static const Command memoize = FindCommand(Intern("memoize"));
+        const std::vector<std::shared_ptr<Node>> args{
+            CompileLambda(func->GetName(), symbols, list, 2, frame)};
+        return CompileDefine(func, std::shared_ptr<Node>(new BuiltinCallNode(memoize, args)),
+                             frame);
+    };
+    forms["set!"] = [](const std::vector<Value>& list,
+                       const Frame* frame, bool) -> std::shared_ptr<Node> {
+        if (list.size() != 3) {
+            throw SyntaxError("Invalid set!");
+        }
+        Symbol* symbol = As<Symbol>(list[1]);
+        if (symbol == nullptr) {
+            throw SyntaxError("Invalid set!");
+        }
+        std::shared_ptr<Node> value = CompileExpression(list[2], frame);
+        size_t depth, slot;
+        if (Resolve(frame, symbol, &depth, &slot)) {
+            return std::shared_ptr<Node>(new LocalSetNode(depth, slot, value));
+        }
+        return std::shared_ptr<Node>(new GlobalSetNode(symbol, value));
+    };
+    forms["lambda"] = [](const std::vector<Value>& list,
+                         const Frame* frame, bool) -> std::shared_ptr<Node> {
+        return CompileLambdaForm("lambda", list, frame);
+    };
+    forms["and"] = [](const std::vector<Value>& list,
+                      const Frame* frame, bool tail) -> std::shared_ptr<Node> {
+        std::vector<std::shared_ptr<Node>> args;
+        if (std::shared_ptr<Node> folded = CompileShortCircuit(list, frame, tail, false, &args)) {
+            return folded;
+        }
+        return std::shared_ptr<Node>(new AndNode(args));
+    };
+    forms["or"] = [](const std::vector<Value>& list,
+                     const Frame* frame, bool tail) -> std::shared_ptr<Node> {
+        std::vector<std::shared_ptr<Node>> args;
+        if (std::shared_ptr<Node> folded = CompileShortCircuit(list, frame, tail, true, &args)) {
+            return folded;
+        }
+        return std::shared_ptr<Node>(new OrNode(args));
+    };
+    return forms;
+}
+
+static SpecialForm FindSpecialForm(const Symbol* symbol) {
+    static const std::unordered_map<size_t, SpecialForm> forms = [] {
+        std::unordered_map<size_t, SpecialForm> forms;
+        for (const auto& entry : MakeSpecialForms()) {
+            forms[Intern(entry.first)->GetId()] = entry.second;
+        }
+        return forms;
+    }();
+    const auto iter = forms.find(symbol->GetId());
+    return (iter != forms.end() ? iter->second : nullptr);
+}
+
+static std::shared_ptr<Node> CompileForm(const Value& form, const Frame* frame, bool tail) {
+    const std::vector<Value> list = UnfoldList(form);
+    if (Symbol* symbol = As<Symbol>(list.front())) {
+        if (SpecialForm form = FindSpecialForm(symbol)) {
+            return form(list, frame, tail);
+        }
+        // Builtins are bound when a call is compiled: a define cannot replace them.
+        if (Command command = FindCommand(symbol)) {
+            std::vector<std::shared_ptr<Node>> args = CompileAll(list, 1, frame);
+            if (std::shared_ptr<Node> folded = FoldBuiltin(symbol, args)) {
+                return folded;
+            }
+            const Op op = (args.size() == 2 ? FindBinaryOp(symbol) : kBuiltin);
+            if (op != kBuiltin) {
+                return std::shared_ptr<Node>(new BinaryBuiltinNode(op, command, args[0], args[1]));
+            }
+            return std::shared_ptr<Node>(new BuiltinCallNode(command, args));
+        }
+    }
+    return std::shared_ptr<Node>(new CallNode(form, CompileExpression(list.front(), frame),
+                                              CompileAll(list, 1, frame), tail));
+}
+
+static std::shared_ptr<Node> CompileExpression(const Value& object, const Frame* frame,
+                                               bool tail) {
+    if (object.IsFixnum() || object.IsBoolean() || object.IsChar()) {
+        return std::shared_ptr<Node>(new ConstNode(object));
+    }
+    if (object.IsObject()) {
+        switch (object.GetObject()->GetType()) {
+            case ObjectType::kNumber:
+            case ObjectType::kReal:
+            case ObjectType::kString:
+            case ObjectType::kVector:
+                return std::shared_ptr<Node>(new ConstNode(object));
+            case ObjectType::kSymbol: {
+                Symbol* symbol = static_cast<Symbol*>(object.GetObject());
+                size_t depth, slot;
+                if (Resolve(frame, symbol, &depth, &slot)) {
+                    return std::shared_ptr<Node>(new LocalRefNode(symbol, depth, slot));
+                }
+                return std::shared_ptr<Node>(new GlobalRefNode(symbol));
+            }
+            case ObjectType::kCell:
+                return CompileForm(object, frame, tail);
+            case ObjectType::kHashTable:
+            case ObjectType::kLambda:
+                break;
+        }
+    }
+    throw RuntimeError(std::string("Cannot evaluate: ") + ToString(object));
+}
+
+std::shared_ptr<Node> Compile(const Value& object, GlobalLayout* layout) {
+    GlobalsGuard guard(layout);
+    return CompileExpression(object, nullptr);
+}
+
+std::shared_ptr<const Code> CompileToCode(const Value& object, GlobalLayout* layout) {
+    return Assemble({Compile(object, layout)});
+}
+
+// The frames around the lambda are rebuilt from their layouts, outermost first, so that its
+// variables resolve to the same slots as when it was first compiled.
+std::shared_ptr<const Procedure> CompileProcedure(
+    const std::string& name, size_t num_args, const std::vector<Value>& expressions,
+    const std::shared_ptr<const FrameLayout>& layout, GlobalLayout* global_layout) {
+    GlobalsGuard guard(global_layout);
+    std::vector<const FrameLayout*> enclosing;
+    for (const FrameLayout* level = layout->parent.get(); level; level = level->parent.get()) {
+        enclosing.push_back(level);
+    }
+    std::vector<std::unique_ptr<Frame>> frames;
+    const Frame* parent = nullptr;
+    for (auto iter = enclosing.rbegin(); iter != enclosing.rend(); ++iter) {
+        frames.emplace_back(new Frame{parent, {}});
+        Frame* frame = frames.back().get();
+        if (parent != nullptr) {
+            frame->layout->parent = parent->layout;
+        }
+        for (const Symbol* symbol : (*iter)->slots) {
+            frame->Add(symbol);
+        }
+        parent = frame;
+    }
+    const std::vector<const Symbol*> args(layout->slots.begin(),
+                                          layout->slots.begin() + num_args);
+    return CompileBody(name, args, expressions, 0, parent);
+}
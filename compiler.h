@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "object.h"
+
+class GlobalLayout;
+class Interpreter;
+class Scope;
+struct Code;
+
+// A pre-analyzed expression. Forms are compiled once and then evaluated any number of times
+// without looking at the original Cell lists again. Nodes are evaluated in the frame of the
+// enclosing lambda call, or in a null frame at the top level.
+class Node {
+public:
+    virtual ~Node() = default;
+    virtual Value Eval(Interpreter*, Scope*) const = 0;
+    virtual void Emit(Code*) const = 0;  // appends the equivalent bytecode
+};
+
+// The variables of the frames of a lambda's calls in slot order, and those of the frames around
+// them: what compiling the lambda's body on its own takes (see CompileProcedure).
+struct FrameLayout {
+    std::vector<const Symbol*> slots;
+    std::shared_ptr<const FrameLayout> parent;  // nullptr at the top level
+};
+
+// Everything a closure shares with the other closures created by the same lambda expression.
+struct Procedure {
+    std::string name;  // of the define that binds it, "lambda" if there is none; for profiles
+    std::vector<std::string> arg_names;  // occupy the first slots of the frame
+    size_t num_slots;
+    bool makes_closures;  // whether the body contains lambdas, which may capture the frame
+    std::vector<Value> expressions;  // source, used for printing
+    std::vector<std::shared_ptr<Node>> body;
+    std::shared_ptr<const Code> code;  // the body, for the VM
+    std::shared_ptr<const FrameLayout> layout;
+};
+
+// Throws SyntaxError on malformed special forms. The code runs in global scopes with the layout
+// it was compiled for, to which global variables it refers to are added (see GlobalLayout).
+std::shared_ptr<Node> Compile(const Value&, GlobalLayout* globals);
+std::shared_ptr<const Code> CompileToCode(const Value&, GlobalLayout* globals);
+
+// Compiles the body of a lambda again from what its Procedure keeps: the first num_args slots of
+// the layout are its arguments. Loading an image (see image.h) does this.
+std::shared_ptr<const Procedure> CompileProcedure(const std::string& name, size_t num_args,
+                                                  const std::vector<Value>& expressions,
+                                                  const std::shared_ptr<const FrameLayout>&,
+                                                  GlobalLayout* globals);
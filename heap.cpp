@@ -0,0 +1,125 @@
+#include "heap.h"
+#include "error.h"
+#include "object.h"
+#include <algorithm>
+
+thread_local Heap* Heap::current_ = nullptr;
+
+void* Arena::AllocateSlow(SizeClass* size_class, size_t size) {
+    size = (size + kGranularity - 1) / kGranularity * kGranularity;
+    if (size_class->next + size > size_class->end) {
+        chunks_.emplace_back(new char[kChunkSize]);
+        size_class->next = chunks_.back().get();
+        size_class->end = size_class->next + kChunkSize;
+    }
+    void* memory = size_class->next;
+    size_class->next += size;
+    return memory;
+}
+
+Heap::Heap(const HeapOptions& options) : options_(options), threshold_(options.initial_size) {
+}
+
+Heap::Heap(const HeapOptions& options, const Heap& parent) : Heap(options) {
+    if (parent.depth_ == UINT8_MAX) {
+        throw RuntimeError("Heaps nested too deeply");
+    }
+    depth_ = parent.depth_ + 1;
+}
+
+Heap::~Heap() {
+    while (objects_ != nullptr) {
+        GcObject* next = objects_->next_;
+        Destroy(objects_);
+        objects_ = next;
+    }
+}
+
+void Heap::Destroy(GcObject* object) {
+    void* memory = dynamic_cast<void*>(object);  // the start of the most derived object
+    const size_t size = object->size_;
+    object->~GcObject();
+    arena_.Free(memory, size);
+}
+
+Heap* Heap::Current() {
+    static thread_local Heap fallback;
+    return (current_ != nullptr ? current_ : &fallback);
+}
+
+void Heap::AddRoot(GcObject* object) {
+    roots_.push_back(object);
+}
+
+void Heap::AddRootSet(const RootSet* roots) {
+    root_sets_.push_back(roots);
+}
+
+void Heap::Mark(GcObject* object) {
+    if (object != nullptr && object->depth_ == depth_ && !object->marked_) {
+        object->marked_ = true;
+        gray_.push_back(object);
+    }
+}
+
+void Heap::Mark(const Value& value) {
+    Mark(value.GetObject());
+}
+
+void Heap::Collect() {
+    if (frozen_) {
+        return;
+    }
+    for (GcObject* root : roots_) {
+        Mark(root);
+    }
+    for (const std::vector<Value>* values : root_lists_) {
+        for (const Value& value : *values) {
+            Mark(value);
+        }
+    }
+    for (const RootSet* roots : root_sets_) {
+        roots->Trace(this);
+    }
+    // An explicit gray stack rather than recursion, so that long lists cannot overflow the
+    // C++ stack.
+    while (!gray_.empty()) {
+        GcObject* object = gray_.back();
+        gray_.pop_back();
+        object->Trace(this);
+    }
+    GcObject** link = &objects_;
+    while (*link != nullptr) {
+        GcObject* object = *link;
+        if (object->marked_) {
+            object->marked_ = false;
+            link = &object->next_;
+        } else {
+            *link = object->next_;
+            --stats_.live_objects;
+            ++stats_.freed_objects;
+            stats_.live_bytes -= object->size_ + object->GetExternalSize();
+            Destroy(object);
+        }
+    }
+    ++stats_.collections;
+    threshold_ = std::max(options_.initial_size, 2 * stats_.live_bytes);
+    if (options_.max_size != 0 && stats_.live_bytes > options_.max_size) {
+        throw RuntimeError("Heap exhausted: " + std::to_string(stats_.live_bytes) +
+                           " bytes live");
+    }
+}
+
+void Heap::MaybeCollect() {
+    if (stats_.live_bytes >= threshold_) {
+        Collect();
+    }
+}
+
+void Heap::Freeze() {
+    Collect();
+    for (GcObject* object = objects_; object != nullptr; object = object->next_) {
+        object->depth_ = 0;
+    }
+    frozen_ = true;
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+class Heap;
+class Value;
+
+// Header of everything the collector manages: Cells, Lambdas, boxed numbers and Scopes.
+// Interned symbols are Objects too, but live outside any heap and are never collected.
+class GcObject {
+    friend class Heap;
+
+    GcObject* next_ = nullptr;  // all objects of a heap form a list, for sweeping
+    uint32_t size_ = 0;
+    uint8_t depth_ = 0;  // of the heap that manages it, 0 for none
+    bool marked_ = false;
+
+public:
+    virtual ~GcObject() = default;
+
+    // Whether no collector owns this object: it belongs to a frozen heap (see Heap::Freeze), or
+    // to no heap at all. Such objects are shared, so they must not be modified.
+    bool IsFrozen() const {
+        return depth_ == 0;
+    }
+
+    // Marks every object this one references, with heap->Mark().
+    virtual void Trace(Heap*) const {
+    }
+
+    // Memory the object holds outside the heap, such as the elements of a Vector, which counts
+    // towards the bytes of its heap like the object itself. Whatever it is once the object is
+    // constructed is counted by Heap::Allocate; an object that grows or shrinks it afterwards
+    // reports the difference with Heap::AddExternalBytes and RemoveExternalBytes.
+    virtual size_t GetExternalSize() const {
+        return 0;
+    }
+};
+
+// Something outside the heap that holds references into it, e.g. the stack of the VM.
+class RootSet {
+public:
+    virtual ~RootSet() = default;
+    virtual void Trace(Heap*) const = 0;
+};
+
+// Size-segregated free lists carved out of large chunks. Objects allocated one after another
+// (the cells of a list, most of the time) end up next to each other in memory, and freeing
+// and reusing a slot never goes to malloc. Requests above kMaxSize do.
+class Arena {
+    static constexpr size_t kGranularity = 8;
+    static constexpr size_t kMaxSize = 128;
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct SizeClass {
+        FreeSlot* free = nullptr;
+        char* next = nullptr;  // unused part of the last chunk
+        char* end = nullptr;
+    };
+
+    SizeClass classes_[kMaxSize / kGranularity];
+    std::vector<std::unique_ptr<char[]>> chunks_;
+
+    void* AllocateSlow(SizeClass*, size_t size);
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size) {
+        if (size > kMaxSize) {
+            return ::operator new(size);
+        }
+        SizeClass* size_class = &classes_[(size - 1) / kGranularity];
+        if (FreeSlot* slot = size_class->free) {
+            size_class->free = slot->next;
+            return slot;
+        }
+        return AllocateSlow(size_class, size);
+    }
+
+    void Free(void* memory, size_t size) {  // size is the one passed to Allocate
+        if (size > kMaxSize) {
+            ::operator delete(memory);
+            return;
+        }
+        SizeClass* size_class = &classes_[(size - 1) / kGranularity];
+        FreeSlot* slot = static_cast<FreeSlot*>(memory);
+        slot->next = size_class->free;
+        size_class->free = slot;
+    }
+
+    size_t GetReservedBytes() const {
+        return chunks_.size() * kChunkSize;
+    }
+};
+
+struct HeapOptions {
+    size_t initial_size = 1 << 20;  // bytes allocated before the first collection
+    size_t max_size = 0;            // live bytes a collection may leave, 0 for no limit
+};
+
+struct GcStats {
+    size_t collections = 0;
+    size_t allocated_objects = 0;  // since the heap was created
+    size_t allocated_bytes = 0;
+    size_t freed_objects = 0;
+    size_t live_objects = 0;  // including garbage not collected yet
+    size_t live_bytes = 0;  // of objects and of the memory they hold (see GetExternalSize)
+};
+
+// A mark-and-sweep heap. Allocation never collects: collections only happen at safe points
+// (see MaybeCollect), where every value that is still needed is reachable from the roots.
+//
+// A heap may be nested in another, for a thread that works for the owner of that heap while the
+// owner waits. Its objects may then refer to those of the heaps it is nested in, which it must
+// neither mark nor modify: every object records the depth of its heap, and a heap only marks,
+// and owns, the objects of its own depth. No object refers to those of another heap of the same
+// depth.
+class Heap {
+    friend class Roots;
+
+    HeapOptions options_;
+    GcStats stats_;
+    Arena arena_;
+    size_t threshold_;
+    GcObject* objects_ = nullptr;
+    std::vector<GcObject*> roots_;
+    std::vector<const std::vector<Value>*> root_lists_;
+    std::vector<const RootSet*> root_sets_;
+    std::vector<GcObject*> gray_;
+    uint8_t depth_ = 1;
+    bool frozen_ = false;
+
+    static thread_local Heap* current_;
+    friend class CurrentHeapGuard;
+
+    void Destroy(GcObject*);
+
+public:
+    explicit Heap(const HeapOptions& options = HeapOptions());
+    Heap(const HeapOptions& options, const Heap& parent);  // nested in parent
+    ~Heap();  // frees every object, reachable or not
+
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    // The heap of the interpreter running on this thread; a per-thread heap that is never
+    // collected when there is none.
+    static Heap* Current();
+
+    template <class T, class... Args>
+    T* Allocate(Args&&... args) {
+        void* memory = arena_.Allocate(sizeof(T));
+        T* object;
+        try {
+            object = new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            arena_.Free(memory, sizeof(T));
+            throw;
+        }
+        GcObject* header = object;
+        header->next_ = objects_;
+        header->size_ = sizeof(T);
+        header->depth_ = depth_;
+        objects_ = header;
+        ++stats_.allocated_objects;
+        ++stats_.live_objects;
+        AddExternalBytes(sizeof(T) + header->GetExternalSize());
+        return object;
+    }
+
+    // For the memory an object of this heap holds outside it, see GcObject::GetExternalSize.
+    void AddExternalBytes(size_t bytes) {
+        stats_.allocated_bytes += bytes;
+        stats_.live_bytes += bytes;
+    }
+
+    void RemoveExternalBytes(size_t bytes) {
+        stats_.live_bytes -= bytes;
+    }
+
+    bool Owns(const GcObject* object) const {  // of the objects this heap's values refer to
+        return object->depth_ == depth_;
+    }
+
+    void AddRoot(GcObject*);  // a root for the lifetime of the heap
+    void AddRootSet(const RootSet*);
+
+    void Mark(GcObject*);
+    void Mark(const Value&);
+
+    void Collect();      // throws RuntimeError if live data exceeds options.max_size
+    void MaybeCollect();  // collects if enough was allocated since the last collection
+
+    // Collects one last time and turns every surviving object into a shared constant: other
+    // heaps no longer mark or trace them (see GcObject::IsFrozen), and this heap never collects
+    // again, it only frees everything when it is destroyed.
+    void Freeze();
+
+    const GcStats& GetStats() const {
+        return stats_;
+    }
+
+    const HeapOptions& GetOptions() const {
+        return options_;
+    }
+
+    size_t GetReservedBytes() const {  // memory held by the arena, used or not
+        return arena_.GetReservedBytes();
+    }
+};
+
+// Allocates in the current heap.
+template <class T, class... Args>
+T* Make(Args&&... args) {
+    return Heap::Current()->Allocate<T>(std::forward<Args>(args)...);
+}
+
+// Makes a heap current on this thread until the end of the enclosing block.
+class CurrentHeapGuard {
+    Heap* previous_;
+
+public:
+    explicit CurrentHeapGuard(Heap* heap) : previous_(Heap::current_) {
+        Heap::current_ = heap;
+    }
+
+    ~CurrentHeapGuard() {
+        Heap::current_ = previous_;
+    }
+};
+
+// Roots objects that are only referenced from C++ locals until the end of the enclosing block.
+// Anything that may reach a safe point while holding such a value must register it here.
+class Roots {
+    Heap* heap_;
+    size_t num_roots_, num_lists_;
+
+public:
+    explicit Roots(Heap* heap)
+        : heap_(heap), num_roots_(heap->roots_.size()), num_lists_(heap->root_lists_.size()) {
+    }
+
+    ~Roots() {
+        heap_->roots_.resize(num_roots_);
+        heap_->root_lists_.resize(num_lists_);
+    }
+
+    Roots(const Roots&) = delete;
+    Roots& operator=(const Roots&) = delete;
+
+    void Add(GcObject* object) {
+        heap_->roots_.push_back(object);
+    }
+
+    void Add(const Value&);
+
+    void Add(const std::vector<Value>* values) {  // the vector may keep growing
+        heap_->root_lists_.push_back(values);
+    }
+};
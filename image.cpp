@@ -0,0 +1,668 @@
+#include "image.h"
+#include "compiler.h"
+#include "error.h"
+#include "memo.h"
+#include <cstring>
+#include <iterator>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// An image is the magic and the version followed by these tables, each a count and then its
+// entries: symbols, frame layouts, the kinds of the objects, their contents, procedures and
+// globals. Counts and indices are LEB128 varints; references that may be null are an index
+// plus one, 0 for null. Numbers, strings, symbols and immediate values are written inline.
+static constexpr char kMagic[8] = {'S', 'C', 'M', 'I', 'M', 'A', 'G', 'E'};
+static constexpr uint64_t kVersion = 3;
+
+enum class ImageKind : uint8_t {
+    kCell,
+    kVector,     // followed by its size
+    kHashTable,
+    kLambda,
+    kScope,      // followed by its number of slots
+};
+
+enum class ImageTag : uint8_t {
+    kNull,
+    kFalse,
+    kTrue,
+    kUnbound,
+    kFixnum,  // zigzag varint
+    kBignum,  // decimal text
+    kReal,    // the 8 bytes of the double, little-endian
+    kSymbol,  // symbol index
+    kObject,  // object index, of anything but a scope
+    kString,  // its size and bytes
+    kChar,    // its byte
+};
+
+class ImageWriter {
+    std::string out_;
+    std::unordered_map<const Symbol*, size_t> symbol_indices_;
+    std::vector<const Symbol*> symbols_;
+    std::unordered_map<const FrameLayout*, size_t> layout_indices_;
+    std::vector<const FrameLayout*> layouts_;  // parents first
+    std::unordered_map<const GcObject*, size_t> object_indices_;
+    std::vector<std::pair<const GcObject*, ImageKind>> objects_;
+    std::unordered_map<const Procedure*, size_t> procedure_indices_;
+    std::vector<const Procedure*> procedures_;
+
+    size_t AddSymbol(const Symbol*);
+    size_t AddLayout(const FrameLayout*);
+    void AddObject(const GcObject*, ImageKind);
+    void AddValue(const Value&);
+    void AddProcedure(const Procedure*);
+    void AddReferences(const GcObject*, ImageKind);
+
+    void PutVarint(uint64_t);
+    void PutString(std::string_view);
+    void PutObject(const GcObject*);  // as a reference that may be null
+    void PutValue(const Value&);
+    void PutContents(const GcObject*, ImageKind);
+
+public:
+    std::string Write(const GlobalScope& globals);
+};
+
+size_t ImageWriter::AddSymbol(const Symbol* symbol) {
+    const auto [iter, added] = symbol_indices_.emplace(symbol, symbols_.size());
+    if (added) {
+        symbols_.push_back(symbol);
+    }
+    return iter->second;
+}
+
+// Recurses once per enclosing lambda, which source nesting bounds.
+size_t ImageWriter::AddLayout(const FrameLayout* layout) {
+    const auto iter = layout_indices_.find(layout);
+    if (iter != layout_indices_.end()) {
+        return iter->second;
+    }
+    if (layout->parent != nullptr) {
+        AddLayout(layout->parent.get());
+    }
+    for (const Symbol* symbol : layout->slots) {
+        AddSymbol(symbol);
+    }
+    layout_indices_[layout] = layouts_.size();
+    layouts_.push_back(layout);
+    return layouts_.size() - 1;
+}
+
+void ImageWriter::AddObject(const GcObject* object, ImageKind kind) {
+    if (object != nullptr && object_indices_.emplace(object, objects_.size()).second) {
+        objects_.emplace_back(object, kind);
+    }
+}
+
+void ImageWriter::AddValue(const Value& value) {
+    if (!value.IsObject() || Is<Number>(value) || Is<Real>(value) || Is<String>(value)) {
+        return;
+    }
+    if (const Symbol* symbol = As<Symbol>(value)) {
+        AddSymbol(symbol);
+    } else if (Is<Cell>(value)) {
+        AddObject(value.GetObject(), ImageKind::kCell);
+    } else if (Is<Vector>(value)) {
+        AddObject(value.GetObject(), ImageKind::kVector);
+    } else if (Is<HashTable>(value)) {
+        AddObject(value.GetObject(), ImageKind::kHashTable);
+    } else if (Is<Lambda>(value)) {
+        AddObject(value.GetObject(), ImageKind::kLambda);
+    } else {
+        throw RuntimeError("Cannot save in an image: " + ToString(value));
+    }
+}
+
+void ImageWriter::AddProcedure(const Procedure* procedure) {
+    if (procedure_indices_.emplace(procedure, procedures_.size()).second) {
+        procedures_.push_back(procedure);
+        AddLayout(procedure->layout.get());
+        for (const Value& expression : procedure->expressions) {
+            AddValue(expression);
+        }
+    }
+}
+
+void ImageWriter::AddReferences(const GcObject* object, ImageKind kind) {
+    switch (kind) {
+        case ImageKind::kCell: {
+            const Cell* cell = static_cast<const Cell*>(object);
+            AddValue(cell->GetFirst());
+            AddValue(cell->GetSecond());
+            break;
+        }
+        case ImageKind::kVector:
+            for (const Value& element : static_cast<const Vector*>(object)->GetElements()) {
+                AddValue(element);
+            }
+            break;
+        case ImageKind::kHashTable:
+            static_cast<const HashTable*>(object)->ForEach(
+                [this](const Value& key, const Value& value) {
+                    AddValue(key);
+                    AddValue(value);
+                });
+            break;
+        case ImageKind::kLambda: {
+            const Lambda* lambda = static_cast<const Lambda*>(object);
+            AddProcedure(&lambda->GetProcedure());
+            AddObject(lambda->GetScope(), ImageKind::kScope);
+            break;
+        }
+        case ImageKind::kScope: {
+            const Scope* scope = static_cast<const Scope*>(object);
+            AddObject(scope->GetParent(), ImageKind::kScope);
+            for (size_t i = 0; i != scope->GetNumSlots(); ++i) {
+                AddValue(scope->GetSlot(i));
+            }
+            break;
+        }
+    }
+}
+
+void ImageWriter::PutVarint(uint64_t value) {
+    while (value >= 0x80) {
+        out_.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out_.push_back(static_cast<char>(value));
+}
+
+void ImageWriter::PutString(std::string_view text) {
+    PutVarint(text.size());
+    out_.append(text);
+}
+
+void ImageWriter::PutObject(const GcObject* object) {
+    PutVarint(object == nullptr ? 0 : object_indices_.at(object) + 1);
+}
+
+void ImageWriter::PutValue(const Value& value) {
+    const auto put_tag = [this](ImageTag tag) { out_.push_back(static_cast<char>(tag)); };
+    if (value.IsNull()) {
+        put_tag(ImageTag::kNull);
+    } else if (value.IsBoolean()) {
+        put_tag(value.IsFalse() ? ImageTag::kFalse : ImageTag::kTrue);
+    } else if (value.IsUnbound()) {
+        put_tag(ImageTag::kUnbound);
+    } else if (value.IsChar()) {
+        put_tag(ImageTag::kChar);
+        out_.push_back(static_cast<char>(value.GetChar()));
+    } else if (value.IsFixnum()) {
+        const int64_t fixnum = value.GetFixnum();
+        put_tag(ImageTag::kFixnum);
+        PutVarint((static_cast<uint64_t>(fixnum) << 1) ^ static_cast<uint64_t>(fixnum >> 63));
+    } else if (const Number* number = As<Number>(value)) {
+        put_tag(ImageTag::kBignum);
+        PutString(number->GetValue().ToString());
+    } else if (const Real* real = As<Real>(value)) {
+        put_tag(ImageTag::kReal);
+        const double number = real->GetValue();
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        for (int i = 0; i != 8; ++i) {
+            out_.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+    } else if (const String* string = As<String>(value)) {
+        put_tag(ImageTag::kString);
+        PutString(string->GetView());
+    } else if (const Symbol* symbol = As<Symbol>(value)) {
+        put_tag(ImageTag::kSymbol);
+        PutVarint(symbol_indices_.at(symbol));
+    } else {
+        put_tag(ImageTag::kObject);
+        PutVarint(object_indices_.at(value.GetObject()));
+    }
+}
+
+void ImageWriter::PutContents(const GcObject* object, ImageKind kind) {
+    switch (kind) {
+        case ImageKind::kCell: {
+            const Cell* cell = static_cast<const Cell*>(object);
+            PutValue(cell->GetFirst());
+            PutValue(cell->GetSecond());
+            break;
+        }
+        case ImageKind::kVector:
+            for (const Value& element : static_cast<const Vector*>(object)->GetElements()) {
+                PutValue(element);
+            }
+            break;
+        case ImageKind::kHashTable: {
+            const HashTable* table = static_cast<const HashTable*>(object);
+            PutVarint(table->GetCount());
+            table->ForEach([this](const Value& key, const Value& value) {
+                PutValue(key);
+                PutValue(value);
+            });
+            break;
+        }
+        case ImageKind::kLambda: {
+            const Lambda* lambda = static_cast<const Lambda*>(object);
+            PutVarint(procedure_indices_.at(&lambda->GetProcedure()));
+            PutObject(lambda->GetScope());
+            // The capacity of its cache, 0 if it is not memoized; the cache starts over empty.
+            PutVarint(lambda->GetMemo() != nullptr ? lambda->GetMemo()->GetCapacity() : 0);
+            break;
+        }
+        case ImageKind::kScope: {
+            const Scope* scope = static_cast<const Scope*>(object);
+            PutObject(scope->GetParent());
+            for (size_t i = 0; i != scope->GetNumSlots(); ++i) {
+                PutValue(scope->GetSlot(i));
+            }
+            break;
+        }
+    }
+}
+
+std::string ImageWriter::Write(const GlobalScope& globals) {
+    std::vector<std::pair<const Symbol*, Value>> variables;
+    const std::vector<Value>& by_slot = globals.GetVariables();
+    for (size_t slot = 0; slot != by_slot.size(); ++slot) {
+        if (!by_slot[slot].IsUnbound()) {
+            variables.emplace_back(globals.GetLayout()->GetName(slot), by_slot[slot]);
+            AddSymbol(variables.back().first);
+            AddValue(by_slot[slot]);
+        }
+    }
+    // Objects and procedures are added as they are found, so the walk needs no recursion.
+    for (size_t i = 0, j = 0; i != objects_.size() || j != procedures_.size();) {
+        if (i != objects_.size()) {
+            AddReferences(objects_[i].first, objects_[i].second);
+            ++i;
+        } else {
+            ++j;  // a procedure adds what it refers to as soon as it is added itself
+        }
+    }
+
+    out_.append(kMagic, sizeof(kMagic));
+    PutVarint(kVersion);
+    PutVarint(symbols_.size());
+    for (const Symbol* symbol : symbols_) {
+        PutString(symbol->GetName());
+    }
+    PutVarint(layouts_.size());
+    for (const FrameLayout* layout : layouts_) {
+        PutVarint(layout->parent == nullptr ? 0 : layout_indices_.at(layout->parent.get()) + 1);
+        PutVarint(layout->slots.size());
+        for (const Symbol* symbol : layout->slots) {
+            PutVarint(symbol_indices_.at(symbol));
+        }
+    }
+    PutVarint(objects_.size());
+    for (const auto& [object, kind] : objects_) {
+        out_.push_back(static_cast<char>(kind));
+        if (kind == ImageKind::kVector) {
+            PutVarint(static_cast<const Vector*>(object)->GetSize());
+        } else if (kind == ImageKind::kScope) {
+            PutVarint(static_cast<const Scope*>(object)->GetNumSlots());
+        }
+    }
+    for (const auto& [object, kind] : objects_) {
+        PutContents(object, kind);
+    }
+    PutVarint(procedures_.size());
+    for (const Procedure* procedure : procedures_) {
+        PutString(procedure->name);
+        PutVarint(procedure->arg_names.size());
+        PutVarint(layout_indices_.at(procedure->layout.get()));
+        PutVarint(procedure->expressions.size());
+        for (const Value& expression : procedure->expressions) {
+            PutValue(expression);
+        }
+    }
+    PutVarint(variables.size());
+    for (const auto& [symbol, value] : variables) {
+        PutVarint(symbol_indices_.at(symbol));
+        PutValue(value);
+    }
+    return std::move(out_);
+}
+
+void SaveImage(const Interpreter& interpreter, std::ostream* out) {
+    const std::string image = ImageWriter().Write(*interpreter.GetScope());
+    out->write(image.data(), image.size());
+}
+
+// Objects are created empty first, lambdas without a procedure, so that their contents can
+// refer to any of them. Procedures are compiled once the objects in their bodies are complete,
+// and hash tables are filled last, when their keys are complete and can be hashed.
+class ImageReader {
+    std::string_view in_;
+    GlobalLayout* globals_;  // that the procedures are compiled for
+    size_t pos_ = 0;
+    size_t claimed_ = 0;  // elements of the vectors and scopes created so far
+    std::vector<Symbol*> symbols_;
+    std::vector<std::shared_ptr<const FrameLayout>> layouts_;
+    std::vector<std::pair<GcObject*, ImageKind>> objects_;
+    std::vector<std::shared_ptr<const Procedure>> procedures_;
+    std::vector<std::pair<Lambda*, size_t>> lambdas_;  // and the index of their procedure
+    std::vector<std::tuple<HashTable*, Value, Value>> entries_;
+
+    [[noreturn]] static void Fail() {
+        throw RuntimeError("Invalid image");
+    }
+
+    uint8_t GetByte();
+    uint64_t GetVarint();
+    size_t GetIndex(size_t size);  // less than size
+    size_t GetSize();  // of a vector or a scope
+    std::string_view GetString();
+    Value GetValue();
+    Scope* GetScope();  // a reference that may be null
+
+    void ReadContents(GcObject*, ImageKind);
+    void CheckForm(const Value&, std::unordered_set<const Cell*>* path,
+                   std::unordered_set<const Cell*>* checked);
+
+public:
+    ImageReader(std::string_view in, GlobalLayout* globals) : in_(in), globals_(globals) {
+    }
+
+    std::vector<std::pair<const Symbol*, Value>> Read();  // the globals
+};
+
+uint8_t ImageReader::GetByte() {
+    if (pos_ == in_.size()) {
+        Fail();
+    }
+    return static_cast<uint8_t>(in_[pos_++]);
+}
+
+uint64_t ImageReader::GetVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const uint8_t byte = GetByte();
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    Fail();
+}
+
+size_t ImageReader::GetIndex(size_t size) {
+    const uint64_t index = GetVarint();
+    if (index >= size) {
+        Fail();
+    }
+    return index;
+}
+
+// Each element takes at least a byte further on, so together the sizes may not claim more than
+// the rest of the image: a small one cannot make the reader allocate more than it is long.
+size_t ImageReader::GetSize() {
+    const uint64_t size = GetVarint();
+    const size_t left = in_.size() - pos_;
+    if (claimed_ > left || size > left - claimed_) {
+        Fail();
+    }
+    claimed_ += size;
+    return size;
+}
+
+std::string_view ImageReader::GetString() {
+    const uint64_t size = GetVarint();
+    if (size > in_.size() - pos_) {
+        Fail();
+    }
+    pos_ += size;
+    return in_.substr(pos_ - size, size);
+}
+
+Value ImageReader::GetValue() {
+    switch (static_cast<ImageTag>(GetByte())) {
+        case ImageTag::kNull:
+            return Value();
+        case ImageTag::kFalse:
+            return GetBooleanConstant(false);
+        case ImageTag::kTrue:
+            return GetBooleanConstant(true);
+        case ImageTag::kUnbound:
+            return Value::Unbound();
+        case ImageTag::kFixnum: {
+            const uint64_t bits = GetVarint();
+            return GetNumberConstant(static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1)));
+        }
+        case ImageTag::kBignum: {
+            const std::string_view digits = GetString();
+            const size_t sign = (!digits.empty() && digits[0] == '-' ? 1 : 0);
+            if (digits.size() == sign ||
+                digits.find_first_not_of("0123456789", sign) != std::string_view::npos) {
+                Fail();
+            }
+            return GetNumberConstant(BigInt::Parse(digits));
+        }
+        case ImageTag::kReal: {
+            uint64_t bits = 0;
+            for (int i = 0; i != 8; ++i) {
+                bits |= static_cast<uint64_t>(GetByte()) << (8 * i);
+            }
+            double number;
+            std::memcpy(&number, &bits, sizeof(number));
+            return GetRealConstant(number);
+        }
+        case ImageTag::kSymbol:
+            return Value(symbols_[GetIndex(symbols_.size())]);
+        case ImageTag::kObject: {
+            const auto& [object, kind] = objects_[GetIndex(objects_.size())];
+            if (kind == ImageKind::kScope) {
+                Fail();
+            }
+            return Value(static_cast<Object*>(object));
+        }
+        case ImageTag::kString:
+            return Value(Make<String>(GetString()));
+        case ImageTag::kChar:
+            return Value::FromChar(GetByte());
+    }
+    Fail();
+}
+
+Scope* ImageReader::GetScope() {
+    const size_t reference = GetIndex(objects_.size() + 1);
+    if (reference == 0) {
+        return nullptr;
+    }
+    const auto& [object, kind] = objects_[reference - 1];
+    if (kind != ImageKind::kScope) {
+        Fail();
+    }
+    return static_cast<Scope*>(object);
+}
+
+void ImageReader::ReadContents(GcObject* object, ImageKind kind) {
+    switch (kind) {
+        case ImageKind::kCell: {
+            Cell* cell = static_cast<Cell*>(object);
+            cell->SetFirst(GetValue());
+            cell->SetSecond(GetValue());
+            break;
+        }
+        case ImageKind::kVector: {
+            Vector* vector = static_cast<Vector*>(object);
+            for (size_t i = 0; i != vector->GetSize(); ++i) {
+                (*vector)[i] = GetValue();
+            }
+            break;
+        }
+        case ImageKind::kHashTable: {
+            HashTable* table = static_cast<HashTable*>(object);
+            for (uint64_t count = GetVarint(); count != 0; --count) {
+                Value key = GetValue();
+                entries_.emplace_back(table, key, GetValue());
+            }
+            break;
+        }
+        case ImageKind::kLambda: {
+            Lambda* lambda = static_cast<Lambda*>(object);
+            const size_t procedure = GetVarint();
+            lambda->scope_ = GetScope();
+            if (const uint64_t capacity = GetVarint()) {
+                lambda->memo_ = Make<MemoCache>(capacity);
+            }
+            lambdas_.emplace_back(lambda, procedure);
+            break;
+        }
+        case ImageKind::kScope: {
+            Scope* scope = static_cast<Scope*>(object);
+            scope->Reset(GetScope(), scope->GetNumSlots());
+            for (size_t i = 0; i != scope->GetNumSlots(); ++i) {
+                scope->GetSlot(i) = GetValue();
+            }
+            break;
+        }
+    }
+}
+
+// Rejects a form that contains itself, through the elements or the tails of its lists, which
+// would make the compiler walk it forever; path holds the cells of the forms that enclose it.
+// What is quoted is data, which the compiler does not walk, so it may be circular.
+void ImageReader::CheckForm(const Value& form, std::unordered_set<const Cell*>* path,
+                            std::unordered_set<const Cell*>* checked) {
+    static const Symbol* const quote = Intern("quote");
+    std::vector<const Cell*> cells;
+    for (const Cell* cell = As<Cell>(form); cell != nullptr && checked->count(cell) == 0;
+         cell = As<Cell>(cell->GetSecond())) {
+        if (!path->insert(cell).second) {
+            Fail();
+        }
+        cells.push_back(cell);
+    }
+    if (cells.empty() || As<Symbol>(cells.front()->GetFirst()) != quote) {
+        for (const Cell* cell : cells) {
+            CheckForm(cell->GetFirst(), path, checked);
+        }
+    }
+    for (const Cell* cell : cells) {
+        path->erase(cell);
+        checked->insert(cell);
+    }
+}
+
+std::vector<std::pair<const Symbol*, Value>> ImageReader::Read() {
+    if (in_.substr(0, sizeof(kMagic)) != std::string_view(kMagic, sizeof(kMagic))) {
+        Fail();
+    }
+    pos_ = sizeof(kMagic);
+    if (GetVarint() != kVersion) {
+        throw RuntimeError("Unsupported image version");
+    }
+    for (uint64_t count = GetVarint(); count != 0; --count) {
+        symbols_.push_back(Intern(GetString()));
+    }
+    for (uint64_t count = GetVarint(); count != 0; --count) {
+        std::shared_ptr<FrameLayout> layout = std::make_shared<FrameLayout>();
+        const size_t parent = GetIndex(layouts_.size() + 1);
+        if (parent != 0) {
+            layout->parent = layouts_[parent - 1];
+        }
+        for (uint64_t size = GetVarint(); size != 0; --size) {
+            layout->slots.push_back(symbols_[GetIndex(symbols_.size())]);
+        }
+        layouts_.push_back(std::move(layout));
+    }
+    for (uint64_t count = GetVarint(); count != 0; --count) {
+        const ImageKind kind = static_cast<ImageKind>(GetByte());
+        GcObject* object;
+        switch (kind) {
+            case ImageKind::kCell:
+                object = Make<Cell>(nullptr, nullptr);
+                break;
+            case ImageKind::kVector:
+                object = Make<Vector>(GetSize(), Value());
+                break;
+            case ImageKind::kHashTable:
+                object = Make<HashTable>();
+                break;
+            case ImageKind::kLambda:
+                object = Make<Lambda>(nullptr, nullptr);
+                break;
+            case ImageKind::kScope:
+                object = Make<Scope>(nullptr, GetSize());
+                break;
+            default:
+                Fail();
+        }
+        objects_.emplace_back(object, kind);
+    }
+    for (const auto& [object, kind] : objects_) {
+        ReadContents(object, kind);
+    }
+    // Until their own are compiled, lambdas have an empty procedure, so that the errors of the
+    // bodies that quote them can print them.
+    const auto pending = std::make_shared<Procedure>();
+    pending->name = "lambda";
+    for (const auto& [lambda, procedure] : lambdas_) {
+        lambda->procedure_ = pending;
+    }
+    for (uint64_t count = GetVarint(); count != 0; --count) {
+        const std::string name(GetString());
+        const size_t num_args = GetVarint();
+        const std::shared_ptr<const FrameLayout>& layout = layouts_[GetIndex(layouts_.size())];
+        if (num_args > layout->slots.size()) {
+            Fail();
+        }
+        std::vector<Value> expressions;
+        std::unordered_set<const Cell*> path, checked;
+        for (uint64_t size = GetVarint(); size != 0; --size) {
+            expressions.push_back(GetValue());
+            CheckForm(expressions.back(), &path, &checked);
+        }
+        // Whatever is wrong with the body, improper lists included, the image is.
+        try {
+            procedures_.push_back(CompileProcedure(name, num_args, expressions, layout, globals_));
+        } catch (const std::exception&) {
+            Fail();
+        }
+    }
+    for (const auto& [lambda, procedure] : lambdas_) {
+        if (procedure >= procedures_.size()) {
+            Fail();
+        }
+        lambda->procedure_ = procedures_[procedure];
+        // The code refers to the frames around it by depth and slot, as its layouts give them.
+        const FrameLayout* level = lambda->procedure_->layout->parent.get();
+        const Scope* scope = lambda->scope_;
+        for (; level != nullptr && scope != nullptr;
+             level = level->parent.get(), scope = scope->GetParent()) {
+            if (scope->GetNumSlots() != level->slots.size()) {
+                Fail();
+            }
+        }
+        if (level != nullptr || scope != nullptr) {
+            Fail();
+        }
+    }
+    std::vector<std::pair<const Symbol*, Value>> globals;
+    for (uint64_t count = GetVarint(); count != 0; --count) {
+        const Symbol* symbol = symbols_[GetIndex(symbols_.size())];
+        globals.emplace_back(symbol, GetValue());
+    }
+    if (pos_ != in_.size()) {
+        Fail();
+    }
+    for (const auto& [table, key, value] : entries_) {
+        table->Set(key, value);
+    }
+    return globals;
+}
+
+// Allocating never collects, so what has been read so far needs no roots until the globals
+// refer to it.
+void LoadImage(Interpreter* interpreter, std::string_view image) {
+    CurrentHeapGuard guard(&interpreter->GetHeap());
+    GlobalScope* globals = interpreter->GetScope();
+    for (const auto& [symbol, value] : ImageReader(image, globals->GetLayout()).Read()) {
+        globals->SetVariable(symbol, value);
+    }
+}
+
+void LoadImage(Interpreter* interpreter, std::istream* in) {
+    const std::string image{std::istreambuf_iterator<char>(*in), std::istreambuf_iterator<char>()};
+    LoadImage(interpreter, image);
+}
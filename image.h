@@ -0,0 +1,23 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string_view>
+
+#include "scheme.h"
+
+// A binary image of the global environment of an interpreter: every global variable and all
+// that it reaches, shared structure and cycles included. Loading an image interns its symbols
+// and rebuilds its objects without tokenizing or reading any text; lambdas are compiled again
+// from the bodies it keeps, which is a small part of the cost of evaluating their source.
+//
+// Images are meant to be read back by the same build of the interpreter.
+
+// Throws RuntimeError if a global reaches something an image cannot hold.
+void SaveImage(const Interpreter&, std::ostream* out);
+
+// Defines the globals of the image in interpreter, replacing those with the same names. The
+// image is read in place, so it may be a memory-mapped file. Throws RuntimeError if the image
+// is malformed, in which case no global has changed.
+void LoadImage(Interpreter*, std::string_view image);
+void LoadImage(Interpreter*, std::istream* in);
@@ -0,0 +1,113 @@
+#include "memo.h"
+#include <algorithm>
+
+// Combines the hashes of the arguments, which are consistent with Equal (see Hash).
+static size_t HashArgs(const std::vector<Value>& args) {
+    size_t hash = args.size();
+    for (const Value& arg : args) {
+        hash ^= Hash(arg) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+MemoCache::MemoCache(size_t capacity) : capacity_(capacity), buckets_(8, kNone) {
+}
+
+void MemoCache::Trace(Heap* heap) const {
+    for (const Entry& entry : entries_) {
+        for (const Value& arg : entry.args) {
+            heap->Mark(arg);
+        }
+        heap->Mark(entry.result);
+    }
+}
+
+size_t MemoCache::FindEntry(const std::vector<Value>& args, size_t hash) const {
+    for (size_t i = buckets_[hash & (buckets_.size() - 1)]; i != kNone; i = entries_[i].next) {
+        const Entry& entry = entries_[i];
+        if (entry.hash == hash &&
+            std::equal(entry.args.begin(), entry.args.end(), args.begin(), args.end(), Equal)) {
+            return i;
+        }
+    }
+    return kNone;
+}
+
+void MemoCache::Unlink(size_t index) {
+    const Entry& entry = entries_[index];
+    (entry.newer != kNone ? entries_[entry.newer].older : newest_) = entry.older;
+    (entry.older != kNone ? entries_[entry.older].newer : oldest_) = entry.newer;
+}
+
+void MemoCache::LinkNewest(size_t index) {
+    Entry& entry = entries_[index];
+    entry.newer = kNone;
+    entry.older = newest_;
+    (newest_ != kNone ? entries_[newest_].newer : oldest_) = index;
+    newest_ = index;
+}
+
+void MemoCache::Unbucket(size_t index) {
+    size_t* link = &buckets_[entries_[index].hash & (buckets_.size() - 1)];
+    while (*link != index) {
+        link = &entries_[*link].next;
+    }
+    *link = entries_[index].next;
+}
+
+void MemoCache::Bucket(size_t index) {
+    size_t& head = buckets_[entries_[index].hash & (buckets_.size() - 1)];
+    entries_[index].next = head;
+    head = index;
+}
+
+void MemoCache::Rehash(size_t num_buckets) {
+    buckets_.assign(num_buckets, kNone);
+    for (size_t i = 0; i != entries_.size(); ++i) {
+        Bucket(i);
+    }
+}
+
+const Value* MemoCache::Find(const std::vector<Value>& args) {
+    const size_t index = FindEntry(args, HashArgs(args));
+    if (index == kNone) {
+        ++misses_;
+        return nullptr;
+    }
+    ++hits_;
+    Unlink(index);
+    LinkNewest(index);
+    return &entries_[index].result;
+}
+
+const Value* MemoCache::Peek(const std::vector<Value>& args) const {
+    const size_t index = FindEntry(args, HashArgs(args));
+    return (index != kNone ? &entries_[index].result : nullptr);
+}
+
+void MemoCache::Add(const std::vector<Value>& args, const Value& result) {
+    const size_t hash = HashArgs(args);
+    size_t index = FindEntry(args, hash);
+    if (index != kNone) {  // by a call that the one with the same arguments made
+        entries_[index].result = result;
+        Unlink(index);
+    } else if (entries_.size() != capacity_) {
+        index = entries_.size();
+        entries_.push_back({args, result, hash, kNone, kNone, kNone});
+        if (entries_.size() > buckets_.size()) {
+            Rehash(2 * buckets_.size());
+        } else {
+            Bucket(index);
+        }
+    } else {
+        index = oldest_;
+        Unlink(index);
+        Unbucket(index);
+        Entry& entry = entries_[index];
+        entry.args = args;
+        entry.result = result;
+        entry.hash = hash;
+        Bucket(index);
+    }
+    LinkNewest(index);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "object.h"
+
+// The results of the calls of a memoized lambda (see Lambda::Call), by their arguments: calls
+// whose arguments are Equal one by one share a result. At most capacity of them are kept; once
+// the cache is full, the least recently used one makes room for the next. Arguments are kept
+// as they were passed, so, as with the keys of a HashTable, modifying one afterwards leaves its
+// entry unreachable until it is evicted.
+class MemoCache : public GcObject {
+    static constexpr size_t kNone = SIZE_MAX;
+
+    struct Entry {
+        std::vector<Value> args;
+        Value result;
+        size_t hash;
+        size_t next;          // in the same bucket
+        size_t newer, older;  // in the order of use
+    };
+
+    size_t capacity_;
+    std::vector<Entry> entries_;  // grows up to capacity_, then the oldest entry is reused
+    std::vector<size_t> buckets_;  // the first entry of each, a power of two of them
+    size_t newest_ = kNone, oldest_ = kNone;
+    size_t hits_ = 0, misses_ = 0;
+
+    size_t FindEntry(const std::vector<Value>& args, size_t hash) const;  // kNone if none
+    void Unlink(size_t index);  // from the order of use
+    void LinkNewest(size_t index);
+    void Unbucket(size_t index);
+    void Bucket(size_t index);
+    void Rehash(size_t num_buckets);
+
+public:
+    static constexpr size_t kDefaultCapacity = 4096;  // see memoize
+
+    explicit MemoCache(size_t capacity);  // capacity must not be 0
+    virtual void Trace(Heap*) const override;
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    size_t GetCount() const {
+        return entries_.size();
+    }
+
+    size_t GetHits() const {
+        return hits_;
+    }
+
+    size_t GetMisses() const {
+        return misses_;
+    }
+
+    // The result of a call with args, which becomes the most recently used, or nullptr; counts
+    // a hit or a miss. The pointer is good until the cache next changes.
+    const Value* Find(const std::vector<Value>& args);
+    // Find, changing nothing, for threads that share the cache with its owner (see ParallelMap).
+    const Value* Peek(const std::vector<Value>& args) const;
+    void Add(const std::vector<Value>& args, const Value& result);
+};
@@ -1,123 +1,482 @@
 #pragma once
 
 #include <cstddef>  // int64_t
+#include <cstdint>  // uintptr_t
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <type_traits>
+
+#include "bigint.h"
+#include "heap.h"
+
+class Object;
+
+// A Scheme value packed into one word. Fixnums, booleans and the empty list are stored inline,
+// so passing them around never allocates; any other value is a pointer to an Object owned by a
+// Heap. Values are plain words: copying one does not keep the object alive (see Roots).
+//
+//   ...xxx1  fixnum, shifted left by one bit
+//   ...x000  pointer to an Object, 0 being the empty list
+//   ...x010  other immediate: #f, #t, a character (its byte above the low byte of the word),
+//            the marker of a variable that is not yet defined, or the marker of a pending tail
+//            call, which never escapes Lambda::Call
+class Value {
+    uintptr_t bits_;
+
+    static constexpr uintptr_t kFixnumTag = 1;
+    static constexpr uintptr_t kTagMask = 7;
+    static constexpr uintptr_t kFalse = 0x02;
+    static constexpr uintptr_t kTrue = 0x0a;
+    static constexpr uintptr_t kUnbound = 0x12;
+    static constexpr uintptr_t kTailCall = 0x1a;
+    static constexpr uintptr_t kCharTag = 0x22;
+    static constexpr uintptr_t kCharTagMask = 0xff;
+
+    static Value FromBits(uintptr_t bits) {
+        Value value;
+        value.bits_ = bits;
+        return value;
+    }
+
+public:
+    static constexpr int64_t kMinFixnum = INT64_MIN >> 1;
+    static constexpr int64_t kMaxFixnum = INT64_MAX >> 1;
+
+    Value() : bits_(0) {
+    }
+
+    Value(std::nullptr_t) : bits_(0) {
+    }
+
+    Value(Object* object) : bits_(reinterpret_cast<uintptr_t>(object)) {
+    }
+
+    static Value FromFixnum(int64_t value) {  // value must be in [kMinFixnum, kMaxFixnum]
+        return FromBits((static_cast<uintptr_t>(value) << 1) | kFixnumTag);
+    }
+
+    static Value FromBoolean(bool value) {
+        return FromBits(value ? kTrue : kFalse);
+    }
+
+    static Value FromChar(unsigned char chr) {
+        return FromBits((static_cast<uintptr_t>(chr) << 8) | kCharTag);
+    }
+
+    static Value Unbound() {
+        return FromBits(kUnbound);
+    }
+
+    static Value TailCall() {
+        return FromBits(kTailCall);
+    }
+
+    bool IsNull() const {
+        return bits_ == 0;
+    }
+
+    bool IsFixnum() const {
+        return (bits_ & kFixnumTag) != 0;
+    }
+
+    bool IsBoolean() const {
+        return bits_ == kFalse || bits_ == kTrue;
+    }
+
+    bool IsFalse() const {
+        return bits_ == kFalse;
+    }
+
+    bool IsChar() const {
+        return (bits_ & kCharTagMask) == kCharTag;
+    }
+
+    bool IsUnbound() const {
+        return bits_ == kUnbound;
+    }
+
+    bool IsTailCall() const {
+        return bits_ == kTailCall;
+    }
+
+    bool IsObject() const {
+        return bits_ != 0 && (bits_ & kTagMask) == 0;
+    }
+
+    int64_t GetFixnum() const {
+        return static_cast<int64_t>(bits_) >> 1;
+    }
+
+    unsigned char GetChar() const {
+        return static_cast<unsigned char>(bits_ >> 8);
+    }
+
+    uintptr_t GetBits() const {  // for hashing by identity
+        return bits_;
+    }
+
+    Object* GetObject() const {  // nullptr if the value is not a heap object
+        return IsObject() ? reinterpret_cast<Object*>(bits_) : nullptr;
+    }
+
+    // Identity, not structural equality (see Equal).
+    bool operator==(const Value& other) const {
+        return bits_ == other.bits_;
+    }
+
+    bool operator!=(const Value& other) const {
+        return bits_ != other.bits_;
+    }
+};
+
+static_assert(sizeof(Value) == sizeof(uintptr_t), "Value must fit in a word");
+
+static_assert(std::is_trivially_copyable<Value>::value, "Values are copied as words");
+
+// The concrete class of an Object, so that type checks are a compare instead of a dynamic_cast.
+enum class ObjectType : uint8_t {
+    kNumber,
+    kReal,
+    kSymbol,
+    kString,
+    kCell,
+    kVector,
+    kHashTable,
+    kLambda,
+};
+
+class Object : public GcObject {
+    ObjectType type_;
 
-class Object : public std::enable_shared_from_this<Object> {
-    size_t refs_ = 0;
 public:
+    explicit Object(ObjectType type) : type_(type) {
+    }
+
     virtual ~Object() = default;
-    void IncreaseRefs();
-    void DecreaseRefs();
-    size_t GetRefs() const;
+
+    ObjectType GetType() const {
+        return type_;
+    }
+
     virtual std::string ToString() const = 0;
-    virtual bool IsEqualTo(const std::shared_ptr<const Object>& other) const = 0;
-    virtual bool IsLessThan(const std::shared_ptr<const Object>& other) const = 0;
+    virtual bool IsEqualTo(const Value& other) const = 0;
+    virtual bool IsLessThan(const Value& other) const = 0;
 };
 
+inline void Roots::Add(const Value& value) {
+    Add(value.GetObject());
+}
+
+// An integer outside the fixnum range. Arithmetic keeps integers normalized, so a Number is
+// never equal to a fixnum.
 class Number : public Object {
-    int64_t value_;
+    BigInt value_;
 
 public:
-    Number(int64_t);
+    static constexpr ObjectType kType = ObjectType::kNumber;
+
+    Number(BigInt);
     virtual ~Number() = default;
-    int64_t GetValue() const;
+    const BigInt& GetValue() const;
     virtual std::string ToString() const override;
-    virtual bool IsEqualTo(const std::shared_ptr<const Object>& other) const override;
-    virtual bool IsLessThan(const std::shared_ptr<const Object>& other) const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
 };
 
-class Boolean : public Object {
-    bool value_;
+// An inexact number. Arithmetic with a Real and an integer gives a Real.
+class Real : public Object {
+    double value_;
 
 public:
-    Boolean(bool);
-    virtual ~Boolean() = default;
-    bool GetValue() const;
+    static constexpr ObjectType kType = ObjectType::kReal;
+
+    Real(double);
+    virtual ~Real() = default;
+    double GetValue() const;
     virtual std::string ToString() const override;
-    virtual bool IsEqualTo(const std::shared_ptr<const Object>& other) const override;
-    virtual bool IsLessThan(const std::shared_ptr<const Object>& other) const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
 };
 
+// Symbols are interned: Intern returns the same Symbol for equal names, so symbols are compared
+// by pointer and keyed by their id. Interned symbols belong to no heap and are never freed.
 class Symbol : public Object {
     std::string name_;
+    size_t id_;
+    size_t hash_;
+
+    Symbol(const std::string&, size_t id);
+    friend Symbol* Intern(std::string_view);
 
 public:
-    Symbol(const std::string&);
+    static constexpr ObjectType kType = ObjectType::kSymbol;
+
     virtual ~Symbol() = default;
     const std::string& GetName() const;
+    size_t GetId() const {  // dense: ids are given out in order from 0
+        return id_;
+    }
+
+    size_t GetHash() const;
     virtual std::string ToString() const override;
-    virtual bool IsEqualTo(const std::shared_ptr<const Object>& other) const override;
-    virtual bool IsLessThan(const std::shared_ptr<const Object>& other) const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
+};
+
+Symbol* Intern(std::string_view);
+Symbol* GetSymbol(size_t id);  // of a symbol that has been interned
+
+// Immutable text: bytes, stored contiguously. Strings of up to kInlineSize bytes, which most of
+// what scripts handle are, are stored in the object itself, so they take a single allocation
+// from the heap; longer ones have a buffer of their own.
+class String : public Object {
+    static constexpr size_t kInlineSize = 16;
+
+    size_t size_;
+    union {
+        char inline_[kInlineSize];
+        char* buffer_;
+    };
+
+    char* Reserve(size_t size);  // the storage for the contents, size_ bytes
+
+public:
+    static constexpr ObjectType kType = ObjectType::kString;
+
+    explicit String(std::string_view);
+    explicit String(const std::vector<std::string_view>& parts);  // their concatenation
+    virtual ~String();
+    virtual size_t GetExternalSize() const override;  // the buffer, which never changes
+
+    String(const String&) = delete;
+    String& operator=(const String&) = delete;
+
+    size_t GetSize() const {
+        return size_;
+    }
+
+    std::string_view GetView() const {
+        return std::string_view(size_ <= kInlineSize ? inline_ : buffer_, size_);
+    }
+
+    virtual std::string ToString() const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
 };
 
 class Cell : public Object {
-    std::shared_ptr<Object> first_, second_;
+    Value first_, second_;
 
 public:
-    Cell(const std::shared_ptr<Object>&, const std::shared_ptr<Object>&);
+    static constexpr ObjectType kType = ObjectType::kCell;
+
+    Cell(const Value&, const Value&);
     virtual ~Cell() = default;
-    std::shared_ptr<Object> GetFirst() const;
-    std::shared_ptr<Object> GetSecond() const;
-    void SetFirst(const std::shared_ptr<Object>&);
-    void SetSecond(const std::shared_ptr<Object>&);
+    virtual void Trace(Heap*) const override;
+    Value GetFirst() const;
+    Value GetSecond() const;
+    void SetFirst(const Value&);
+    void SetSecond(const Value&);
+    virtual std::string ToString() const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
+};
+
+// A fixed-size array, stored contiguously.
+class Vector : public Object {
+    std::vector<Value> elements_;
+
+public:
+    static constexpr ObjectType kType = ObjectType::kVector;
+
+    Vector(size_t size, const Value& fill);
+    Vector(std::vector<Value> elements);
+    virtual ~Vector() = default;
+    virtual void Trace(Heap*) const override;
+    virtual size_t GetExternalSize() const override;
+
+    size_t GetSize() const {
+        return elements_.size();
+    }
+
+    const std::vector<Value>& GetElements() const {
+        return elements_;
+    }
+
+    Value& operator[](size_t index) {  // index must be less than GetSize()
+        return elements_[index];
+    }
+
     virtual std::string ToString() const override;
-    virtual bool IsEqualTo(const std::shared_ptr<const Object>& other) const override;
-    virtual bool IsLessThan(const std::shared_ptr<const Object>& other) const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
+};
+
+// Keys are compared with Equal and hashed with Hash. Open addressing with linear probing over
+// a power-of-two array of entries, so a lookup usually touches a single cache line.
+class HashTable : public Object {
+    struct Entry {
+        Value key = Value::Unbound();  // Unbound for an empty entry, TailCall for a removed one
+        Value value;
+        size_t hash = 0;
+    };
+
+    std::vector<Entry> entries_;
+    size_t count_ = 0;
+    size_t used_ = 0;  // entries that are not empty, including removed ones
+
+    Entry* FindEntry(const Value& key, size_t hash);
+    size_t GetRehashCapacity() const;  // for the next Set of a new key, 0 if it needs no rehash
+    void Rehash(size_t capacity);
+
+public:
+    static constexpr ObjectType kType = ObjectType::kHashTable;
+
+    HashTable();
+    virtual ~HashTable() = default;
+    virtual void Trace(Heap*) const override;
+    virtual size_t GetExternalSize() const override;
+
+    size_t GetCount() const {
+        return count_;
+    }
+
+    size_t GetRehashSize() const {  // the bytes the next Set of a new key allocates
+        return GetRehashCapacity() * sizeof(Entry);
+    }
+
+    template <class Function>
+    void ForEach(Function function) const {  // function(key, value) for every entry
+        for (const auto& entry : entries_) {
+            if (!entry.key.IsUnbound() && !entry.key.IsTailCall()) {
+                function(entry.key, entry.value);
+            }
+        }
+    }
+
+    Value* Find(const Value& key);  // nullptr if there is no such key
+    void Set(const Value& key, const Value& value);  // in a table of the current heap
+    bool Remove(const Value& key);  // false if there was no such key
+
+    virtual std::string ToString() const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
 };
 
 class Scope;
+class Interpreter;
+class MemoCache;
+struct Procedure;
 
 class Lambda : public Object {
-    std::vector<std::string> arg_names_;
-    std::weak_ptr<Scope> scope_;
-    std::vector<std::shared_ptr<Object>> expressions_;
-    std::vector<std::shared_ptr<Scope>> local_scopes_;
+    std::shared_ptr<const Procedure> procedure_;  // nullptr only while an image loads
+    Scope* scope_;  // the enclosing frame, nullptr at the top level
+    MemoCache* memo_ = nullptr;  // the results of its calls if it is memoized
+
+    friend class ImageReader;  // which creates lambdas before their procedures
+
+    Value Invoke(Interpreter*, const std::vector<Value>&);
 
 public:
-    Lambda(const std::vector<std::string>&,
-           const std::weak_ptr<Scope>&,
-           const std::vector<std::shared_ptr<Object>>&);
-    virtual ~Lambda();
-    std::shared_ptr<Object> Call(const std::vector<std::shared_ptr<Object>>&);
+    static constexpr ObjectType kType = ObjectType::kLambda;
+
+    Lambda(const std::shared_ptr<const Procedure>&, Scope*);
+    virtual ~Lambda() = default;
+    virtual void Trace(Heap*) const override;
+
+    const Procedure& GetProcedure() const {
+        return *procedure_;
+    }
+
+    const std::shared_ptr<const Procedure>& GetSharedProcedure() const {
+        return procedure_;
+    }
+
+    Scope* GetScope() const {
+        return scope_;
+    }
+
+    MemoCache* GetMemo() const {  // nullptr unless memoized
+        return memo_;
+    }
+
+    void SetMemo(MemoCache* memo) {
+        memo_ = memo;
+    }
+
+    // A memoized lambda returns what it returned before for Equal arguments, if its cache still
+    // has it, instead of evaluating its body.
+    Value Call(Interpreter*, const std::vector<Value>&);
     virtual std::string ToString() const override;
-    virtual bool IsEqualTo(const std::shared_ptr<const Object>& other) const override;
-    virtual bool IsLessThan(const std::shared_ptr<const Object>& other) const override;
+    virtual bool IsEqualTo(const Value& other) const override;
+    virtual bool IsLessThan(const Value& other) const override;
 };
 
-std::string ToString(const std::shared_ptr<const Object>&);
-std::string ListToString(std::shared_ptr<const Object>);
+std::string ToString(const Value&);
+std::string ListToString(Value);
+std::vector<Value> UnfoldList(Value);  // throws RuntimeError
+
+bool Equal(const Value&, const Value&);
+bool Less(const Value&, const Value&);
+bool LessOrEqual(const Value&, const Value&);
+bool Greater(const Value&, const Value&);
+bool GreaterOrEqual(const Value&, const Value&);
+
+// Equal values have equal hashes.
+size_t Hash(const Value&);
+
+// int64_t multiplication that reports overflow instead of wrapping: false if the product does
+// not fit, in which case *result is unspecified.
+inline bool CheckedMultiply(int64_t lhs, int64_t rhs, int64_t* result) {
+#if defined(__GNUC__)
+    return !__builtin_mul_overflow(lhs, rhs, result);
+#else
+    if (lhs != 0 && rhs != 0) {
+        if ((lhs == -1 && rhs == INT64_MIN) || (rhs == -1 && lhs == INT64_MIN)) {
+            return false;
+        }
+        if (lhs != -1 && rhs != -1) {
+            const int64_t limit = ((lhs < 0) == (rhs < 0) ? INT64_MAX : INT64_MIN);
+            if ((lhs < 0) == (rhs < 0) ? (lhs > 0 ? lhs > limit / rhs : lhs < limit / rhs)
+                                       : (lhs > 0 ? rhs < limit / lhs : lhs < limit / rhs)) {
+                return false;
+            }
+        }
+    }
+    *result = lhs * rhs;
+    return true;
+#endif
+}
 
-bool Equal(const std::shared_ptr<const Object>&, const std::shared_ptr<const Object>&);
-bool Less(const std::shared_ptr<const Object>&, const std::shared_ptr<const Object>&);
-bool LessOrEqual(const std::shared_ptr<const Object>&, const std::shared_ptr<const Object>&);
-bool Greater(const std::shared_ptr<const Object>&, const std::shared_ptr<const Object>&);
-bool GreaterOrEqual(const std::shared_ptr<const Object>&, const std::shared_ptr<const Object>&);
+// Integers stay exact and grow as needed; a Real operand makes the result a Real. Throw
+// RuntimeError when an operand is not a number, or on integer division by zero.
+Value Add(const Value&, const Value&);
+Value Subtract(const Value&, const Value&);
+Value Multiply(const Value&, const Value&);
+Value Divide(const Value&, const Value&);
 
-std::shared_ptr<Object> Add(const std::shared_ptr<const Object>&,
-                            const std::shared_ptr<const Object>&);
-std::shared_ptr<Object> Subtract(const std::shared_ptr<const Object>&,
-                                 const std::shared_ptr<const Object>&);
-std::shared_ptr<Object> Multiply(const std::shared_ptr<const Object>&,
-                                 const std::shared_ptr<const Object>&);
-std::shared_ptr<Object> Divide(const std::shared_ptr<const Object>&,
-                               const std::shared_ptr<const Object>&);
+bool AsBoolean(const Value&);
+Value Not(const Value&);
 
-bool AsBoolean(const std::shared_ptr<const Object>&);
-std::shared_ptr<Object> Not(const std::shared_ptr<const Object>&);
+bool IsNumber(const Value&);
+double GetNumberAsDouble(const Value&);  // the value must be a number
 
-std::shared_ptr<Object> GetNumberConstant(int64_t);
-std::shared_ptr<Object> GetBooleanConstant(bool);
+Value GetNumberConstant(int64_t);
+Value GetNumberConstant(BigInt);
+Value GetRealConstant(double);
+// A literal as scanned by the tokenizer (see ConstantToken).
+Value ParseNumber(std::string_view);
+Value GetBooleanConstant(bool);
 
 template <class T>
-std::shared_ptr<T> As(const std::shared_ptr<Object>& obj) {
-    T* ptr = dynamic_cast<T*>(obj.get());  // what if ptr == nullptr?
-    return std::shared_ptr<T>(obj, ptr);
+T* As(const Value& value) {  // nullptr if value is not a T
+    Object* object = value.GetObject();
+    return (object != nullptr && object->GetType() == T::kType ? static_cast<T*>(object) : nullptr);
 }
 
 template <class T>
-bool Is(const std::shared_ptr<Object>& obj) {
-    return dynamic_cast<T*>(obj.get()) != nullptr;
+bool Is(const Value& value) {
+    return As<T>(value) != nullptr;
 }
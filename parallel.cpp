@@ -0,0 +1,217 @@
+#include "parallel.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+struct WorkStealingPool::Batch {
+    const std::function<void(size_t, size_t)>* task;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending;  // tasks that have neither returned nor been skipped, guarded by mutex
+    std::exception_ptr error;  // guarded by mutex
+    std::atomic<bool> failed{false};
+};
+
+WorkStealingPool::WorkStealingPool(size_t num_threads) {
+    for (size_t i = 0; i != num_threads; ++i) {
+        queues_.emplace_back(new Queue);
+    }
+    for (size_t i = 0; i != num_threads; ++i) {
+        threads_.emplace_back(&WorkStealingPool::Work, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool WorkStealingPool::Take(Queue* queue, bool newest, const Batch* only, Task* task) {
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        std::deque<Task>& tasks = queue->tasks;
+        auto iter = tasks.begin();
+        if (only != nullptr) {
+            iter = std::find_if(tasks.begin(), tasks.end(),
+                                [only](const Task& queued) { return queued.batch == only; });
+        } else if (newest && !tasks.empty()) {
+            iter = tasks.end() - 1;
+        }
+        if (iter == tasks.end()) {
+            return false;
+        }
+        *task = *iter;
+        tasks.erase(iter);
+    }
+    Dequeued();
+    return true;
+}
+
+void WorkStealingPool::Dequeued() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --queued_;
+}
+
+void WorkStealingPool::Execute(const Task& task, size_t worker) {
+    Batch* batch = task.batch;
+    if (!batch->failed.load(std::memory_order_relaxed)) {
+        try {
+            (*batch->task)(worker, task.index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (batch->error == nullptr) {
+                batch->error = std::current_exception();
+            }
+            batch->failed.store(true, std::memory_order_relaxed);
+        }
+    }
+    // Under the lock, so that the batch outlives the notification.
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    if (--batch->pending == 0) {
+        batch->done.notify_all();
+    }
+}
+
+void WorkStealingPool::Work(size_t thread) {
+    const size_t num_queues = queues_.size();
+    for (;;) {
+        Task task;
+        bool found = Take(queues_[thread].get(), true, nullptr, &task);
+        for (size_t i = 1; !found && i != num_queues; ++i) {
+            found = Take(queues_[(thread + i) % num_queues].get(), false, nullptr, &task);
+        }
+        if (found) {
+            Execute(task, thread);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stopping_ || queued_ != 0; });
+        if (stopping_) {
+            return;
+        }
+    }
+}
+
+void WorkStealingPool::Run(size_t num_tasks,
+                           const std::function<void(size_t worker, size_t index)>& task) {
+    Batch batch;
+    batch.task = &task;
+    batch.pending = num_tasks;
+    const size_t num_queues = queues_.size();
+    if (num_queues == 0) {
+        for (size_t i = 0; i != num_tasks; ++i) {
+            Execute({&batch, i}, GetNumThreads());
+        }
+    } else {
+        for (size_t queue = 0; queue != num_queues; ++queue) {
+            std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+            for (size_t i = queue; i < num_tasks; i += num_queues) {
+                queues_[queue]->tasks.push_back({&batch, i});
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_ += num_tasks;
+        }
+        wake_.notify_all();
+        Task next;
+        for (size_t queue = 0; queue != num_queues;) {
+            if (Take(queues_[queue].get(), false, &batch, &next)) {
+                Execute(next, GetNumThreads());
+            } else {
+                ++queue;
+            }
+        }
+    }
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, [&batch] { return batch.pending == 0; });
+    if (batch.error != nullptr) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+WorkStealingPool& WorkStealingPool::GetDefault() {
+    static WorkStealingPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+// Enough chunks per thread that threads which finish early have some to steal.
+static constexpr size_t kChunksPerThread = 4;
+
+// Results stay in the heap of the worker that computed them, rooted there, until every call has
+// returned; then they are copied out together, which keeps what they share shared.
+std::vector<Value> ParallelMap(Interpreter* interpreter, Lambda* lambda,
+                               const std::vector<Value>& args, bool keep_results) {
+    WorkStealingPool& pool = *interpreter->pool_;
+    const size_t num_workers = pool.GetNumThreads() + 1;
+    while (interpreter->workers_.size() < num_workers) {
+        interpreter->workers_.emplace_back(new Interpreter(interpreter));
+    }
+    struct Results {
+        std::vector<Value> values;
+        std::vector<size_t> indices;  // into args
+    };
+    std::vector<Results> results(num_workers);
+    std::vector<std::unique_ptr<Roots>> roots;
+    for (size_t i = 0; i != num_workers; ++i) {
+        Interpreter* worker = interpreter->workers_[i].get();
+        worker->cancelled_.store(false, std::memory_order_relaxed);
+        worker->SetLimits(interpreter->limits_);
+        roots.emplace_back(new Roots(&worker->heap_));
+        roots.back()->Add(&results[i].values);
+    }
+
+    const size_t chunk = std::max<size_t>(1, args.size() / (num_workers * kChunksPerThread));
+    std::mutex error_mutex;
+    std::exception_ptr error;  // the first, not one of the cancellations it causes
+    const auto run_chunk = [&](size_t index, size_t begin) {
+        Interpreter* worker = interpreter->workers_[index].get();
+        CurrentHeapGuard guard(&worker->heap_);
+        std::vector<Value> call_args(1);
+        try {
+            for (size_t i = begin; i != std::min(args.size(), begin + chunk); ++i) {
+                call_args[0] = args[i];
+                const Value result = lambda->Call(worker, call_args);
+                if (keep_results) {
+                    results[index].values.push_back(result);
+                    results[index].indices.push_back(i);
+                }
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+            }
+            for (const auto& other : interpreter->workers_) {
+                other->Cancel();  // stops the other chunks in progress at their next step
+            }
+            throw;
+        }
+    };
+    try {
+        pool.Run((args.size() + chunk - 1) / chunk,
+                 [&](size_t worker, size_t index) { run_chunk(worker, index * chunk); });
+    } catch (...) {
+        // The workers may have stopped for it; either way the form that made the call is over.
+        interpreter->cancelled_.store(false, std::memory_order_relaxed);
+        std::rethrow_exception(error);
+    }
+
+    std::vector<Value> values(keep_results ? args.size() : 0);
+    for (const Results& worker_results : results) {
+        for (size_t i = 0; i != worker_results.values.size(); ++i) {
+            values[worker_results.indices[i]] = worker_results.values[i];
+        }
+    }
+    CopyOutOf(interpreter->workers_.front()->heap_, &values);
+    return values;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scheme.h"
+
+// Threads that run batches of tasks. Every thread has a queue of tasks of its own: it takes the
+// newest from it and, once it is empty, steals the oldest from the queues of the others. The
+// thread that runs a batch takes part in it, running only tasks of that batch until all of them
+// are done, so tasks may run batches of their own.
+class WorkStealingPool {
+    struct Batch;
+
+    struct Task {
+        Batch* batch;
+        size_t index;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;  // one per thread
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    size_t queued_ = 0;  // tasks in the queues, guarded by mutex_
+    bool stopping_ = false;
+
+    bool Take(Queue*, bool newest, const Batch* only, Task*);  // only nullptr for any batch
+    void Dequeued();
+    void Execute(const Task&, size_t worker);
+    void Work(size_t thread);
+
+public:
+    explicit WorkStealingPool(size_t num_threads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t GetNumThreads() const {
+        return threads_.size();
+    }
+
+    // Calls task(worker, index) for every index below num_tasks, where worker is the thread that
+    // makes the call: a thread of the pool, or GetNumThreads() for the calling thread. Returns
+    // once every call has returned, rethrowing the first exception any of them threw; tasks that
+    // have not started by then are skipped.
+    void Run(size_t num_tasks, const std::function<void(size_t worker, size_t index)>& task);
+
+    static WorkStealingPool& GetDefault();  // a thread per core, but for the calling one
+};
+
+// Calls lambda with each of args in turn, on the threads of the default pool, and returns what
+// the calls returned, in order, in the heap of interpreter; none if keep_results is false. Each
+// thread calls the lambda in a worker of interpreter (see Interpreter::CheckModifiable): the
+// lambda sees its globals and the values it captured, but must not modify any of them. The
+// limits of interpreter apply to each worker on its own; cancelling interpreter cancels them.
+std::vector<Value> ParallelMap(Interpreter*, Lambda*, const std::vector<Value>& args,
+                               bool keep_results);
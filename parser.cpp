@@ -1,185 +1,475 @@
 #include "parser.h"
 #include "error.h"
 #include "scheme.h"
-
-static void FailCompare(const std::shared_ptr<const Object>& lhs,
-                        const std::shared_ptr<const Object>& rhs) {
+#include "compiler.h"
+#include "memo.h"
+#include "profiler.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+static void FailCompare(const Value& lhs, const Value& rhs) {
     const std::string msg =
         std::string("Cannot compare: ") + ToString(lhs) + std::string(" and ") + ToString(rhs);
     throw NameError(msg);
 }
 
-Number::Number(int64_t value) : value_(value) {
+// Both must be numbers. Integers compare exactly; anything compared with a Real is converted
+// to a double.
+static int CompareNumbers(const Value& lhs, const Value& rhs);
+static bool NumbersEqual(const Value& lhs, const Value& rhs);
+
+Number::Number(BigInt value) : Object(kType), value_(std::move(value)) {
 }
 
-int64_t Number::GetValue() const {
+const BigInt& Number::GetValue() const {
     return value_;
 }
 
 std::string Number::ToString() const {
-    return std::to_string(value_);
+    return value_.ToString();
+}
+
+bool Number::IsEqualTo(const Value& other) const {
+    return IsNumber(other) && NumbersEqual(Value(const_cast<Number*>(this)), other);
+}
+
+bool Number::IsLessThan(const Value& other) const {
+    if (!IsNumber(other)) {
+        FailCompare(Value(const_cast<Number*>(this)), other);
+    }
+    return CompareNumbers(Value(const_cast<Number*>(this)), other) < 0;
+}
+
+Real::Real(double value) : Object(kType), value_(value) {
+}
+
+double Real::GetValue() const {
+    return value_;
+}
+
+// The shortest text that reads back as the same double, always with a "." or an exponent so
+// that it does not read back as an integer.
+std::string Real::ToString() const {
+    if (std::isnan(value_)) {
+        return "+nan.0";
+    }
+    if (std::isinf(value_)) {
+        return (value_ > 0 ? "+inf.0" : "-inf.0");
+    }
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value_);
+    std::string text(buffer, result.ptr);
+    if (text.find_first_of(".e") == std::string::npos) {
+        text += ".0";
+    }
+    return text;
 }
 
-bool Number::IsEqualTo(const std::shared_ptr<const Object>& other) const {
-    const Number* number = dynamic_cast<const Number*>(other.get());
-    return number != nullptr && number->value_ == value_;
+bool Real::IsEqualTo(const Value& other) const {
+    return IsNumber(other) && NumbersEqual(Value(const_cast<Real*>(this)), other);
 }
 
-bool Number::IsLessThan(const std::shared_ptr<const Object>& other) const {
-    const Number* number = dynamic_cast<const Number*>(other.get());
-    if (number == nullptr) {
-        FailCompare(shared_from_this(), other);
+bool Real::IsLessThan(const Value& other) const {
+    if (!IsNumber(other)) {
+        FailCompare(Value(const_cast<Real*>(this)), other);
     }
-    return value_ < number->value_;
+    return CompareNumbers(Value(const_cast<Real*>(this)), other) < 0;
 }
 
-Symbol::Symbol(const std::string& name) : name_(name) {
+Symbol::Symbol(const std::string& name, size_t id)
+    : Object(kType), name_(name), id_(id), hash_(std::hash<std::string>()(name)) {
 }
 
 const std::string& Symbol::GetName() const {
     return name_;
 }
 
+size_t Symbol::GetHash() const {
+    return hash_;
+}
+
 std::string Symbol::ToString() const {
     return name_;
 }
 
-bool Symbol::IsEqualTo(const std::shared_ptr<const Object>& other) const {
-    const Symbol* symbol = dynamic_cast<const Symbol*>(other.get());
-    return symbol != nullptr && symbol->name_ == name_;
+bool Symbol::IsEqualTo(const Value& other) const {
+    return this == other.GetObject();
 }
 
-bool Symbol::IsLessThan(const std::shared_ptr<const Object>& other) const {
-    FailCompare(shared_from_this(), other);
+bool Symbol::IsLessThan(const Value& other) const {
+    FailCompare(Value(const_cast<Symbol*>(this)), other);
     return false;  // never reached
 }
 
-Cell::Cell(const std::shared_ptr<Object>& first, const std::shared_ptr<Object>& second)
-    : first_(first), second_(second) {
+// Shared by every interpreter. Most names are already interned, so lookups only take a shared
+// lock and interpreters reading code on different threads do not serialize on it.
+struct SymbolTable {
+    std::shared_mutex mutex;
+    // Keys are views of the names of the symbols, so lookups need no std::string.
+    std::unordered_map<std::string_view, std::unique_ptr<Symbol>> symbols;
+    std::vector<Symbol*> by_id;
+};
+
+static SymbolTable& GetSymbolTable() {
+    static SymbolTable table;
+    return table;
 }
 
-std::shared_ptr<Object> Cell::GetFirst() const {
+Symbol* Intern(std::string_view name) {
+    SymbolTable& table = GetSymbolTable();
+    {
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        const auto iter = table.symbols.find(name);
+        if (iter != table.symbols.end()) {
+            return iter->second.get();
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(table.mutex);
+    const auto iter = table.symbols.find(name);  // another thread may have interned it meanwhile
+    if (iter != table.symbols.end()) {
+        return iter->second.get();
+    }
+    std::unique_ptr<Symbol> symbol(new Symbol(std::string(name), table.by_id.size()));
+    table.by_id.push_back(symbol.get());
+    const std::string_view key = symbol->GetName();
+    return table.symbols.emplace(key, std::move(symbol)).first->second.get();
+}
+
+Symbol* GetSymbol(size_t id) {
+    SymbolTable& table = GetSymbolTable();
+    std::shared_lock<std::shared_mutex> lock(table.mutex);
+    return table.by_id.at(id);
+}
+
+char* String::Reserve(size_t size) {
+    size_ = size;
+    if (size <= kInlineSize) {
+        return inline_;
+    }
+    buffer_ = new char[size];
+    return buffer_;
+}
+
+String::String(std::string_view text) : Object(kType) {
+    text.copy(Reserve(text.size()), text.size());
+}
+
+String::String(const std::vector<std::string_view>& parts) : Object(kType) {
+    size_t size = 0;
+    for (std::string_view part : parts) {
+        size += part.size();
+    }
+    char* contents = Reserve(size);
+    for (std::string_view part : parts) {
+        contents += part.copy(contents, part.size());
+    }
+}
+
+String::~String() {
+    if (size_ > kInlineSize) {
+        delete[] buffer_;
+    }
+}
+
+size_t String::GetExternalSize() const {
+    return (size_ > kInlineSize ? size_ : 0);
+}
+
+std::string String::ToString() const {
+    return ::ToString(Value(const_cast<String*>(this)));
+}
+
+bool String::IsEqualTo(const Value& other) const {
+    const String* string = As<String>(other);
+    return string != nullptr && string->GetView() == GetView();
+}
+
+bool String::IsLessThan(const Value& other) const {
+    FailCompare(Value(const_cast<String*>(this)), other);
+    return false;  // never reached
+}
+
+Cell::Cell(const Value& first, const Value& second)
+    : Object(kType), first_(first), second_(second) {
+}
+
+void Cell::Trace(Heap* heap) const {
+    heap->Mark(first_);
+    heap->Mark(second_);
+}
+
+Value Cell::GetFirst() const {
     return first_;
 }
 
-std::shared_ptr<Object> Cell::GetSecond() const {
+Value Cell::GetSecond() const {
     return second_;
 }
 
-void Cell::SetFirst(const std::shared_ptr<Object>& value) {
+void Cell::SetFirst(const Value& value) {
     first_ = value;
 }
 
-void Cell::SetSecond(const std::shared_ptr<Object>& value) {
+void Cell::SetSecond(const Value& value) {
     second_ = value;
 }
 
 std::string Cell::ToString() const {
-    const std::shared_ptr<const Object> shared_this = shared_from_this();
-    return ListToString(shared_this);
+    return ::ToString(Value(const_cast<Cell*>(this)));
 }
 
-bool Cell::IsEqualTo(const std::shared_ptr<const Object>& other) const {
-    const Cell* cell = dynamic_cast<const Cell*>(other.get());
+bool Cell::IsEqualTo(const Value& other) const {
+    const Cell* cell = As<Cell>(other);
     return cell != nullptr && Equal(first_, cell->first_) && Equal(second_, cell->second_);
 }
 
-bool Cell::IsLessThan(const std::shared_ptr<const Object>& other) const {
-    FailCompare(shared_from_this(), other);
+bool Cell::IsLessThan(const Value& other) const {
+    FailCompare(Value(const_cast<Cell*>(this)), other);
     return false;  // never reached
 }
 
-Boolean::Boolean(bool value) : value_(value) {
+Vector::Vector(size_t size, const Value& fill) : Object(kType), elements_(size, fill) {
 }
 
-bool Boolean::GetValue() const {
-    return value_;
+Vector::Vector(std::vector<Value> elements) : Object(kType), elements_(std::move(elements)) {
 }
 
-std::string Boolean::ToString() const {
-    return (value_ ? "#t" : "#f");
+size_t Vector::GetExternalSize() const {
+    return elements_.capacity() * sizeof(Value);
 }
 
-bool Boolean::IsEqualTo(const std::shared_ptr<const Object>& other) const {
-    const Boolean* boolean = dynamic_cast<const Boolean*>(other.get());
-    return boolean != nullptr && value_ == boolean->value_;
+void Vector::Trace(Heap* heap) const {
+    for (const auto& element : elements_) {
+        heap->Mark(element);
+    }
 }
 
-bool Boolean::IsLessThan(const std::shared_ptr<const Object>& other) const {
-    FailCompare(shared_from_this(), other);
+std::string Vector::ToString() const {
+    return ::ToString(Value(const_cast<Vector*>(this)));
+}
+
+bool Vector::IsEqualTo(const Value& other) const {
+    const Vector* vector = As<Vector>(other);
+    if (vector == nullptr || vector->elements_.size() != elements_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i != elements_.size(); ++i) {
+        if (!Equal(elements_[i], vector->elements_[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Vector::IsLessThan(const Value& other) const {
+    FailCompare(Value(const_cast<Vector*>(this)), other);
     return false;  // never reached
 }
 
-std::string ToString(const std::shared_ptr<const Object>& obj) {
-    if (obj == nullptr) {
-        return "()";
-    } else {
-        return obj->ToString();
+HashTable::HashTable() : Object(kType), entries_(8) {
+}
+
+void HashTable::Trace(Heap* heap) const {
+    for (const auto& entry : entries_) {
+        heap->Mark(entry.key);
+        heap->Mark(entry.value);
     }
 }
 
-Lambda::Lambda(const std::vector<std::string>& arg_names,
-           const std::weak_ptr<Scope>& scope,
-           const std::vector<std::shared_ptr<Object>>& expressions):
-                arg_names_(arg_names),
-                scope_(scope),
-                expressions_(expressions) {
-    if (!scope_.expired()) {
-        scope_.lock()->AddRef();
+// The entry holding key, or else the empty one where it would go.
+HashTable::Entry* HashTable::FindEntry(const Value& key, size_t hash) {
+    const size_t mask = entries_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Entry* entry = &entries_[i];
+        if (entry->key.IsUnbound()) {
+            return entry;
+        }
+        if (entry->hash == hash && !entry->key.IsTailCall() &&
+            (entry->key == key || Equal(entry->key, key))) {
+            return entry;
+        }
     }
 }
 
-Lambda::~Lambda() {
-    if (!scope_.expired()) {
-        scope_.lock()->DelRef();
+size_t HashTable::GetExternalSize() const {
+    return entries_.capacity() * sizeof(Entry);
+}
+
+// Keeps at least a quarter of the entries empty, so that probes stay short and end.
+size_t HashTable::GetRehashCapacity() const {
+    if (4 * (used_ + 1) <= 3 * entries_.size()) {
+        return 0;
+    }
+    return (4 * (count_ + 1) > entries_.size() ? 2 * entries_.size() : entries_.size());
+}
+
+void HashTable::Rehash(size_t capacity) {
+    std::vector<Entry> entries(capacity);
+    entries.swap(entries_);
+    Heap* heap = Heap::Current();
+    heap->AddExternalBytes(GetExternalSize());
+    heap->RemoveExternalBytes(entries.capacity() * sizeof(Entry));
+    used_ = count_;
+    for (const auto& entry : entries) {
+        if (!entry.key.IsUnbound() && !entry.key.IsTailCall()) {
+            *FindEntry(entry.key, entry.hash) = entry;
+        }
     }
 }
 
-std::shared_ptr<Object> Lambda::Call(const std::vector<std::shared_ptr<Object>>& args) {
-    const size_t num_args = arg_names_.size();
-    std::shared_ptr<Scope> local_scope(new Scope(scope_));
-    const auto last = std::remove_if(
-        local_scopes_.begin(),
-        local_scopes_.end(),
-        [](const std::shared_ptr<Scope>& ptr) { return ptr->GetRefs() <= 0; }
-    ); 
-    local_scopes_.erase(last, local_scopes_.end());
-    local_scopes_.push_back(local_scope);
-    if (args.size() != num_args) {
-        throw RuntimeError(std::string("Invalid number of arguments in for lambda: ") + ToString());
+Value* HashTable::Find(const Value& key) {
+    Entry* entry = FindEntry(key, Hash(key));
+    return (entry->key.IsUnbound() ? nullptr : &entry->value);
+}
+
+void HashTable::Set(const Value& key, const Value& value) {
+    const size_t hash = Hash(key);
+    Entry* entry = FindEntry(key, hash);
+    if (!entry->key.IsUnbound()) {
+        entry->value = value;
+        return;
     }
-    for (size_t i = 0; i != num_args; ++i) {
-        local_scope->SetLocalVariable(arg_names_[i], args[i]);
+    if (const size_t capacity = GetRehashCapacity()) {
+        Rehash(capacity);
+        entry = FindEntry(key, hash);
     }
-    std::shared_ptr<Object> result;
-    Interpreter interpreter(local_scope);
-    for (const auto& expression: expressions_) {
-        result = interpreter.Eval(expression);
+    *entry = Entry{key, value, hash};
+    ++count_;
+    ++used_;
+}
+
+bool HashTable::Remove(const Value& key) {
+    Entry* entry = FindEntry(key, Hash(key));
+    if (entry->key.IsUnbound()) {
+        return false;
     }
-    return result;
+    // A removed entry must not end the probe sequences that pass through it.
+    entry->key = Value::TailCall();
+    entry->value = Value();
+    --count_;
+    return true;
 }
 
-std::string Lambda::ToString() const {
-    std::string result = "(lambda (";
-    for (const auto& name: arg_names_) {
-        result += name;
-        result.push_back(' ');
+std::string HashTable::ToString() const {
+    return "#<hash-table " + std::to_string(count_) + ">";
+}
+
+bool HashTable::IsEqualTo(const Value& other) const {
+    return this == other.GetObject();
+}
+
+bool HashTable::IsLessThan(const Value& other) const {
+    FailCompare(Value(const_cast<HashTable*>(this)), other);
+    return false;  // never reached
+}
+
+Lambda::Lambda(const std::shared_ptr<const Procedure>& procedure, Scope* scope)
+    : Object(kType), procedure_(procedure), scope_(scope) {
+}
+
+void Lambda::Trace(Heap* heap) const {
+    heap->Mark(scope_);
+    heap->Mark(memo_);
+    if (procedure_ == nullptr) {
+        return;
     }
-    result.back() = ')';
-    for (const auto& expression: expressions_) {
-        result.push_back(' ');
-        result += ::ToString(expression);
+    for (const auto& expression : procedure_->expressions) {  // quoted constants live here
+        heap->Mark(expression);
+    }
+}
+
+// A cache that the interpreter does not own is shared with other threads: it is only read.
+Value Lambda::Call(Interpreter* interpreter, const std::vector<Value>& args) {
+    if (memo_ == nullptr) {
+        return Invoke(interpreter, args);
+    }
+    const bool owned = interpreter->GetHeap().Owns(memo_);
+    if (const Value* result = (owned ? memo_->Find(args) : memo_->Peek(args))) {
+        return *result;
+    }
+    const Value result = Invoke(interpreter, args);
+    if (owned) {
+        memo_->Add(args, result);
     }
-    result.push_back(')');
     return result;
 }
 
-bool Lambda::IsEqualTo(const std::shared_ptr<const Object>& other) const {
-    return this == other.get();
+// Tail calls made by the body loop here instead of recursing (see CallNode). The frame of the
+// previous call is reused when its procedure creates no closures that could still refer to it;
+// on the same condition, the frame of the last call goes back to the FramePool.
+Value Lambda::Invoke(Interpreter* interpreter, const std::vector<Value>& args) {
+    if (interpreter->GetEngine() == Engine::kBytecode) {
+        return interpreter->GetVirtualMachine().Call(interpreter, this, args);
+    }
+    Heap& heap = interpreter->GetHeap();
+    FramePool& frames = interpreter->GetFramePool();
+    Lambda* lambda = this;
+    const std::vector<Value>* call_args = &args;
+    std::vector<Value> tail_args;
+    Scope* frame = nullptr;
+    bool reuse_frame = false;
+    Interpreter::CallDepthGuard depth(interpreter);
+    Profiler* const profiler = interpreter->GetProfiler();
+    ProfileUnwinder unwinder(profiler);
+    if (profiler != nullptr) {
+        profiler->Enter(lambda);
+    }
+    for (;;) {
+        interpreter->Step();
+        const Procedure& procedure = *lambda->procedure_;
+        const size_t num_args = procedure.arg_names.size();
+        if (call_args->size() != num_args) {
+            throw RuntimeError(std::string("Invalid number of arguments in for lambda: ") +
+                               lambda->ToString());
+        }
+        if (reuse_frame) {
+            frame->Reset(lambda->scope_, procedure.num_slots);
+        } else {
+            frame = frames.Take(lambda->scope_, procedure.num_slots);
+        }
+        for (size_t i = 0; i != num_args; ++i) {
+            frame->GetSlot(i) = (*call_args)[i];
+        }
+        Roots roots(&heap);
+        roots.Add(lambda);
+        roots.Add(frame);
+        heap.MaybeCollect();  // the caller roots the arguments and everything else it holds
+        Value result;
+        for (const auto& node: procedure.body) {
+            result = node->Eval(interpreter, frame);
+        }
+        if (!result.IsTailCall()) {
+            if (!procedure.makes_closures) {
+                frames.Give(frame);
+            }
+            interpreter->GiveBackArgs(&tail_args);  // what the last tail call took
+            return result;
+        }
+        reuse_frame = !procedure.makes_closures;
+        lambda = interpreter->TakeTailCall(&tail_args);
+        call_args = &tail_args;
+        if (profiler != nullptr) {
+            profiler->Replace(lambda);
+        }
+    }
+}
+
+std::string Lambda::ToString() const {
+    return ::ToString(Value(const_cast<Lambda*>(this)));
 }
 
-bool Lambda::IsLessThan(const std::shared_ptr<const Object>& other) const {
-    FailCompare(shared_from_this(), other);
+bool Lambda::IsEqualTo(const Value& other) const {
+    return this == other.GetObject();
+}
+
+bool Lambda::IsLessThan(const Value& other) const {
+    FailCompare(Value(const_cast<Lambda*>(this)), other);
     return false;  // never reached
 }
 
@@ -188,183 +478,402 @@ static bool IsClosingBracket(const Token& token) {
     return bracket_token != nullptr && *bracket_token == BracketToken::CLOSE;
 }
 
-std::shared_ptr<Object> GetBooleanConstant(bool value) {
-    static std::shared_ptr<Object> true_value(new Boolean(true));
-    static std::shared_ptr<Object> false_value(new Boolean(false));
-    return (value ? true_value : false_value);
+Value GetBooleanConstant(bool value) {
+    return Value::FromBoolean(value);
 }
 
-bool Equal(const std::shared_ptr<const Object>& lhs, const std::shared_ptr<const Object>& rhs) {
-    if (lhs == nullptr || rhs == nullptr) {
-        return lhs == nullptr && rhs == nullptr;
+bool Equal(const Value& lhs, const Value& rhs) {
+    if (lhs == rhs) {
+        return true;
+    }
+    if (lhs.IsObject()) {
+        return lhs.GetObject()->IsEqualTo(rhs);
+    }
+    if (rhs.IsObject()) {
+        return rhs.GetObject()->IsEqualTo(lhs);
+    }
+    return false;
+}
+
+bool Less(const Value& lhs, const Value& rhs) {
+    if (lhs.IsFixnum() && rhs.IsFixnum()) {
+        return lhs.GetFixnum() < rhs.GetFixnum();
+    }
+    if (!lhs.IsObject()) {
+        if (!IsNumber(lhs) || !IsNumber(rhs)) {
+            FailCompare(lhs, rhs);
+        }
+        return CompareNumbers(lhs, rhs) < 0;
+    }
+    return lhs.GetObject()->IsLessThan(rhs);
+}
+
+static size_t Mix(uint64_t bits) {  // the finalizer of splitmix64
+    bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9;
+    bits = (bits ^ (bits >> 27)) * 0x94d049bb133111eb;
+    return bits ^ (bits >> 31);
+}
+
+// Numbers that are Equal convert to the same double. Below 2^53 every integer is exactly a
+// double, so those hash as integers whatever their type; the rest hash by their double.
+static size_t HashNumber(const Value& value) {
+    static constexpr double kExactLimit = 9007199254740992.0;  // 2^53
+    if (value.IsFixnum()) {
+        const int64_t integer = value.GetFixnum();
+        if (-kExactLimit < integer && integer < kExactLimit) {
+            return Mix(integer);
+        }
+    }
+    const double number = GetNumberAsDouble(value);
+    if (-kExactLimit < number && number < kExactLimit && number == std::trunc(number)) {
+        return Mix(static_cast<int64_t>(number));
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &number, sizeof(bits));
+    return Mix(bits);
+}
+
+// Lists and vectors hash by their structure, looking at a bounded number of elements so that
+// hashing a long list stays cheap; equal structures still agree on those elements.
+static size_t HashStructure(const Value& value, int budget) {
+    if (const Cell* cell = As<Cell>(value)) {
+        size_t hash = 0x9e3779b97f4a7c15;
+        Value object = value;
+        for (int i = 0; i != budget && (cell = As<Cell>(object)) != nullptr; ++i) {
+            hash = Mix(hash ^ HashStructure(cell->GetFirst(), budget / 2));
+            object = cell->GetSecond();
+        }
+        if (!Is<Cell>(object)) {
+            hash = Mix(hash ^ HashStructure(object, budget / 2));
+        }
+        return hash;
+    }
+    if (Vector* vector = As<Vector>(value)) {
+        size_t hash = Mix(vector->GetSize());
+        for (size_t i = 0; i != vector->GetSize() && i != static_cast<size_t>(budget); ++i) {
+            hash = Mix(hash ^ HashStructure((*vector)[i], budget / 2));
+        }
+        return hash;
     }
-    return lhs->IsEqualTo(rhs);
+    if (IsNumber(value)) {
+        return HashNumber(value);
+    }
+    if (const Symbol* symbol = As<Symbol>(value)) {
+        return symbol->GetHash();
+    }
+    if (const String* string = As<String>(value)) {
+        return std::hash<std::string_view>()(string->GetView());
+    }
+    // Everything else, immediates included, is only equal to itself.
+    return Mix(value.GetBits());
 }
 
-bool Less(const std::shared_ptr<const Object>& lhs, const std::shared_ptr<const Object>& rhs) {
-    if (lhs == nullptr || rhs == nullptr) {
-        FailCompare(lhs, rhs);
+size_t Hash(const Value& value) {
+    if (value.IsFixnum()) {
+        return HashNumber(value);
+    }
+    if (const Symbol* symbol = As<Symbol>(value)) {
+        return symbol->GetHash();
     }
-    return lhs->IsLessThan(rhs);
+    return HashStructure(value, 16);
 }
 
-bool LessOrEqual(const std::shared_ptr<const Object>& lhs,
-                 const std::shared_ptr<const Object>& rhs) {
+bool LessOrEqual(const Value& lhs, const Value& rhs) {
     return Less(lhs, rhs) || Equal(lhs, rhs);
 }
 
-bool Greater(const std::shared_ptr<const Object>& lhs, const std::shared_ptr<const Object>& rhs) {
+bool Greater(const Value& lhs, const Value& rhs) {
     return Less(rhs, lhs);
 }
 
-bool GreaterOrEqual(const std::shared_ptr<const Object>& lhs,
-                    const std::shared_ptr<const Object>& rhs) {
+bool GreaterOrEqual(const Value& lhs, const Value& rhs) {
     return LessOrEqual(rhs, lhs);
 }
 
-std::shared_ptr<Object> Add(const std::shared_ptr<const Object>& lhs,
-                            const std::shared_ptr<const Object>& rhs) {
-    const Number* left_number = dynamic_cast<const Number*>(lhs.get());
-    const Number* right_number = dynamic_cast<const Number*>(rhs.get());
-    if (left_number == nullptr || right_number == nullptr) {
+static void CheckOperands(const char* operation, const Value& lhs, const Value& rhs) {
+    if (!IsNumber(lhs) || !IsNumber(rhs)) {
         const std::string msg =
-            std::string("Cannot add: ") + ToString(lhs) + " and " + ToString(rhs);
+            std::string("Cannot ") + operation + ": " + ToString(lhs) + " and " + ToString(rhs);
         throw RuntimeError(msg);
     }
-    return GetNumberConstant(left_number->GetValue() + right_number->GetValue());
 }
 
-std::shared_ptr<Object> Subtract(const std::shared_ptr<const Object>& lhs,
-                                 const std::shared_ptr<const Object>& rhs) {
-    const Number* left_number = dynamic_cast<const Number*>(lhs.get());
-    const Number* right_number = dynamic_cast<const Number*>(rhs.get());
-    if (left_number == nullptr || right_number == nullptr) {
-        const std::string msg =
-            std::string("Cannot subtract: ") + ToString(lhs) + " and " + ToString(rhs);
-        throw RuntimeError(msg);
+static BigInt GetInteger(const Value& value) {  // value is a fixnum or a Number
+    if (value.IsFixnum()) {
+        return BigInt(value.GetFixnum());
     }
-    return GetNumberConstant(left_number->GetValue() - right_number->GetValue());
+    return static_cast<const Number*>(value.GetObject())->GetValue();
 }
 
-std::shared_ptr<Object> Multiply(const std::shared_ptr<const Object>& lhs,
-                                 const std::shared_ptr<const Object>& rhs) {
-    const Number* left_number = dynamic_cast<const Number*>(lhs.get());
-    const Number* right_number = dynamic_cast<const Number*>(rhs.get());
-    if (left_number == nullptr || right_number == nullptr) {
-        const std::string msg =
-            std::string("Cannot multiply: ") + ToString(lhs) + " and " + ToString(rhs);
-        throw RuntimeError(msg);
+static bool IsExact(const Value& lhs, const Value& rhs) {
+    return !Is<Real>(lhs) && !Is<Real>(rhs);
+}
+
+static int CompareNumbers(const Value& lhs, const Value& rhs) {
+    if (IsExact(lhs, rhs)) {
+        return Compare(GetInteger(lhs), GetInteger(rhs));
     }
-    return GetNumberConstant(left_number->GetValue() * right_number->GetValue());
+    const double x = GetNumberAsDouble(lhs), y = GetNumberAsDouble(rhs);
+    return (x < y ? -1 : (y < x ? 1 : 0));
 }
 
-std::shared_ptr<Object> Divide(const std::shared_ptr<const Object>& lhs,
-                               const std::shared_ptr<const Object>& rhs) {
-    const Number* left_number = dynamic_cast<const Number*>(lhs.get());
-    const Number* right_number = dynamic_cast<const Number*>(rhs.get());
-    if (left_number == nullptr || right_number == nullptr || right_number->GetValue() == 0) {
-        const std::string msg =
-            std::string("Cannot divide: ") + ToString(lhs) + " and " + ToString(rhs);
-        throw RuntimeError(msg);
+static bool NumbersEqual(const Value& lhs, const Value& rhs) {
+    if (IsExact(lhs, rhs)) {
+        return Compare(GetInteger(lhs), GetInteger(rhs)) == 0;
     }
-    return GetNumberConstant(left_number->GetValue() / right_number->GetValue());
+    return GetNumberAsDouble(lhs) == GetNumberAsDouble(rhs);
 }
 
-bool AsBoolean(const std::shared_ptr<const Object>& object) {
-    if (const Boolean* boolean = dynamic_cast<const Boolean*>(object.get())) {
-        return boolean->GetValue();
+// Fixnums have 63 bits, so sums and differences of two of them always fit in an int64_t.
+// Everything else is rare enough that going through BigInt is fine.
+Value Add(const Value& lhs, const Value& rhs) {
+    if (lhs.IsFixnum() && rhs.IsFixnum()) {
+        return GetNumberConstant(lhs.GetFixnum() + rhs.GetFixnum());
     }
-    return true;
+    CheckOperands("add", lhs, rhs);
+    if (!IsExact(lhs, rhs)) {
+        return GetRealConstant(GetNumberAsDouble(lhs) + GetNumberAsDouble(rhs));
+    }
+    return GetNumberConstant(GetInteger(lhs) + GetInteger(rhs));
+}
+
+Value Subtract(const Value& lhs, const Value& rhs) {
+    if (lhs.IsFixnum() && rhs.IsFixnum()) {
+        return GetNumberConstant(lhs.GetFixnum() - rhs.GetFixnum());
+    }
+    CheckOperands("subtract", lhs, rhs);
+    if (!IsExact(lhs, rhs)) {
+        return GetRealConstant(GetNumberAsDouble(lhs) - GetNumberAsDouble(rhs));
+    }
+    return GetNumberConstant(GetInteger(lhs) - GetInteger(rhs));
+}
+
+Value Multiply(const Value& lhs, const Value& rhs) {
+    int64_t product;
+    if (lhs.IsFixnum() && rhs.IsFixnum() &&
+        CheckedMultiply(lhs.GetFixnum(), rhs.GetFixnum(), &product)) {
+        return GetNumberConstant(product);
+    }
+    CheckOperands("multiply", lhs, rhs);
+    if (!IsExact(lhs, rhs)) {
+        return GetRealConstant(GetNumberAsDouble(lhs) * GetNumberAsDouble(rhs));
+    }
+    return GetNumberConstant(GetInteger(lhs) * GetInteger(rhs));
+}
+
+// Integer division truncates; only exact zero is an invalid divisor.
+Value Divide(const Value& lhs, const Value& rhs) {
+    CheckOperands("divide", lhs, rhs);
+    if (!IsExact(lhs, rhs)) {
+        return GetRealConstant(GetNumberAsDouble(lhs) / GetNumberAsDouble(rhs));
+    }
+    if (rhs == GetNumberConstant(0)) {
+        throw RuntimeError(std::string("Cannot divide: ") + ToString(lhs) + " and " +
+                           ToString(rhs));
+    }
+    if (lhs.IsFixnum() && rhs.IsFixnum()) {
+        return GetNumberConstant(lhs.GetFixnum() / rhs.GetFixnum());
+    }
+    return GetNumberConstant(GetInteger(lhs) / GetInteger(rhs));
+}
+
+bool AsBoolean(const Value& value) {
+    return !value.IsFalse();
 }
-std::shared_ptr<Object> Not(const std::shared_ptr<const Object>& object) {
-    return GetBooleanConstant(!AsBoolean(object));
+
+Value Not(const Value& value) {
+    return GetBooleanConstant(!AsBoolean(value));
+}
+
+bool IsNumber(const Value& value) {
+    return value.IsFixnum() || Is<Number>(value) || Is<Real>(value);
 }
 
-std::shared_ptr<Object> GetNumberConstant(int64_t value) {
-    const int64_t min = -1000;
-    const int64_t max = 1000;
-    static std::shared_ptr<Object> table[max - min + 1];
-    if (min <= value && value <= max) {
-        size_t index = value - min;
-        if (table[index] == nullptr) {
-            table[index].reset(new Number(value));
+double GetNumberAsDouble(const Value& value) {
+    if (value.IsFixnum()) {
+        return value.GetFixnum();
+    }
+    if (const Real* real = As<Real>(value)) {
+        return real->GetValue();
+    }
+    return static_cast<const Number*>(value.GetObject())->GetValue().ToDouble();
+}
+
+Value GetNumberConstant(int64_t value) {
+    if (Value::kMinFixnum <= value && value <= Value::kMaxFixnum) {
+        return Value::FromFixnum(value);
+    }
+    return Value(Make<Number>(BigInt(value)));
+}
+
+Value GetNumberConstant(BigInt value) {
+    if (value.FitsInt64()) {
+        return GetNumberConstant(value.ToInt64());
+    }
+    return Value(Make<Number>(std::move(value)));
+}
+
+Value GetRealConstant(double value) {
+    return Value(Make<Real>(value));
+}
+
+// Whether a real literal out of the range of double is too large for it rather than too small:
+// whether its first significant digit, which it has since zero is in range, is left of the units.
+static bool IsTooLarge(std::string_view text) {
+    const size_t e = text.find_first_of("eE");
+    const std::string_view mantissa = text.substr(0, e);
+    int64_t exponent = 0;
+    if (e != std::string_view::npos) {
+        const bool negative = (text[e + 1] == '-');
+        // Far past the range of double, the exponent only matters by its sign.
+        for (char chr : text.substr(e + 1 + (negative || text[e + 1] == '+'))) {
+            exponent = std::min<int64_t>(10 * exponent + (chr - '0'), 1 << 30);
         }
-        return table[index];
+        exponent = (negative ? -exponent : exponent);
     }
-    return std::shared_ptr<Object>(new Number(value));
+    const int64_t point = std::min(mantissa.find('.'), mantissa.size());
+    const int64_t first = mantissa.find_first_of("123456789");
+    return (first < point ? point - first - 1 : point - first) + exponent > 0;
 }
 
-std::string ListToString(std::shared_ptr<const Object> object) {
-    std::string result = "(";
-    bool first = true;
-    while (object != nullptr) {
-        const Cell* cell = dynamic_cast<const Cell*>(object.get());
-        if (cell == nullptr) {
-            result += std::string(" . ");
-            result += ToString(object);
-            break;
+Value ParseNumber(std::string_view text) {
+    if (text.find_first_of(".eE") != std::string_view::npos) {
+        // from_chars accepts a leading "-" but not a "+".
+        if (text[0] == '+') {
+            text.remove_prefix(1);
         }
-        if (first) {
-            first = false;
-        } else {
-            result.push_back(' ');
+        double value = 0;
+        const char* end = text.data() + text.size();
+        const auto [ptr, error] = std::from_chars(text.data(), end, value);
+        if (error == std::errc::result_out_of_range) {
+            // Overflow gives an infinity and underflow a zero, as IEEE arithmetic would.
+            value = (IsTooLarge(text) ? std::numeric_limits<double>::infinity() : 0.0);
+            value = (text[0] == '-' ? -value : value);
+        } else if (error != std::errc() || ptr != end) {
+            throw SyntaxError("Invalid number: " + std::string(text));
         }
-        result += ToString(cell->GetFirst());
-        object = cell->GetSecond();
+        return GetRealConstant(value);
     }
-    result.push_back(')');
-    return result;
+    // 18 digits always fit in an int64_t.
+    const size_t num_digits = text.size() - (text[0] == '+' || text[0] == '-');
+    if (num_digits <= 18) {
+        int64_t value = 0;
+        for (char chr : text.substr(text.size() - num_digits)) {
+            value = 10 * value + (chr - '0');
+        }
+        return GetNumberConstant(text[0] == '-' ? -value : value);
+    }
+    return GetNumberConstant(BigInt::Parse(text));
 }
 
-static std::shared_ptr<Object> ReadList(Tokenizer* tokenizer) {
-    std::vector<std::shared_ptr<Object>> objects;
-    std::shared_ptr<Object> result = nullptr;
-    while (!tokenizer->IsEnd() && !IsClosingBracket(tokenizer->GetToken())) {
-        const Token token = tokenizer->GetToken();
-        if (std::get_if<DotToken>(&token) != nullptr) {
-            if (objects.empty()) {
-                throw SyntaxError("Read: expected expression before .");
+std::vector<Value> UnfoldList(Value object) {
+    std::vector<Value> result;
+    Value slow = object;  // a cell behind, at half the pace: a circular list catches up with it
+    while (!object.IsNull()) {
+        Cell* cell = As<Cell>(object);
+        if (cell == nullptr) {
+            throw RuntimeError(std::string("Expected list, but got: ") + ToString(object));
+        }
+        result.push_back(cell->GetFirst());
+        object = cell->GetSecond();
+        if (result.size() % 2 == 0) {
+            slow = As<Cell>(slow)->GetSecond();
+            if (slow == object) {
+                throw RuntimeError("Expected list, but got a circular list");
             }
-            tokenizer->Next();
-            result = Read(tokenizer);
-            break;
         }
-        objects.push_back(Read(tokenizer));
-    }
-    if (tokenizer->IsEnd() || !IsClosingBracket(tokenizer->GetToken())) {
-        throw SyntaxError("Read: expected ) ending list");
-    }
-    tokenizer->Next();  // skip ')'
-    for (auto iter = objects.rbegin(); iter != objects.rend(); ++iter) {
-        result = std::shared_ptr<Object>(new Cell(*iter, result));
     }
     return result;
 }
 
-std::shared_ptr<Object> Read(Tokenizer* tokenizer) {
-    if (tokenizer->IsEnd()) {
-        throw SyntaxError("Read: Unexpected end of input");
-    }
-    const Token token = tokenizer->GetToken();
-    tokenizer->Next();
-    if (std::get_if<QuoteToken>(&token) != nullptr) {
-        static std::shared_ptr<Object> quote(new Symbol("quote"));
-        std::shared_ptr<Object> expression = Read(tokenizer);
-        std::shared_ptr<Object> cell1(new Cell(expression, nullptr));
-        std::shared_ptr<Object> cell2(new Cell(quote, cell1));
-        return cell2;
-    } else if (const ConstantToken* constant_token = std::get_if<ConstantToken>(&token)) {
-        return GetNumberConstant(constant_token->value);
-    } else if (const SymbolToken* symbol_token = std::get_if<SymbolToken>(&token)) {
-        return std::shared_ptr<Object>(new Symbol(symbol_token->name));
-    } else if (const BooleanToken* boolean_token = std::get_if<BooleanToken>(&token)) {
-        return GetBooleanConstant(*boolean_token == BooleanToken::TRUE);
-    } else if (const BracketToken* bracket_token = std::get_if<BracketToken>(&token)) {
-        if (*bracket_token == BracketToken::CLOSE) {
-            throw SyntaxError("Read: Unexpcted )");
+// A list or a quote that Read has started but not finished.
+struct ReadFrame {
+    bool is_quote;
+    Value head;               // the elements read so far
+    Cell* tail = nullptr;     // the last cell of head, nullptr while the list is empty
+    bool dotted = false;      // after a ".": the next datum is the cdr of tail
+    bool complete = false;    // the datum after the "." has been read, ")" must follow
+
+    explicit ReadFrame(bool is_quote) : is_quote(is_quote) {
+    }
+};
+
+// Iterative, so that nesting depth is bounded by memory rather than by the C++ stack; lists are
+// built front to back by appending to their last cell.
+Value Read(Tokenizer* tokenizer) {
+    static Symbol* const quote = Intern("quote");
+    std::vector<ReadFrame> stack;
+    for (;;) {
+        ReadFrame* top = (stack.empty() ? nullptr : &stack.back());
+        if (tokenizer->IsEnd()) {
+            if (top != nullptr && !top->is_quote && !(top->dotted && !top->complete)) {
+                throw SyntaxError("Read: expected ) ending list");
+            }
+            throw SyntaxError("Read: Unexpected end of input");
+        }
+        const Token token = tokenizer->GetToken();
+        tokenizer->Next();
+        if (top != nullptr && top->complete && !IsClosingBracket(token)) {
+            throw SyntaxError("Read: expected ) ending list");
+        }
+        Value datum;
+        if (std::get_if<QuoteToken>(&token) != nullptr) {
+            stack.emplace_back(true);
+            continue;
+        } else if (const ConstantToken* constant_token = std::get_if<ConstantToken>(&token)) {
+            datum = ParseNumber(constant_token->text);
+        } else if (const SymbolToken* symbol_token = std::get_if<SymbolToken>(&token)) {
+            datum = Value(Intern(symbol_token->name));
+        } else if (const BooleanToken* boolean_token = std::get_if<BooleanToken>(&token)) {
+            datum = GetBooleanConstant(*boolean_token == BooleanToken::TRUE);
+        } else if (const StringToken* string_token = std::get_if<StringToken>(&token)) {
+            datum = Value(Make<String>(string_token->text));
+        } else if (const CharToken* char_token = std::get_if<CharToken>(&token)) {
+            datum = Value::FromChar(char_token->value);
+        } else if (const BracketToken* bracket_token = std::get_if<BracketToken>(&token)) {
+            if (*bracket_token == BracketToken::OPEN) {
+                stack.emplace_back(false);
+                continue;
+            }
+            if (top == nullptr || top->is_quote || (top->dotted && !top->complete)) {
+                throw SyntaxError("Read: Unexpcted )");
+            }
+            datum = top->head;
+            stack.pop_back();
+        } else if (std::get_if<DotToken>(&token) != nullptr && top != nullptr &&
+                   !top->is_quote && !top->dotted) {
+            if (top->tail == nullptr) {
+                throw SyntaxError("Read: expected expression before .");
+            }
+            top->dotted = true;
+            continue;
+        } else {
+            throw SyntaxError("Read: Unexpected token");
+        }
+        // datum is complete: it goes into the innermost unfinished list or quote.
+        for (;;) {
+            if (stack.empty()) {
+                return datum;
+            }
+            ReadFrame& frame = stack.back();
+            if (frame.is_quote) {
+                datum = Value(Make<Cell>(quote, Value(Make<Cell>(datum, nullptr))));
+                stack.pop_back();
+                continue;
+            }
+            if (frame.dotted) {
+                frame.tail->SetSecond(datum);
+                frame.complete = true;
+            } else {
+                Cell* cell = Make<Cell>(datum, nullptr);
+                if (frame.tail == nullptr) {
+                    frame.head = Value(cell);
+                } else {
+                    frame.tail->SetSecond(Value(cell));
+                }
+                frame.tail = cell;
+            }
+            break;
         }
-        return ReadList(tokenizer);
-    } else {
-        throw SyntaxError("Read: Unexpected token");
     }
 }
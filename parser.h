@@ -5,4 +5,4 @@
 #include "object.h"
 #include "tokenizer.h"
 
-std::shared_ptr<Object> Read(Tokenizer* tokenizer);
+Value Read(Tokenizer* tokenizer);
@@ -0,0 +1,104 @@
+#include "profiler.h"
+#include "compiler.h"
+#include <algorithm>
+
+Profiler::Profiler(const Heap* heap) : heap_(heap) {
+}
+
+void Profiler::Enter(const Lambda* lambda) {
+    const std::shared_ptr<const Procedure>& procedure = lambda->GetSharedProcedure();
+    Entry& entry = entries_[procedure.get()];
+    if (entry.procedure == nullptr) {
+        entry.procedure = procedure;
+        entry.profile.name = procedure->name;
+    }
+    ++entry.profile.calls;
+    ++entry.active;
+    const GcStats& stats = heap_->GetStats();
+    stack_.push_back({&entry, Clock::now(), Clock::duration::zero(), stats.allocated_objects,
+                      stats.allocated_bytes, 0, 0});
+}
+
+void Profiler::Replace(const Lambda* lambda) {
+    Leave();
+    Enter(lambda);
+}
+
+void Profiler::Leave() {
+    if (stack_.empty()) {
+        return;
+    }
+    const Activation activation = stack_.back();
+    stack_.pop_back();
+    const Clock::duration elapsed = Clock::now() - activation.start;
+    const GcStats& stats = heap_->GetStats();
+    const size_t objects = stats.allocated_objects - activation.objects;
+    const size_t bytes = stats.allocated_bytes - activation.bytes;
+
+    LambdaProfile& profile = activation.entry->profile;
+    profile.self_seconds += std::chrono::duration<double>(elapsed - activation.callees).count();
+    if (--activation.entry->active == 0) {
+        profile.total_seconds += std::chrono::duration<double>(elapsed).count();
+    }
+    profile.allocated_objects += objects - activation.callee_objects;
+    profile.allocated_bytes += bytes - activation.callee_bytes;
+    if (!stack_.empty()) {
+        Activation& caller = stack_.back();
+        caller.callees += elapsed;
+        caller.callee_objects += objects;
+        caller.callee_bytes += bytes;
+    }
+}
+
+void Profiler::Unwind(size_t depth) {
+    while (stack_.size() > depth) {
+        Leave();
+    }
+}
+
+std::vector<LambdaProfile> Profiler::GetLambdaProfiles() const {
+    std::map<std::string, LambdaProfile> by_name;
+    for (const auto& [procedure, entry] : entries_) {
+        LambdaProfile& profile = by_name[entry.profile.name];
+        profile.name = entry.profile.name;
+        profile.calls += entry.profile.calls;
+        profile.total_seconds += entry.profile.total_seconds;
+        profile.self_seconds += entry.profile.self_seconds;
+        profile.allocated_objects += entry.profile.allocated_objects;
+        profile.allocated_bytes += entry.profile.allocated_bytes;
+    }
+    std::vector<LambdaProfile> profiles;
+    for (auto& entry : by_name) {
+        profiles.push_back(std::move(entry.second));
+    }
+    std::stable_sort(profiles.begin(), profiles.end(),
+                     [](const LambdaProfile& lhs, const LambdaProfile& rhs) {
+                         return lhs.self_seconds > rhs.self_seconds;
+                     });
+    return profiles;
+}
+
+std::vector<BuiltinProfile> Profiler::GetBuiltinProfiles() const {
+    std::vector<BuiltinProfile> profiles;
+    for (const auto& [command, calls] : builtins_) {
+        profiles.push_back({GetCommandName(command), calls});
+    }
+    std::sort(profiles.begin(), profiles.end(),
+              [](const BuiltinProfile& lhs, const BuiltinProfile& rhs) {
+                  return lhs.calls != rhs.calls ? lhs.calls > rhs.calls : lhs.name < rhs.name;
+              });
+    return profiles;
+}
+
+// Entries of calls in progress stay, with their statistics cleared, as the stack points to them.
+void Profiler::Clear() {
+    for (auto iter = entries_.begin(); iter != entries_.end();) {
+        if (iter->second.active == 0) {
+            iter = entries_.erase(iter);
+        } else {
+            iter->second.profile = LambdaProfile{iter->second.profile.name};
+            ++iter;
+        }
+    }
+    builtins_.clear();
+}
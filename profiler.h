@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "scheme.h"
+
+struct Procedure;
+
+struct LambdaProfile {
+    std::string name;  // of the define that bound the lambda, "lambda" if none did
+    size_t calls = 0;
+    double total_seconds = 0;  // including callees, counting recursive calls once; a tail
+                               // call ends the call that makes it
+    double self_seconds = 0;
+    size_t allocated_objects = 0;  // by the lambda itself, not by its callees
+    size_t allocated_bytes = 0;
+};
+
+struct BuiltinProfile {
+    std::string name;
+    size_t calls = 0;
+};
+
+// Per-lambda call counts, times and allocations, and per-builtin call counts, of an Interpreter
+// created with InterpreterOptions::profile. Both engines report every call to it: Enter when a
+// lambda is called, Replace on a tail call and Leave when it returns. An interpreter that is not
+// profiling has no Profiler, and every hook is a test of a null pointer.
+class Profiler {
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::shared_ptr<const Procedure> procedure;  // keeps the key alive
+        LambdaProfile profile;
+        size_t active = 0;  // calls on the stack
+    };
+
+    struct Activation {
+        Entry* entry;
+        Clock::time_point start;
+        Clock::duration callees;
+        size_t objects, bytes;  // allocated when the call started
+        size_t callee_objects, callee_bytes;
+    };
+
+    const Heap* heap_;
+    std::unordered_map<const Procedure*, Entry> entries_;
+    std::vector<Activation> stack_;
+    std::map<Command, size_t> builtins_;
+
+public:
+    explicit Profiler(const Heap*);
+
+    void Enter(const Lambda*);
+    void Replace(const Lambda*);  // leaves the current call and enters a tail call
+    void Leave();
+
+    size_t GetDepth() const {
+        return stack_.size();
+    }
+
+    void Unwind(size_t depth);  // leaves calls until depth remain, when an exception escapes
+
+    void CountBuiltin(Command command) {
+        ++builtins_[command];
+    }
+
+    std::vector<LambdaProfile> GetLambdaProfiles() const;  // by name, most self time first
+    std::vector<BuiltinProfile> GetBuiltinProfiles() const;  // most calls first
+
+    void Clear();  // forgets what was recorded, keeps track of the calls in progress
+};
+
+// Leaves, when the enclosing block ends, every call Entered since the block began.
+class ProfileUnwinder {
+    Profiler* profiler_;
+    size_t depth_;
+
+public:
+    explicit ProfileUnwinder(Profiler* profiler)
+        : profiler_(profiler), depth_(profiler != nullptr ? profiler->GetDepth() : 0) {
+    }
+
+    ProfileUnwinder(const ProfileUnwinder&) = delete;
+    ProfileUnwinder& operator=(const ProfileUnwinder&) = delete;
+
+    ~ProfileUnwinder() {
+        if (profiler_ != nullptr) {
+            profiler_->Unwind(depth_);
+        }
+    }
+};
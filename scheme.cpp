@@ -2,24 +2,19 @@
 #include "tokenizer.h"
 #include "parser.h"
 #include "error.h"
-#include <sstream>
+#include "compiler.h"
+#include "memo.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "writer.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
 #include <vector>
 
-static std::vector<std::shared_ptr<Object>> UnfoldList(std::shared_ptr<Object> object) {
-    std::vector<std::shared_ptr<Object>> result;
-    while (object != nullptr) {
-        Cell* cell = dynamic_cast<Cell*>(object.get());
-        if (cell == nullptr) {
-            throw RuntimeError(std::string("Expected list, but got: ") + ToString(object));
-        }
-        result.push_back(cell->GetFirst());
-        object = cell->GetSecond();
-    }
-    return result;
-}
-
-static void FailEvaluation(const std::vector<std::shared_ptr<Object>>& args) {
-    std::string msg = "Failed to evaluate: (";
+static void FailEvaluation(const std::string& name, const Arguments& args) {
+    std::string msg = "Failed to evaluate: (" + name;
     for (const auto& arg : args) {
         msg.push_back(' ');
         msg += ToString(arg);
@@ -28,340 +23,327 @@ static void FailEvaluation(const std::vector<std::shared_ptr<Object>>& args) {
     throw RuntimeError(msg);
 }
 
-static std::string SymbolToName(const std::shared_ptr<const Object>& object) {
-    const Symbol* symbol = dynamic_cast<const Symbol*>(object.get());
-    if (symbol == nullptr) {
-        throw RuntimeError(std::string("Expected symbol, but got: ") + ToString(object));
+Scope::Scope(): parent_(nullptr) {
+}
+
+Scope::Scope(Scope* parent, size_t num_slots)
+    : parent_(parent), slots_(num_slots, Value::Unbound()) {
+}
+
+void Scope::Reset(Scope* parent, size_t num_slots) {
+    parent_ = parent;
+    slots_.assign(num_slots, Value::Unbound());
+}
+
+void Scope::Trace(Heap* heap) const {
+    heap->Mark(parent_);
+    for (const auto& value : slots_) {
+        heap->Mark(value);
     }
-    return symbol->GetName();
 }
 
-Scope::Scope() {
+GlobalLayout::GlobalLayout(std::shared_ptr<const GlobalLayout> base)
+    : base_(std::move(base)), base_size_(base_ != nullptr ? base_->GetSize() : 0) {
 }
 
-Scope::Scope(const std::weak_ptr<Scope>& parent): parent_(parent) {
+size_t GlobalLayout::Find(const Symbol* symbol) const {
+    if (base_ != nullptr) {
+        const size_t slot = base_->Find(symbol);
+        if (slot != kNone) {
+            return slot;
+        }
+    }
+    const auto iter = slots_.find(symbol);
+    return (iter != slots_.end() ? iter->second : kNone);
 }
 
-void Scope::AddRef() {
-    ++refs_;
+size_t GlobalLayout::Add(const Symbol* symbol) {
+    size_t slot = Find(symbol);
+    if (slot == kNone) {
+        slot = GetSize();
+        slots_.emplace(symbol, slot);
+        names_.push_back(symbol);
+    }
+    return slot;
 }
 
-void Scope::DelRef() {
-    --refs_;
+const Symbol* GlobalLayout::GetName(size_t slot) const {
+    return (slot < base_size_ ? base_->GetName(slot) : names_[slot - base_size_]);
 }
 
-size_t Scope::GetRefs() const {
-    return refs_;
+GlobalScope::GlobalScope() : layout_(std::make_shared<GlobalLayout>()) {
 }
 
-std::shared_ptr<Object>* Scope::FindVariable(const std::string& name) {
-    const auto iter = variables_.find(name);
-    if (iter != variables_.end()) {
-        return &(iter->second);
+void GlobalScope::Trace(Heap* heap) const {
+    Scope::Trace(heap);
+    for (const auto& value : variables_) {
+        heap->Mark(value);
     }
-    if (!parent_.expired()) {
-        return parent_.lock()->FindVariable(name);
+}
+
+void GlobalScope::Reset(std::shared_ptr<const GlobalLayout> base) {
+    layout_ = std::make_shared<GlobalLayout>(std::move(base));
+    variables_.clear();
+}
+
+void FramePool::Trace(Heap* heap) const {
+    for (Scope* frame : frames_) {
+        heap->Mark(frame);
     }
-    return nullptr;
 }
 
-std::shared_ptr<Object> Scope::GetVariable(const std::string& name) {
-    std::shared_ptr<Object>* ptr = FindVariable(name);
+Value GlobalScope::GetVariable(const Symbol* symbol) {
+    Value* ptr = FindVariable(symbol);
     if (ptr != nullptr) {
         return *ptr;
     }
-    throw NameError(std::string("No such variable: ") + name);
+    throw NameError(std::string("No such variable: ") + symbol->GetName());
 }
 
-void Scope::SetVariable(const std::string& name, const std::shared_ptr<Object>& value) {
-    std::shared_ptr<Object>* ptr = FindVariable(name);
-    if (ptr != nullptr) {
-        *ptr = value;
-    } else {
-        SetLocalVariable(name, value);
+static Profiler* GetProfilerOrFail(Interpreter* interpreter) {
+    Profiler* profiler = interpreter->GetProfiler();
+    if (profiler == nullptr) {
+        throw RuntimeError("The interpreter is not profiling");
     }
+    return profiler;
 }
 
-void Scope::SetLocalVariable(const std::string& name, const std::shared_ptr<Object>& value) {
-    variables_.insert(std::make_pair(name, value));
+static Value MakeList(const std::vector<Value>& elements) {
+    Value result;
+    for (auto iter = elements.rbegin(); iter != elements.rend(); ++iter) {
+        result = Value(Make<Cell>(*iter, result));
+    }
+    return result;
 }
 
-template <typename T>
-class CheckTypeCommand {
-    Interpreter* interpreter_;
+static Value MakeField(const char* name, const Value& value) {
+    return Value(Make<Cell>(Value(Intern(name)), value));
+}
+
+// (parallel-map f sequence) and (parallel-for-each f sequence), where the sequence is a list or
+// a vector; parallel-map returns the same kind of sequence (see ParallelMap).
+static Value ParallelCommand(const char* name, Interpreter* interpreter, const Arguments& args,
+                             bool keep_results) {
+    Lambda* lambda = (args.size() == 2 ? As<Lambda>(args[0]) : nullptr);
+    if (lambda == nullptr) {
+        FailEvaluation(name, args);
+    }
+    const Vector* vector = As<Vector>(args[1]);
+    std::vector<Value> elements;
+    if (vector != nullptr) {
+        elements = vector->GetElements();
+    } else {
+        try {
+            elements = UnfoldList(args[1]);
+        } catch (...) {
+            FailEvaluation(name, args);
+        }
+    }
+    std::vector<Value> results = ParallelMap(interpreter, lambda, elements, keep_results);
+    if (!keep_results) {
+        return nullptr;
+    }
+    if (vector != nullptr) {
+        return Value(Make<Vector>(std::move(results)));
+    }
+    return MakeList(results);
+}
 
-public:
-    CheckTypeCommand(Interpreter* interpreter) : interpreter_(interpreter) {
+// ((lambdas (name (calls . n) (total-seconds . x) ...) ...) (builtins (name (calls . n)) ...)),
+// most expensive first.
+static Value MakeProfileReport(Interpreter* interpreter) {
+    const Profiler* profiler = GetProfilerOrFail(interpreter);
+    std::vector<Value> lambdas{Value(Intern("lambdas"))};
+    for (const LambdaProfile& profile : profiler->GetLambdaProfiles()) {
+        lambdas.push_back(MakeList({
+            Value(Intern(profile.name)),
+            MakeField("calls", GetNumberConstant(profile.calls)),
+            MakeField("total-seconds", GetRealConstant(profile.total_seconds)),
+            MakeField("self-seconds", GetRealConstant(profile.self_seconds)),
+            MakeField("allocated-objects", GetNumberConstant(profile.allocated_objects)),
+            MakeField("allocated-bytes", GetNumberConstant(profile.allocated_bytes)),
+        }));
+    }
+    std::vector<Value> builtins{Value(Intern("builtins"))};
+    for (const BuiltinProfile& profile : profiler->GetBuiltinProfiles()) {
+        builtins.push_back(MakeList({
+            Value(Intern(profile.name)),
+            MakeField("calls", GetNumberConstant(profile.calls)),
+        }));
     }
+    return MakeList({MakeList(lambdas), MakeList(builtins)});
+}
 
-    std::shared_ptr<Object> operator()(std::vector<std::shared_ptr<Object>> args) const {
-        const size_t n = args.size();
-        if (n != 2) {
-            FailEvaluation(args);
+static void CheckNumbers(const std::string& name, const Arguments& args) {
+    for (const auto& arg : args) {
+        if (!IsNumber(arg)) {
+            FailEvaluation(name, args);
         }
-        args[1] = interpreter_->Eval(args[1]);
-        return GetBooleanConstant(dynamic_cast<T*>(args[1].get()) != nullptr);
     }
-};
-
-void Interpreter::InitCommands() {
-    commands_["quote"] = [](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        if (n != 2) {
-            FailEvaluation(args);
-        }
-        return args[1];
-    };
-    commands_["number?"] = CheckTypeCommand<Number>(this);
-    commands_["boolean?"] = CheckTypeCommand<Boolean>(this);
-    commands_["pair?"] = CheckTypeCommand<Cell>(this);
-    commands_["symbol?"] = CheckTypeCommand<Symbol>(this);
-    commands_["="] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (dynamic_cast<Number*>(args[i].get()) == nullptr) {
-                FailEvaluation(args);
-            }
+}
+
+template <typename T>
+static Value CheckTypeCommand(Interpreter*, const Arguments& args) {
+    if (args.size() != 1) {
+        FailEvaluation("type check", args);
+    }
+    return GetBooleanConstant(Is<T>(args[0]));
+}
+
+// Commands are stateless: the interpreter they run in is passed explicitly, so a single table
+// is built once and shared by every Interpreter.
+static std::map<std::string, Command> MakeCommands() {
+    std::map<std::string, Command> commands;
+    commands["number?"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("type check", args);
+        }
+        return GetBooleanConstant(IsNumber(args[0]));
+    };
+    commands["boolean?"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("type check", args);
         }
-        for (size_t i = 2; i < n; ++i) {
-            if (!Equal(args[1], args[i])) {
+        return GetBooleanConstant(args[0].IsBoolean());
+    };
+    commands["pair?"] = CheckTypeCommand<Cell>;
+    commands["symbol?"] = CheckTypeCommand<Symbol>;
+    commands["="] = [](Interpreter*, const Arguments& args) -> Value {
+        CheckNumbers("=", args);
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!Equal(args[0], args[i])) {
                 return GetBooleanConstant(false);
             }
         }
         return GetBooleanConstant(true);
     };
-    commands_["<"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (dynamic_cast<Number*>(args[i].get()) == nullptr) {
-                FailEvaluation(args);
-            }
-        }
-        for (size_t i = 2; i < n; ++i) {
+    commands["<"] = [](Interpreter*, const Arguments& args) -> Value {
+        CheckNumbers("<", args);
+        for (size_t i = 1; i < args.size(); ++i) {
             if (!Less(args[i - 1], args[i])) {
                 return GetBooleanConstant(false);
             }
         }
         return GetBooleanConstant(true);
     };
-    commands_[">"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (dynamic_cast<Number*>(args[i].get()) == nullptr) {
-                FailEvaluation(args);
-            }
-        }
-        for (size_t i = 2; i < n; ++i) {
+    commands[">"] = [](Interpreter*, const Arguments& args) -> Value {
+        CheckNumbers(">", args);
+        for (size_t i = 1; i < args.size(); ++i) {
             if (!Greater(args[i - 1], args[i])) {
                 return GetBooleanConstant(false);
             }
         }
         return GetBooleanConstant(true);
     };
-    commands_["<="] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (dynamic_cast<Number*>(args[i].get()) == nullptr) {
-                FailEvaluation(args);
-            }
-        }
-        for (size_t i = 2; i < n; ++i) {
+    commands["<="] = [](Interpreter*, const Arguments& args) -> Value {
+        CheckNumbers("<=", args);
+        for (size_t i = 1; i < args.size(); ++i) {
             if (!LessOrEqual(args[i - 1], args[i])) {
                 return GetBooleanConstant(false);
             }
         }
         return GetBooleanConstant(true);
     };
-    commands_[">="] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (dynamic_cast<Number*>(args[i].get()) == nullptr) {
-                FailEvaluation(args);
-            }
-        }
-        for (size_t i = 2; i < n; ++i) {
+    commands[">="] = [](Interpreter*, const Arguments& args) -> Value {
+        CheckNumbers(">=", args);
+        for (size_t i = 1; i < args.size(); ++i) {
             if (!GreaterOrEqual(args[i - 1], args[i])) {
                 return GetBooleanConstant(false);
             }
         }
         return GetBooleanConstant(true);
     };
-    commands_["+"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        std::shared_ptr<Object> result = GetNumberConstant(0);
-        for (size_t i = 1; i < n; ++i) {
-            result = Add(result, args[i]);
+    commands["+"] = [](Interpreter*, const Arguments& args) -> Value {
+        Value result = GetNumberConstant(0);
+        for (const auto& arg : args) {
+            result = Add(result, arg);
         }
         return result;
     };
-    commands_["-"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n <= 1) {
-            FailEvaluation(args);
+    commands["-"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.empty()) {
+            FailEvaluation("-", args);
         }
-        std::shared_ptr<Object> result = args[1];
-        for (size_t i = 2; i < n; ++i) {
+        Value result = args[0];
+        for (size_t i = 1; i < args.size(); ++i) {
             result = Subtract(result, args[i]);
         }
         return result;
     };
-    commands_["*"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        std::shared_ptr<Object> result = GetNumberConstant(1);
-        for (size_t i = 1; i < n; ++i) {
-            result = Multiply(result, args[i]);
+    commands["*"] = [](Interpreter*, const Arguments& args) -> Value {
+        Value result = GetNumberConstant(1);
+        for (const auto& arg : args) {
+            result = Multiply(result, arg);
         }
         return result;
     };
-    commands_["/"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n <= 1) {
-            FailEvaluation(args);
+    commands["/"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.empty()) {
+            FailEvaluation("/", args);
         }
-        std::shared_ptr<Object> result = args[1];
-        for (size_t i = 2; i < n; ++i) {
+        Value result = args[0];
+        for (size_t i = 1; i < args.size(); ++i) {
             result = Divide(result, args[i]);
         }
         return result;
     };
-    commands_["not"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n != 2) {
-            FailEvaluation(args);
-        }
-        return Not(args[1]);
-    };
-    commands_["and"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (!AsBoolean(args[i])) {
-                return args[i];
-            }
-        }
-        if (n > 1) {
-            return args.back();
-        } else {
-            return GetBooleanConstant(true);
+    commands["not"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("not", args);
         }
+        return Not(args[0]);
     };
-    commands_["or"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-            if (AsBoolean(args[i])) {
-                return args[i];
-            }
-        }
-        if (n > 1) {
-            return args.back();
-        } else {
-            return GetBooleanConstant(false);
-        }
-    };
-    commands_["min"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n <= 1) {
-            FailEvaluation(args);
+    commands["min"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.empty()) {
+            FailEvaluation("min", args);
         }
-        for (size_t i = 1; i < n; ++i) {
-            Number* number = dynamic_cast<Number*>(args[i].get());
-            if (number == nullptr) {
-                FailEvaluation(args);
-            }
-        }
-        std::shared_ptr<Object> result = args[1];
-        for (size_t i = 2; i < n; ++i) {
+        CheckNumbers("min", args);
+        Value result = args[0];
+        for (size_t i = 1; i < args.size(); ++i) {
             if (Less(args[i], result)) {
                 result = args[i];
             }
         }
         return result;
     };
-    commands_["max"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
+    commands["max"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.empty()) {
+            FailEvaluation("max", args);
         }
-        if (n <= 1) {
-            FailEvaluation(args);
-        }
-        for (size_t i = 1; i < n; ++i) {
-            Number* number = dynamic_cast<Number*>(args[i].get());
-            if (number == nullptr) {
-                FailEvaluation(args);
-            }
-        }
-        std::shared_ptr<Object> result = args[1];
-        for (size_t i = 2; i < n; ++i) {
+        CheckNumbers("max", args);
+        Value result = args[0];
+        for (size_t i = 1; i < args.size(); ++i) {
             if (Greater(args[i], result)) {
                 result = args[i];
             }
         }
         return result;
     };
-    commands_["abs"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n != 2) {
-            FailEvaluation(args);
+    commands["abs"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("abs", args);
         }
-        Number* number = dynamic_cast<Number*>(args[1].get());
-        if (number == nullptr) {
-            FailEvaluation(args);
+        if (!IsNumber(args[0])) {
+            FailEvaluation("abs", args);
         }
-        if (number->GetValue() >= 0) {
-            return args[1];
-        } else {
-            return GetNumberConstant(-number->GetValue());
+        if (Less(args[0], GetNumberConstant(0))) {
+            return Subtract(GetNumberConstant(0), args[0]);
         }
+        return args[0];
     };
-    commands_["null?"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n != 2) {
-            FailEvaluation(args);
+    commands["null?"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("null?", args);
         }
-        return GetBooleanConstant(args[1] == nullptr);
+        return GetBooleanConstant(args[0].IsNull());
     };
-    commands_["list?"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
+    commands["list?"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("list?", args);
         }
-        if (n != 2) {
-            FailEvaluation(args);
-        }
-        std::shared_ptr<Object> object = args[1];
-        while (object != nullptr) {
-            Cell* cell = dynamic_cast<Cell*>(object.get());
+        Value object = args[0];
+        while (!object.IsNull()) {
+            Cell* cell = As<Cell>(object);
             if (cell == nullptr) {
                 return GetBooleanConstant(false);
             }
@@ -369,301 +351,577 @@ void Interpreter::InitCommands() {
         }
         return GetBooleanConstant(true);
     };
-    commands_["cons"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n != 3) {
-            FailEvaluation(args);
+    commands["cons"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 2) {
+            FailEvaluation("cons", args);
         }
-        return std::shared_ptr<Object>(new Cell(args[1], args[2]));
+        return Value(Make<Cell>(args[0], args[1]));
     };
-    commands_["car"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
+    commands["car"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("car", args);
         }
-        if (n != 2) {
-            FailEvaluation(args);
-        }
-        Cell* cell = dynamic_cast<Cell*>(args[1].get());
+        Cell* cell = As<Cell>(args[0]);
         if (cell == nullptr) {
-            FailEvaluation(args);
+            FailEvaluation("car", args);
         }
         return cell->GetFirst();
     };
-    commands_["cdr"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
-        }
-        if (n != 2) {
-            FailEvaluation(args);
+    commands["cdr"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("cdr", args);
         }
-        Cell* cell = dynamic_cast<Cell*>(args[1].get());
+        Cell* cell = As<Cell>(args[0]);
         if (cell == nullptr) {
-            FailEvaluation(args);
+            FailEvaluation("cdr", args);
         }
         return cell->GetSecond();
     };
-    commands_["list"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
+    commands["set-car!"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        if (args.size() != 2) {
+            FailEvaluation("set-car!", args);
         }
-        std::shared_ptr<Object> result = nullptr;
-        for (size_t i = n - 1; i > 0; --i) {
-            result = std::shared_ptr<Object>(new Cell(args[i], result));
+        Cell* cell = As<Cell>(args[0]);
+        if (cell == nullptr) {
+            throw RuntimeError("Cannot set-car! on a non-pair");
         }
-        return result;
+        interpreter->CheckModifiable(cell, "set-car!");
+        cell->SetFirst(args[1]);
+        return nullptr;
     };
-    commands_["list-ref"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
+    commands["set-cdr!"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        if (args.size() != 2) {
+            FailEvaluation("set-cdr!", args);
         }
-        if (n != 3) {
-            FailEvaluation(args);
+        Cell* cell = As<Cell>(args[0]);
+        if (cell == nullptr) {
+            throw RuntimeError("Cannot set-cdr! on a non-pair");
         }
-        std::vector<std::shared_ptr<Object>> list;
-        try {
-            list = UnfoldList(args[1]);
-        } catch (...) {
-            FailEvaluation(args);
+        interpreter->CheckModifiable(cell, "set-cdr!");
+        cell->SetSecond(args[1]);
+        return nullptr;
+    };
+    commands["list"] = [](Interpreter*, const Arguments& args) -> Value {
+        Value result;
+        for (auto iter = args.rbegin(); iter != args.rend(); ++iter) {
+            result = Value(Make<Cell>(*iter, result));
         }
-        Number* number = dynamic_cast<Number*>(args[2].get());
-        if (number == nullptr) {
-            FailEvaluation(args);
+        return result;
+    };
+    commands["list-ref"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 2 || !args[1].IsFixnum() || args[1].GetFixnum() < 0) {
+            FailEvaluation("list-ref", args);
         }
-        size_t index = number->GetValue();
-        if (index >= list.size()) {
-            FailEvaluation(args);
+        Value object = args[0];
+        for (int64_t i = args[1].GetFixnum(); i != 0; --i) {
+            Cell* cell = As<Cell>(object);
+            if (cell == nullptr) {
+                FailEvaluation("list-ref", args);
+            }
+            object = cell->GetSecond();
         }
-        return list[index];
-    };
-    commands_["list-tail"] = [this](std::vector<std::shared_ptr<Object>> args) {
-        const size_t n = args.size();
-        for (size_t i = 1; i < n; ++i) {
-            args[i] = Eval(args[i]);
+        Cell* cell = As<Cell>(object);
+        if (cell == nullptr) {
+            FailEvaluation("list-ref", args);
         }
-        if (n != 3) {
-            FailEvaluation(args);
+        return cell->GetFirst();
+    };
+    commands["list-tail"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 2) {
+            FailEvaluation("list-tail", args);
         }
-        Number* number = dynamic_cast<Number*>(args[2].get());
-        if (number == nullptr) {
-            FailEvaluation(args);
+        if (!args[1].IsFixnum() || args[1].GetFixnum() < 0) {
+            FailEvaluation("list-tail", args);
         }
-        size_t to_drop = number->GetValue();
-        std::shared_ptr<Object> object = args[1];
-        for (size_t i = 0; i != to_drop; ++i) {
-            Cell* cell = dynamic_cast<Cell*>(object.get());
+        Value object = args[0];
+        for (int64_t i = args[1].GetFixnum(); i != 0; --i) {
+            Cell* cell = As<Cell>(object);
             if (cell == nullptr) {
-                FailEvaluation(args);
+                FailEvaluation("list-tail", args);
             }
             object = cell->GetSecond();
         }
         return object;
     };
-    commands_["define"] = [this](const std::vector<std::shared_ptr<Object>>& args) {
-        const size_t n = args.size();
-        if (n <= 1) {
-            throw SyntaxError("Invalid define");
+    commands["vector?"] = CheckTypeCommand<Vector>;
+    commands["make-vector"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        if (args.empty() || args.size() > 2 || !args[0].IsFixnum() || args[0].GetFixnum() < 0) {
+            FailEvaluation("make-vector", args);
+        }
+        interpreter->CheckAllocation(args[0].GetFixnum(), sizeof(Value));
+        const Value fill = (args.size() == 2 ? args[1] : GetNumberConstant(0));
+        return Value(Make<Vector>(args[0].GetFixnum(), fill));
+    };
+    commands["vector"] = [](Interpreter*, const Arguments& args) -> Value {
+        return Value(Make<Vector>(args));
+    };
+    commands["vector-length"] = [](Interpreter*, const Arguments& args) -> Value {
+        Vector* vector = (args.size() == 1 ? As<Vector>(args[0]) : nullptr);
+        if (vector == nullptr) {
+            FailEvaluation("vector-length", args);
         }
-        if (Symbol* symbol = dynamic_cast<Symbol*>(args[1].get())) {
-            if (n != 3) {
-                throw SyntaxError("Invalid define");
-            }
-            scope_->SetVariable(symbol->GetName(), nullptr); // to make variable visible inside its own scope
-            std::shared_ptr<Object> value = Eval(args[2]);
-            scope_->SetVariable(symbol->GetName(), value);
-        } else {
-            if (n < 3) {
-                throw SyntaxError("Invalid define");
-            }
-            std::string func_name;
-            std::vector<std::string> arg_names;
-            try {
-                std::vector<std::shared_ptr<Object>> list = UnfoldList(args[1]);
-                const size_t list_size = list.size();
-                if (list_size == 0) {
-                    throw;
-                }
-                func_name = SymbolToName(list.front());
-                arg_names.reserve(list_size - 1);
-                for (size_t i = 1; i < list_size; ++i) {
-                    arg_names.push_back(SymbolToName(list[i]));
-                }
-            } catch (...) {
-                throw SyntaxError("Invalid define");
-            }
-            std::vector<std::shared_ptr<Object>> expressions;
-            expressions.reserve(n - 2);
-            for (size_t i = 2; i < n; ++i) {
-                expressions.push_back(args[i]);
-            }
-            scope_->SetVariable(func_name, nullptr); // to make variable visible inside its own scope
-            Lambda* func = new Lambda(arg_names, scope_, expressions);
-            scope_->SetVariable(func_name, std::shared_ptr<Object>(func));
+        return GetNumberConstant(vector->GetSize());
+    };
+    commands["vector-ref"] = [](Interpreter*, const Arguments& args) -> Value {
+        Vector* vector = (args.size() == 2 ? As<Vector>(args[0]) : nullptr);
+        if (vector == nullptr || !args[1].IsFixnum() || args[1].GetFixnum() < 0 ||
+            static_cast<uint64_t>(args[1].GetFixnum()) >= vector->GetSize()) {
+            FailEvaluation("vector-ref", args);
         }
+        return (*vector)[args[1].GetFixnum()];
+    };
+    commands["vector-set!"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        Vector* vector = (args.size() == 3 ? As<Vector>(args[0]) : nullptr);
+        if (vector == nullptr || !args[1].IsFixnum() || args[1].GetFixnum() < 0 ||
+            static_cast<uint64_t>(args[1].GetFixnum()) >= vector->GetSize()) {
+            FailEvaluation("vector-set!", args);
+        }
+        interpreter->CheckModifiable(vector, "vector-set!");
+        (*vector)[args[1].GetFixnum()] = args[2];
         return nullptr;
     };
-    commands_["set!"] = [this](const std::vector<std::shared_ptr<Object>>& args) {
-        const size_t n = args.size();
-        if (n != 3) {
-            throw SyntaxError("Invalid set!");
+    commands["vector->list"] = [](Interpreter*, const Arguments& args) -> Value {
+        Vector* vector = (args.size() == 1 ? As<Vector>(args[0]) : nullptr);
+        if (vector == nullptr) {
+            FailEvaluation("vector->list", args);
         }
-        Symbol* symbol = dynamic_cast<Symbol*>(args[1].get());
-        if (symbol == nullptr) {
-            throw SyntaxError("Invalid set!");
+        Value result;
+        for (size_t i = vector->GetSize(); i != 0; --i) {
+            result = Value(Make<Cell>((*vector)[i - 1], result));
         }
-        std::shared_ptr<Object> value = Eval(args[2]);
-        std::shared_ptr<Object>* ptr = scope_->FindVariable(symbol->GetName());
-        if (ptr == nullptr) {
-            throw NameError(std::string("Variable doesn't yet exist: ") + symbol->GetName());
+        return result;
+    };
+    commands["list->vector"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("list->vector", args);
         }
-        *ptr = value;
-        return nullptr;
+        std::vector<Value> elements;
+        try {
+            elements = UnfoldList(args[0]);
+        } catch (...) {
+            FailEvaluation("list->vector", args);
+        }
+        return Value(Make<Vector>(std::move(elements)));
     };
-    commands_["set-car!"] = [this](const std::vector<std::shared_ptr<Object>>& args) {
-        const size_t n = args.size();
-        if (n != 3) {
-            throw SyntaxError("Invalid set-car!");
+    commands["char?"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("type check", args);
         }
-        Symbol* symbol = dynamic_cast<Symbol*>(args[1].get());
-        if (symbol == nullptr) {
-            throw SyntaxError("Invalid set-car!");
+        return GetBooleanConstant(args[0].IsChar());
+    };
+    commands["char->integer"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1 || !args[0].IsChar()) {
+            FailEvaluation("char->integer", args);
         }
-        std::shared_ptr<Object> value = Eval(args[2]);
-        std::shared_ptr<Object>* ptr = scope_->FindVariable(symbol->GetName());
-        if (ptr == nullptr) {
-            throw NameError(std::string("Variable doesn't yet exist: ") + symbol->GetName());
+        return GetNumberConstant(args[0].GetChar());
+    };
+    commands["integer->char"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1 || !args[0].IsFixnum() || args[0].GetFixnum() < 0 ||
+            args[0].GetFixnum() > UINT8_MAX) {
+            FailEvaluation("integer->char", args);
         }
-        Cell* cell = dynamic_cast<Cell*>(ptr->get());
-        if (cell == nullptr) {
-            throw RuntimeError("Cannot set-car! on a non-pair");
+        return Value::FromChar(args[0].GetFixnum());
+    };
+    commands["string?"] = CheckTypeCommand<String>;
+    commands["string-length"] = [](Interpreter*, const Arguments& args) -> Value {
+        String* string = (args.size() == 1 ? As<String>(args[0]) : nullptr);
+        if (string == nullptr) {
+            FailEvaluation("string-length", args);
         }
-        cell->SetFirst(value);
-        return nullptr;
+        return GetNumberConstant(string->GetSize());
     };
-    commands_["set-cdr!"] = [this](const std::vector<std::shared_ptr<Object>>& args) {
-        const size_t n = args.size();
-        if (n != 3) {
-            throw SyntaxError("Invalid set-cdr!");
+    commands["string-ref"] = [](Interpreter*, const Arguments& args) -> Value {
+        String* string = (args.size() == 2 ? As<String>(args[0]) : nullptr);
+        if (string == nullptr || !args[1].IsFixnum() || args[1].GetFixnum() < 0 ||
+            static_cast<uint64_t>(args[1].GetFixnum()) >= string->GetSize()) {
+            FailEvaluation("string-ref", args);
         }
-        Symbol* symbol = dynamic_cast<Symbol*>(args[1].get());
-        if (symbol == nullptr) {
-            throw SyntaxError("Invalid set-cdr!");
+        return Value::FromChar(string->GetView()[args[1].GetFixnum()]);
+    };
+    // (substring string start [end]): without an end, the rest of the string.
+    commands["substring"] = [](Interpreter*, const Arguments& args) -> Value {
+        String* string = (args.size() == 2 || args.size() == 3 ? As<String>(args[0]) : nullptr);
+        if (string == nullptr) {
+            FailEvaluation("substring", args);
+        }
+        const std::string_view text = string->GetView();
+        const Value end = (args.size() == 3 ? args[2] : GetNumberConstant(text.size()));
+        if (!args[1].IsFixnum() || !end.IsFixnum() || args[1].GetFixnum() < 0 ||
+            end.GetFixnum() < args[1].GetFixnum() ||
+            static_cast<uint64_t>(end.GetFixnum()) > text.size()) {
+            FailEvaluation("substring", args);
+        }
+        const size_t begin = args[1].GetFixnum();
+        return Value(Make<String>(text.substr(begin, end.GetFixnum() - begin)));
+    };
+    commands["string-append"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        std::vector<std::string_view> parts;
+        parts.reserve(args.size());
+        size_t size = 0;
+        for (const auto& arg : args) {
+            const String* string = As<String>(arg);
+            if (string == nullptr) {
+                FailEvaluation("string-append", args);
+            }
+            parts.push_back(string->GetView());
+            size += string->GetSize();
         }
-        std::shared_ptr<Object> value = Eval(args[2]);
-        std::shared_ptr<Object>* ptr = scope_->FindVariable(symbol->GetName());
-        if (ptr == nullptr) {
-            throw NameError(std::string("Variable doesn't yet exist: ") + symbol->GetName());
+        interpreter->CheckAllocation(size, 1);
+        return Value(Make<String>(parts));
+    };
+    commands["string=?"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.empty() || !std::all_of(args.begin(), args.end(), Is<String>)) {
+            FailEvaluation("string=?", args);
         }
-        Cell* cell = dynamic_cast<Cell*>(ptr->get());
-        if (cell == nullptr) {
-            throw RuntimeError("Cannot set-car! on a non-pair");
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!Equal(args[0], args[i])) {
+                return GetBooleanConstant(false);
+            }
         }
-        cell->SetSecond(value);
-        return nullptr;
+        return GetBooleanConstant(true);
     };
-    commands_["lambda"] = [this](const std::vector<std::shared_ptr<Object>>& args) {
-        const size_t n = args.size();
-        if (n < 3) {
-            throw SyntaxError("Invalid lambda");
+    commands["string->list"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        String* string = (args.size() == 1 ? As<String>(args[0]) : nullptr);
+        if (string == nullptr) {
+            FailEvaluation("string->list", args);
         }
-        std::vector<std::string> arg_names;
+        interpreter->CheckAllocation(string->GetSize(), sizeof(Cell));
+        const std::string_view text = string->GetView();
+        Value result;
+        for (size_t i = text.size(); i != 0; --i) {
+            result = Value(Make<Cell>(Value::FromChar(text[i - 1]), result));
+        }
+        return result;
+    };
+    commands["list->string"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1) {
+            FailEvaluation("list->string", args);
+        }
+        std::vector<Value> elements;
         try {
-            std::vector<std::shared_ptr<Object>> list = UnfoldList(args[1]);
-            arg_names.reserve(list.size());
-            for (const auto& element: list) {
-                arg_names.push_back(SymbolToName(element));
-            }
+            elements = UnfoldList(args[0]);
         } catch (...) {
-            throw SyntaxError("Invalid lambda");
-        }
-        std::vector<std::shared_ptr<Object>> expressions;
-        expressions.reserve(n - 2);
-        for (size_t i = 2; i < n; ++i) {
-            expressions.push_back(args[i]);
-        }
-        Lambda* lambda = new Lambda(arg_names, scope_, expressions);
-        return std::shared_ptr<Object>(lambda);
-    };
-    commands_["if"] = [this](const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object> {
-        const size_t n = args.size();
-        if (n != 3 && n != 4) {
-            throw SyntaxError("Invalid if");
-        }
-        bool condition = AsBoolean(Eval(args[1]));
-        if (n == 3) {
-            if (condition) {
-                return Eval(args[2]);
-            } else {
-                return nullptr;
-            }
-        } else {
-            if (condition) {
-                return Eval(args[2]);
-            } else {
-                return Eval(args[3]);
+            FailEvaluation("list->string", args);
+        }
+        std::string text;
+        text.reserve(elements.size());
+        for (const auto& element : elements) {
+            if (!element.IsChar()) {
+                FailEvaluation("list->string", args);
             }
+            text.push_back(element.GetChar());
+        }
+        return Value(Make<String>(text));
+    };
+    commands["string->symbol"] = [](Interpreter*, const Arguments& args) -> Value {
+        String* string = (args.size() == 1 ? As<String>(args[0]) : nullptr);
+        if (string == nullptr) {
+            FailEvaluation("string->symbol", args);
+        }
+        return Value(Intern(string->GetView()));
+    };
+    commands["symbol->string"] = [](Interpreter*, const Arguments& args) -> Value {
+        Symbol* symbol = (args.size() == 1 ? As<Symbol>(args[0]) : nullptr);
+        if (symbol == nullptr) {
+            FailEvaluation("symbol->string", args);
+        }
+        return Value(Make<String>(symbol->GetName()));
+    };
+    commands["number->string"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (args.size() != 1 || !IsNumber(args[0])) {
+            FailEvaluation("number->string", args);
+        }
+        return Value(Make<String>(ToString(args[0])));
+    };
+    commands["hash-table?"] = CheckTypeCommand<HashTable>;
+    commands["make-hash-table"] = [](Interpreter*, const Arguments& args) -> Value {
+        if (!args.empty()) {
+            FailEvaluation("make-hash-table", args);
+        }
+        return Value(Make<HashTable>());
+    };
+    // (hash-ref table key [default]): without a default, a missing key is an error.
+    commands["hash-ref"] = [](Interpreter*, const Arguments& args) -> Value {
+        HashTable* table = (args.size() == 2 || args.size() == 3 ? As<HashTable>(args[0])
+                                                                   : nullptr);
+        if (table == nullptr) {
+            FailEvaluation("hash-ref", args);
+        }
+        if (const Value* value = table->Find(args[1])) {
+            return *value;
+        }
+        if (args.size() != 3) {
+            FailEvaluation("hash-ref", args);
+        }
+        return args[2];
+    };
+    commands["hash-set!"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        HashTable* table = (args.size() == 3 ? As<HashTable>(args[0]) : nullptr);
+        if (table == nullptr) {
+            FailEvaluation("hash-set!", args);
+        }
+        interpreter->CheckModifiable(table, "hash-set!");
+        interpreter->CheckAllocation(table->GetRehashSize(), 1);
+        table->Set(args[1], args[2]);
+        return nullptr;
+    };
+    commands["hash-remove!"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        HashTable* table = (args.size() == 2 ? As<HashTable>(args[0]) : nullptr);
+        if (table == nullptr) {
+            FailEvaluation("hash-remove!", args);
+        }
+        interpreter->CheckModifiable(table, "hash-remove!");
+        table->Remove(args[1]);
+        return nullptr;
+    };
+    commands["hash-count"] = [](Interpreter*, const Arguments& args) -> Value {
+        HashTable* table = (args.size() == 1 ? As<HashTable>(args[0]) : nullptr);
+        if (table == nullptr) {
+            FailEvaluation("hash-count", args);
+        }
+        return GetNumberConstant(table->GetCount());
+    };
+    // (memoize f [capacity]) is f with a cache of the results of its last calls (see MemoCache).
+    commands["memoize"] = [](Interpreter*, const Arguments& args) -> Value {
+        Lambda* lambda = (args.size() == 1 || args.size() == 2 ? As<Lambda>(args[0]) : nullptr);
+        if (lambda == nullptr ||
+            (args.size() == 2 && (!args[1].IsFixnum() || args[1].GetFixnum() <= 0))) {
+            FailEvaluation("memoize", args);
+        }
+        const size_t capacity =
+            (args.size() == 2 ? args[1].GetFixnum() : MemoCache::kDefaultCapacity);
+        Lambda* memoized = Make<Lambda>(lambda->GetSharedProcedure(), lambda->GetScope());
+        memoized->SetMemo(Make<MemoCache>(capacity));
+        return Value(memoized);
+    };
+    // ((hits . n) (misses . n) (count . n) (capacity . n)) of a memoized lambda.
+    commands["memo-stats"] = [](Interpreter*, const Arguments& args) -> Value {
+        Lambda* lambda = (args.size() == 1 ? As<Lambda>(args[0]) : nullptr);
+        const MemoCache* memo = (lambda != nullptr ? lambda->GetMemo() : nullptr);
+        if (memo == nullptr) {
+            FailEvaluation("memo-stats", args);
+        }
+        return MakeList({
+            MakeField("hits", GetNumberConstant(memo->GetHits())),
+            MakeField("misses", GetNumberConstant(memo->GetMisses())),
+            MakeField("count", GetNumberConstant(memo->GetCount())),
+            MakeField("capacity", GetNumberConstant(memo->GetCapacity())),
+        });
+    };
+    commands["parallel-map"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        return ParallelCommand("parallel-map", interpreter, args, true);
+    };
+    commands["parallel-for-each"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        return ParallelCommand("parallel-for-each", interpreter, args, false);
+    };
+    commands["profile-report"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        if (!args.empty()) {
+            FailEvaluation("profile-report", args);
+        }
+        return MakeProfileReport(interpreter);
+    };
+    commands["profile-reset"] = [](Interpreter* interpreter, const Arguments& args) -> Value {
+        if (!args.empty()) {
+            FailEvaluation("profile-reset", args);
         }
+        GetProfilerOrFail(interpreter)->Clear();
+        return nullptr;
     };
+    return commands;
+}
+
+static std::unordered_map<size_t, Command> IndexCommands() {
+    std::unordered_map<size_t, Command> commands;
+    for (const auto& entry : MakeCommands()) {
+        commands[Intern(entry.first)->GetId()] = entry.second;
+    }
+    return commands;
+}
+
+Command FindCommand(const Symbol* symbol) {
+    static const std::unordered_map<size_t, Command> commands = IndexCommands();
+    const auto iter = commands.find(symbol->GetId());
+    return (iter != commands.end() ? iter->second : nullptr);
 }
 
-Interpreter::Interpreter(): scope_(new Scope) {
-    InitCommands();
-    scope_->AddRef();
+const std::string& GetCommandName(Command command) {
+    static const std::map<Command, std::string> names = [] {
+        std::map<Command, std::string> names;
+        for (const auto& entry : MakeCommands()) {
+            names[entry.second] = entry.first;
+        }
+        return names;
+    }();
+    return names.at(command);
 }
 
-Interpreter::Interpreter(const std::shared_ptr<Scope>& scope): scope_(scope) {
-    InitCommands();
-    scope_->AddRef();
+Interpreter::Interpreter(const InterpreterOptions& options)
+    : heap_(options.heap),
+      scope_(heap_.Allocate<GlobalScope>()),
+      engine_(options.engine),
+      pool_(options.pool != nullptr ? options.pool : &WorkStealingPool::GetDefault()) {
+    if (options.profile) {
+        profiler_.reset(new Profiler(&heap_));
+    }
+    SetLimits(options.limits);
+    heap_.AddRoot(scope_);
+    heap_.AddRootSet(&vm_);
+    heap_.AddRootSet(&frames_);
+}
+
+Interpreter::Interpreter(std::shared_ptr<const Snapshot> snapshot,
+                         const InterpreterOptions& options)
+    : Interpreter(options) {
+    snapshot_ = std::move(snapshot);
+    Reset();
+}
+
+Interpreter::Interpreter(Interpreter* parent)
+    : heap_(parent->heap_.GetOptions(), parent->heap_),
+      scope_(parent->scope_),
+      engine_(parent->engine_),
+      pool_(parent->pool_),
+      parent_(parent) {
+    SetLimits(parent->limits_);
+    heap_.AddRootSet(&vm_);
+    heap_.AddRootSet(&frames_);
 }
 
 Interpreter::~Interpreter() {
-    scope_->DelRef();
 }
 
-std::shared_ptr<Object> Interpreter::Eval(const std::shared_ptr<Object>& object) {
-    if (dynamic_cast<Number*>(object.get()) != nullptr) {
-        return object;
-    } else if (dynamic_cast<Boolean*>(object.get()) != nullptr) {
-        return object;
-    } else if (Symbol* symbol = dynamic_cast<Symbol*>(object.get())) {
-        return scope_->GetVariable(symbol->GetName());
-    } else if (dynamic_cast<Cell*>(object.get()) != nullptr) {
-        std::vector<std::shared_ptr<Object>> list = UnfoldList(object);
-        const size_t n = list.size();
-        if (n != 0) {
-            if (Symbol* command = dynamic_cast<Symbol*>(list.front().get())) {
-                const auto iter = commands_.find(command->GetName());
-                if (iter != commands_.end()) {
-                    return (iter->second)(list);
-                }
-            }
-            list.front() = Eval(list.front());
-            if (Lambda* lambda = dynamic_cast<Lambda*>(list.front().get())) {
-                std::vector<std::shared_ptr<Object>> args = list;
-                args.erase(args.begin());
-                for (auto& element: args) {
-                    element = Eval(element);
-                }
-                return lambda->Call(args);
-            }
+void Interpreter::Reset() {
+    CurrentHeapGuard guard(&heap_);
+    if (snapshot_ != nullptr) {
+        CopyGlobals(snapshot_->GetGlobals(), scope_);
+    } else {
+        scope_->Reset(nullptr);
+    }
+    tail_lambda_ = nullptr;
+    tail_args_.clear();
+    cancelled_.store(false, std::memory_order_relaxed);
+    heap_.Collect();
+}
+
+void Interpreter::SetLimits(const EvalLimits& limits) {
+    limits_ = limits;
+    max_depth_ = (limits.max_depth != 0 ? limits.max_depth : SIZE_MAX);
+    StartLimits();
+}
+
+void Interpreter::StartLimits() {
+    steps_ = 0;
+    counted_ = kCheckInterval;
+    if (limits_.max_steps != 0) {
+        counted_ = std::min(counted_, limits_.max_steps + 1);  // fails on the step after the last
+    }
+    countdown_ = counted_;
+    allocated_before_ = heap_.GetStats().allocated_bytes;
+}
+
+void Interpreter::CheckLimits() {
+    steps_ += counted_;
+    if (cancelled_.exchange(false, std::memory_order_relaxed)) {
+        throw RuntimeError("Evaluation cancelled");
+    }
+    // The caller of a parallel call takes its own cancellation once the call is over.
+    for (const Interpreter* parent = parent_; parent != nullptr; parent = parent->parent_) {
+        if (parent->cancelled_.load(std::memory_order_relaxed)) {
+            throw RuntimeError("Evaluation cancelled");
         }
     }
-    throw RuntimeError(std::string("Cannot evaluate: ") + ToString(object));
+    if (limits_.max_steps != 0 && steps_ > limits_.max_steps) {
+        throw RuntimeError("Evaluation exceeded " + std::to_string(limits_.max_steps) +
+                           " steps");
+    }
+    CheckAllocation(0, 1);
+    counted_ = kCheckInterval;
+    if (limits_.max_steps != 0) {
+        counted_ = std::min(counted_, limits_.max_steps + 1 - steps_);
+    }
+    countdown_ = counted_;
 }
 
-std::string Interpreter::Run(const std::string& code) {
-    std::stringstream ss;
-    ss << code;
-    Tokenizer tokenizer(&ss);
-    std::shared_ptr<Object> object = Read(&tokenizer);
+void Interpreter::CheckAllocation(size_t count, size_t size) const {
+    if (limits_.max_allocated_bytes == 0) {
+        return;
+    }
+    const size_t allocated = heap_.GetStats().allocated_bytes - allocated_before_;
+    if (allocated > limits_.max_allocated_bytes ||
+        count > (limits_.max_allocated_bytes - allocated) / size) {
+        FailAllocated();
+    }
+}
+
+void Interpreter::FailAllocated() const {
+    throw RuntimeError("Evaluation exceeded " + std::to_string(limits_.max_allocated_bytes) +
+                       " allocated bytes");
+}
+
+void Interpreter::FailDepth() const {
+    throw RuntimeError("Evaluation exceeded a call depth of " +
+                       std::to_string(limits_.max_depth));
+}
+
+// Objects of a Snapshot are shared by every interpreter forked from it (see Heap::Freeze), and
+// those of an interpreter by the workers of its parallel calls.
+void Interpreter::FailShared(const GcObject* object, const char* operation) const {
+    const char* owner = (object->IsFrozen() ? " on a constant of a snapshot"
+                                            : " on a value shared by a parallel call");
+    throw RuntimeError(std::string("Cannot ") + operation + owner);
+}
+
+GlobalScope* Interpreter::GetScope() const {
+    return scope_;
+}
+
+Value Interpreter::Eval(const Value& object) {
+    CurrentHeapGuard guard(&heap_);
+    StartLimits();
+    Roots roots(&heap_);
+    roots.Add(object);  // compiled code refers to its constants in place
+    if (engine_ == Engine::kBytecode) {
+        return vm_.Execute(this, *CompileToCode(object, scope_->GetLayout()));
+    }
+    return Compile(object, scope_->GetLayout())->Eval(this, nullptr);
+}
+
+static Value ReadOne(const std::string& code) {
+    Tokenizer tokenizer(code);
+    Value object = Read(&tokenizer);
     if (!tokenizer.IsEnd()) {
         throw SyntaxError("Unexpected input");
     }
-    return ToString(Eval(object));
+    return object;
+}
+
+std::string Interpreter::Run(const std::string& code) {
+    CurrentHeapGuard guard(&heap_);
+    heap_.MaybeCollect();
+    return ToString(Eval(ReadOne(code)));
+}
+
+void Interpreter::Run(const std::string& code, std::ostream* out) {
+    CurrentHeapGuard guard(&heap_);
+    heap_.MaybeCollect();
+    Write(Eval(ReadOne(code)), out);
+}
+
+void Interpreter::Run(std::istream* in, const std::function<void(const std::string&)>& callback) {
+    CurrentHeapGuard guard(&heap_);
+    Tokenizer tokenizer(in);
+    while (!tokenizer.IsEnd()) {
+        heap_.MaybeCollect();  // nothing of the previous forms is held but their effects
+        callback(ToString(Eval(Read(&tokenizer))));
+    }
+}
+
+void Interpreter::Run(std::istream* in, std::ostream* out) {
+    CurrentHeapGuard guard(&heap_);
+    Tokenizer tokenizer(in);
+    while (!tokenizer.IsEnd()) {
+        heap_.MaybeCollect();
+        Write(Eval(Read(&tokenizer)), out);
+        out->put('\n');
+    }
 }
@@ -1,41 +1,376 @@
 #pragma once
 
-#include <string>
+#include <atomic>
 #include <functional>
-#include <map>
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include "object.h"
+#include "vm.h"
+
+class Interpreter;
+class Lambda;
+class Profiler;
+class Snapshot;
+class WorkStealingPool;
+
+using Arguments = std::vector<Value>;
+
+// Commands are the builtin procedures; they receive their arguments already evaluated.
+using Command = Value (*)(Interpreter*, const Arguments&);
 
-using Command = std::function<std::shared_ptr<Object>(std::vector<std::shared_ptr<Object>>)>;
+Command FindCommand(const Symbol*);  // returns nullptr if there is no such command
+const std::string& GetCommandName(Command);
 
-class Scope {
-    std::weak_ptr<Scope> parent_;
-    std::map<std::string, std::shared_ptr<Object>> variables_;
-    size_t refs_ = 0;
+// The scope of a lambda call (a frame) keeps its arguments and internal defines in slots, which
+// the compiler resolves statically. Frames are heap objects: closures keep the frame they were
+// created in alive.
+class Scope : public GcObject {
+    Scope* parent_;
+    std::vector<Value> slots_;
 
 public:
     Scope();
-    Scope(const std::weak_ptr<Scope>&);
+    Scope(Scope* parent, size_t num_slots);
+    virtual void Trace(Heap*) const override;
+
+    void Reset(Scope* parent, size_t num_slots);  // makes the frame as good as new
+
+    Scope* GetParent() const {
+        return parent_;
+    }
+
+    Value& GetSlot(size_t index) {
+        return slots_[index];
+    }
+
+    const Value& GetSlot(size_t index) const {
+        return slots_[index];
+    }
+
+    size_t GetNumSlots() const {
+        return slots_.size();
+    }
+};
+
+// The names of the variables of a global scope, by slot. The compiler gives a name the next slot
+// the first time it compiles a reference, a define or a set! of it as a global variable, so a
+// global scope has as many variables as the names its code uses, however many symbols the
+// process interns. A global reference costs an index and a load.
+//
+// A layout may extend a base, which it shares and never changes: that of the snapshot its scope
+// was forked from. The code of the snapshot, shared by every fork, keeps the slots it was
+// compiled with, and each fork adds its own after them.
+class GlobalLayout {
+    std::shared_ptr<const GlobalLayout> base_;
+    size_t base_size_ = 0;
+    std::unordered_map<const Symbol*, size_t> slots_;  // of the names added after base_'s
+    std::vector<const Symbol*> names_;  // by slot, from base_size_ on
+
+public:
+    static constexpr size_t kNone = SIZE_MAX;
+
+    GlobalLayout() = default;
+    explicit GlobalLayout(std::shared_ptr<const GlobalLayout> base);
+
+    GlobalLayout(const GlobalLayout&) = delete;
+    GlobalLayout& operator=(const GlobalLayout&) = delete;
+
+    size_t GetSize() const {
+        return base_size_ + names_.size();
+    }
+
+    size_t Find(const Symbol*) const;  // kNone if the name has no slot
+    size_t Add(const Symbol*);  // the slot of the name, a new one if it has none
+    const Symbol* GetName(size_t slot) const;  // slot must be less than GetSize()
+};
+
+// The global variables of an interpreter, by the slots of its layout.
+class GlobalScope : public Scope {
+    std::shared_ptr<GlobalLayout> layout_;
+    std::vector<Value> variables_;  // by slot, Value::Unbound() where there is none
+
+public:
+    GlobalScope();
+    virtual void Trace(Heap*) const override;
+
+    // Forgets every variable and every slot, but for the slots of base, which may be nullptr.
+    void Reset(std::shared_ptr<const GlobalLayout> base);
+
+    GlobalLayout* GetLayout() const {
+        return layout_.get();
+    }
+
+    std::shared_ptr<const GlobalLayout> GetSharedLayout() const {
+        return layout_;
+    }
+
+    Value* FindVariable(size_t slot) {  // nullptr if there is no such variable
+        if (slot < variables_.size() && !variables_[slot].IsUnbound()) {
+            return &variables_[slot];
+        }
+        return nullptr;
+    }
+
+    Value* FindVariable(const Symbol* symbol) {
+        const size_t slot = layout_->Find(symbol);
+        return (slot != GlobalLayout::kNone ? FindVariable(slot) : nullptr);
+    }
 
-    void AddRef();
-    void DelRef();
-    size_t GetRefs() const;
+    Value GetVariable(const Symbol*); // throws exception if no such variable
 
-    std::shared_ptr<Object>* FindVariable(const std::string&); // return nullptr if no such variable
-    std::shared_ptr<Object> GetVariable(const std::string&); // throws exception if no such variable
-    void SetVariable(const std::string&, const std::shared_ptr<Object>&);
-    void SetLocalVariable(const std::string&, const std::shared_ptr<Object>&);
+    void SetVariable(size_t slot, const Value& value) {
+        if (slot >= variables_.size()) {
+            variables_.resize(layout_->GetSize(), Value::Unbound());
+        }
+        variables_[slot] = value;
+    }
+
+    void SetVariable(const Symbol* symbol, const Value& value) {
+        SetVariable(layout_->Add(symbol), value);
+    }
+
+    const std::vector<Value>& GetVariables() const {  // by slot, possibly fewer than slots
+        return variables_;
+    }
+
+    void SetVariables(std::vector<Value> variables) {  // by slot, at most as many as slots
+        variables_ = std::move(variables);
+    }
 };
 
+// Frames of calls whose procedure makes no closures (see Procedure::makes_closures), which
+// nothing refers to once the call returns. They go back to the pool of their interpreter on
+// return, emptied, and the calls that follow reuse them and the memory of their slots instead of
+// allocating new frames for the collector to free. The pool keeps as many frames as the deepest
+// such recursion took, up to kMaxSize.
+class FramePool : public RootSet {
+    static constexpr size_t kMaxSize = 256;
+
+    std::vector<Scope*> frames_;
+
+public:
+    virtual void Trace(Heap*) const override;
+
+    Scope* Take(Scope* parent, size_t num_slots) {
+        if (frames_.empty()) {
+            return Make<Scope>(parent, num_slots);
+        }
+        Scope* frame = frames_.back();
+        frames_.pop_back();
+        frame->Reset(parent, num_slots);
+        return frame;
+    }
+
+    void Give(Scope* frame) {  // of a call that has returned
+        if (frames_.size() != kMaxSize) {
+            frame->Reset(nullptr, 0);
+            frames_.push_back(frame);
+        }
+    }
+};
+
+// The tree-walking evaluator of compiled Nodes is the reference implementation; the bytecode VM
+// runs the same programs with the same results and errors.
+enum class Engine {
+    kTree,
+    kBytecode,
+};
+
+// Bounds on the evaluation of each top-level form, 0 for none. A step is a procedure call or a
+// tail call, which is what every loop goes through; the depth counts calls in progress. A form
+// that exceeds a bound, or is cancelled (see Interpreter::Cancel), stops with a RuntimeError,
+// and the interpreter can go on with the next one.
+struct EvalLimits {
+    size_t max_steps = 0;
+    // By heap objects and the memory they hold, garbage included; checked every few steps, and by
+    // the builtins whose allocations depend on their arguments before they allocate.
+    size_t max_allocated_bytes = 0;
+    size_t max_depth = 0;
+};
+
+struct InterpreterOptions {
+    Engine engine = Engine::kTree;
+    HeapOptions heap;
+    EvalLimits limits;
+    bool profile = false;  // whether to record a profile (see Profiler)
+    WorkStealingPool* pool = nullptr;  // for parallel-map, WorkStealingPool::GetDefault() if none
+};
+
+// Interpreters are independent: each has its own heap and global scope, and everything they
+// share (interned symbols, builtins, special forms, character tables) is immutable once built
+// or guarded by a lock. Different Interpreters may therefore run concurrently on different
+// threads; a single Interpreter, or the values it returned, must only be used by one thread at
+// a time. Cancel is the exception: it may be called from any thread.
 class Interpreter {
-    std::map<std::string, Command> commands_;
-    std::shared_ptr<Scope> scope_;
+    Heap heap_;
+    GlobalScope* scope_;  // a root of heap_
+    Engine engine_;
+    WorkStealingPool* pool_;  // for parallel calls, see ParallelMap
+    VirtualMachine vm_;  // a root set of heap_
+    FramePool frames_;  // a root set of heap_
+    Lambda* tail_lambda_ = nullptr;  // the pending tail call, see CallNode
+    std::vector<Value> tail_args_;
+    std::vector<std::vector<Value>> spare_args_;  // see TakeArgs
+    std::shared_ptr<const Snapshot> snapshot_;  // what Reset goes back to, may be nullptr
+    std::unique_ptr<Profiler> profiler_;  // nullptr unless profiling
+
+    // Step counts down the steps until the next CheckLimits, which counts them into steps_.
+    static constexpr size_t kCheckInterval = 1024;
+    EvalLimits limits_;
+    size_t max_depth_;  // limits_.max_depth, or no limit at all
+    size_t steps_ = 0;  // of the current form, up to the last CheckLimits
+    size_t countdown_ = 0;
+    size_t counted_ = 0;  // the steps countdown_ started from
+    size_t allocated_before_ = 0;  // bytes allocated by the heap before the current form
+    size_t depth_ = 0;  // Lambda::Calls in progress
+    std::atomic<bool> cancelled_{false};
+
+    // The workers of parallel calls, for each thread of the pool and the calling one. A worker
+    // evaluates with the globals and the limits of its parent, in a heap nested in the parent's.
+    Interpreter* parent_ = nullptr;
+    std::vector<std::unique_ptr<Interpreter>> workers_;
 
-    void InitCommands();
+    explicit Interpreter(Interpreter* parent);  // a worker
+    friend std::vector<Value> ParallelMap(Interpreter*, Lambda*, const std::vector<Value>&, bool);
+
+    void StartLimits();  // before each top-level form
+    void CheckLimits();
+    [[noreturn]] void FailDepth() const;
+    [[noreturn]] void FailAllocated() const;
+    [[noreturn]] void FailShared(const GcObject*, const char* operation) const;
 
 public:
-    Interpreter();
-    Interpreter(const std::shared_ptr<Scope>&);
+    explicit Interpreter(const InterpreterOptions& options = InterpreterOptions());
+    // Starts with the global environment of the snapshot, which the interpreter keeps alive.
+    explicit Interpreter(std::shared_ptr<const Snapshot>,
+                         const InterpreterOptions& options = InterpreterOptions());
     ~Interpreter();
-    std::shared_ptr<Object> Eval(const std::shared_ptr<Object>&);
-    std::string Run(const std::string&);
+
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    Heap& GetHeap() {
+        return heap_;
+    }
+
+    Engine GetEngine() const {
+        return engine_;
+    }
+
+    VirtualMachine& GetVirtualMachine() {
+        return vm_;
+    }
+
+    FramePool& GetFramePool() {
+        return frames_;
+    }
+
+    GlobalScope* GetScope() const;
+
+    Profiler* GetProfiler() const {  // nullptr unless the interpreter was created to profile
+        return profiler_.get();
+    }
+
+    void SetTailCall(Lambda* lambda, std::vector<Value>* args) {  // takes the arguments
+        tail_lambda_ = lambda;
+        tail_args_.swap(*args);
+    }
+
+    Lambda* TakeTailCall(std::vector<Value>* args) {
+        args->swap(tail_args_);
+        return tail_lambda_;
+    }
+
+    // An empty vector for the arguments of a call, with the capacity of one given back earlier,
+    // so that calls in either engine do not allocate their own. The callee may make more calls
+    // before the vector is given back, so each call takes its own; one that an exception unwinds
+    // through is simply freed.
+    std::vector<Value> TakeArgs() {
+        std::vector<Value> args;
+        if (!spare_args_.empty()) {
+            args.swap(spare_args_.back());
+            spare_args_.pop_back();
+        }
+        return args;
+    }
+
+    void GiveBackArgs(std::vector<Value>* args) {  // which may be empty, or come from elsewhere
+        if (args->capacity() != 0) {
+            args->clear();
+            spare_args_.push_back(std::move(*args));
+        }
+    }
+
+    void SetLimits(const EvalLimits&);  // for the forms evaluated from now on
+
+    const EvalLimits& GetLimits() const {
+        return limits_;
+    }
+
+    // Makes the form being evaluated, or else the next one, stop with a RuntimeError on its
+    // next step.
+    void Cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    void Step() {  // at every call, see EvalLimits
+        if (--countdown_ == 0) {
+            CheckLimits();
+        }
+    }
+
+    // Throws RuntimeError if object, which operation modifies, belongs to a snapshot, or to the
+    // caller of a parallel call that this interpreter is a worker of.
+    void CheckModifiable(const GcObject* object, const char* operation) const {
+        if (!heap_.Owns(object)) {
+            FailShared(object, operation);
+        }
+    }
+
+    // Throws RuntimeError if allocating count times size bytes more would exceed the
+    // max_allocated_bytes of the form being evaluated.
+    void CheckAllocation(size_t count, size_t size) const;
+
+    void CheckDepth(size_t depth) const {  // of the VM, whose frames make the depth
+        if (depth > max_depth_) {
+            FailDepth();
+        }
+    }
+
+    // Counts a Lambda::Call of the tree-walking evaluator while it is in progress.
+    class CallDepthGuard {
+        Interpreter* interpreter_;
+
+    public:
+        explicit CallDepthGuard(Interpreter* interpreter) : interpreter_(interpreter) {
+            if (++interpreter->depth_ > interpreter->max_depth_) {
+                --interpreter->depth_;
+                interpreter->FailDepth();
+            }
+        }
+
+        CallDepthGuard(const CallDepthGuard&) = delete;
+        CallDepthGuard& operator=(const CallDepthGuard&) = delete;
+
+        ~CallDepthGuard() {
+            --interpreter_->depth_;
+        }
+    };
+
+    // Forgets every global definition made since the interpreter was created, going back to
+    // its snapshot or to an empty environment, and frees what that leaves unreachable.
+    void Reset();
+
+    Value Eval(const Value&);
+    std::string Run(const std::string&);  // exactly one datum
+    void Run(const std::string&, std::ostream* out);  // writes the value instead, see Write
+
+    // Reads the top-level forms of a file or a socket one at a time, evaluating each as soon
+    // as it is complete and passing its printed value to callback before reading on. Stops
+    // at the end of the input; an error leaves the rest of it unread.
+    void Run(std::istream* in, const std::function<void(const std::string&)>& callback);
+    void Run(std::istream* in, std::ostream* out);  // writes each value followed by a newline
 };
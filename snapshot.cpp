@@ -0,0 +1,191 @@
+#include "snapshot.h"
+#include "memo.h"
+#include <tuple>
+#include <unordered_map>
+
+// Copies object graphs into the current heap: the modifiable part of frozen ones, or everything
+// that belongs to a heap about to be reused. Copy only makes an empty copy and queues it; Run
+// fills the queued copies in, queueing what they refer to in turn, so that long lists do not
+// recurse on the C++ stack and cycles are preserved.
+class Copier {
+    const Heap* from_;  // nullptr to copy from frozen heaps
+    std::unordered_map<const GcObject*, GcObject*> copies_;
+    std::vector<std::pair<const Object*, Object*>> objects_;  // cells and vectors to fill in
+    std::vector<std::pair<const Scope*, Scope*>> scopes_;
+    std::vector<std::pair<const HashTable*, HashTable*>> tables_;
+
+    void Drain();
+
+    bool IsCopied(const GcObject* object) const {
+        return from_ != nullptr ? from_->Owns(object) : object->IsFrozen();
+    }
+
+public:
+    explicit Copier(const Heap* from) : from_(from) {
+    }
+
+    Value Copy(const Value&);
+    Scope* Copy(const Scope*);
+    void Run();
+};
+
+Value Copier::Copy(const Value& value) {
+    Object* object = value.GetObject();
+    if (object == nullptr || !IsCopied(object)) {
+        return value;
+    }
+    const Lambda* lambda = As<Lambda>(value);
+    if (from_ == nullptr &&
+        (Is<Number>(value) || Is<Real>(value) || Is<String>(value) || Is<Symbol>(value) ||
+         (lambda != nullptr && lambda->GetScope() == nullptr && lambda->GetMemo() == nullptr))) {
+        return value;  // immutable, and frozen heaps are never freed before their forks
+    }
+    const auto iter = copies_.find(object);
+    if (iter != copies_.end()) {
+        return Value(static_cast<Object*>(iter->second));
+    }
+    Object* copy;
+    if (const Number* number = As<Number>(value)) {
+        copy = Make<Number>(number->GetValue());
+    } else if (const Real* real = As<Real>(value)) {
+        copy = Make<Real>(real->GetValue());
+    } else if (const String* string = As<String>(value)) {
+        copy = Make<String>(string->GetView());
+    } else if (lambda != nullptr) {
+        Lambda* lambda_copy = Make<Lambda>(lambda->GetSharedProcedure(), Copy(lambda->GetScope()));
+        if (const MemoCache* memo = lambda->GetMemo()) {  // which starts over, empty
+            lambda_copy->SetMemo(Make<MemoCache>(memo->GetCapacity()));
+        }
+        copy = lambda_copy;
+    } else if (const Vector* vector = As<Vector>(value)) {
+        copy = Make<Vector>(vector->GetSize(), Value());
+        objects_.emplace_back(vector, copy);
+    } else if (const HashTable* table = As<HashTable>(value)) {
+        HashTable* table_copy = Make<HashTable>();
+        tables_.emplace_back(table, table_copy);
+        copy = table_copy;
+    } else {
+        copy = Make<Cell>(nullptr, nullptr);
+        objects_.emplace_back(object, copy);
+    }
+    copies_[object] = copy;
+    return Value(copy);
+}
+
+Scope* Copier::Copy(const Scope* scope) {
+    if (scope == nullptr || !IsCopied(scope)) {
+        return const_cast<Scope*>(scope);
+    }
+    const auto iter = copies_.find(scope);
+    if (iter != copies_.end()) {
+        return static_cast<Scope*>(iter->second);
+    }
+    Scope* copy = Make<Scope>();
+    scopes_.emplace_back(scope, copy);
+    copies_[scope] = copy;
+    return copy;
+}
+
+void Copier::Drain() {
+    while (!objects_.empty() || !scopes_.empty()) {
+        if (!objects_.empty()) {
+            const auto [object, copy] = objects_.back();
+            objects_.pop_back();
+            if (const Cell* cell = As<Cell>(Value(const_cast<Object*>(object)))) {
+                Cell* cell_copy = static_cast<Cell*>(copy);
+                cell_copy->SetFirst(Copy(cell->GetFirst()));
+                cell_copy->SetSecond(Copy(cell->GetSecond()));
+            } else {
+                Vector* vector = static_cast<Vector*>(const_cast<Object*>(object));
+                Vector* vector_copy = static_cast<Vector*>(copy);
+                for (size_t i = 0; i != vector->GetSize(); ++i) {
+                    (*vector_copy)[i] = Copy((*vector)[i]);
+                }
+            }
+        } else {
+            const auto [scope, copy] = scopes_.back();
+            scopes_.pop_back();
+            Scope* original = const_cast<Scope*>(scope);
+            copy->Reset(Copy(original->GetParent()), original->GetNumSlots());
+            for (size_t i = 0; i != original->GetNumSlots(); ++i) {
+                copy->GetSlot(i) = Copy(original->GetSlot(i));
+            }
+        }
+    }
+}
+
+// Hash tables are filled in last: keys hash by their contents, so their copies must be complete
+// before they are inserted.
+void Copier::Run() {
+    std::vector<std::tuple<HashTable*, Value, Value>> entries;
+    for (;;) {
+        Drain();
+        if (tables_.empty()) {
+            break;
+        }
+        const auto tables = std::move(tables_);
+        tables_.clear();
+        for (const auto& [table, copy] : tables) {
+            table->ForEach([&, copy = copy](const Value& key, const Value& value) {
+                entries.emplace_back(copy, Copy(key), Copy(value));
+            });
+        }
+    }
+    for (const auto& [table, key, value] : entries) {
+        table->Set(key, value);
+    }
+}
+
+void CopyGlobals(const GlobalScope& from, GlobalScope* to) {
+    Copier copier(nullptr);
+    std::vector<Value> variables = from.GetVariables();
+    for (auto& value : variables) {
+        value = copier.Copy(value);
+    }
+    copier.Run();
+    to->Reset(from.GetSharedLayout());
+    to->SetVariables(std::move(variables));
+}
+
+void CopyOutOf(const Heap& from, std::vector<Value>* values) {
+    Copier copier(&from);
+    for (auto& value : *values) {
+        value = copier.Copy(value);
+    }
+    copier.Run();
+}
+
+Snapshot::Snapshot(std::unique_ptr<Interpreter> warmed) : interpreter_(std::move(warmed)) {
+    interpreter_->GetHeap().Freeze();
+}
+
+InterpreterPool::InterpreterPool(std::shared_ptr<const Snapshot> snapshot, size_t size,
+                                 const InterpreterOptions& options)
+    : snapshot_(std::move(snapshot)), options_(options) {
+    for (size_t i = 0; i != size; ++i) {
+        idle_.emplace_back(new Interpreter(snapshot_, options_));
+    }
+}
+
+InterpreterPool::Lease InterpreterPool::Acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            std::unique_ptr<Interpreter> interpreter = std::move(idle_.back());
+            idle_.pop_back();
+            return Lease(this, std::move(interpreter));
+        }
+    }
+    return Lease(this, std::unique_ptr<Interpreter>(new Interpreter(snapshot_, options_)));
+}
+
+// Resetting happens on the releasing thread, outside the lock.
+void InterpreterPool::Release(std::unique_ptr<Interpreter> interpreter) {
+    try {
+        interpreter->Reset();
+    } catch (...) {
+        return;  // not worth keeping
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(interpreter));
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "scheme.h"
+
+// The global environment of a warmed-up interpreter, frozen so that any number of interpreters
+// can start from it, on any thread, without reading or compiling anything again (see
+// Interpreter(std::shared_ptr<const Snapshot>)).
+//
+// What cannot change is shared by every fork: functions defined at the top level together with
+// their compiled code, numbers, strings and symbols. What a fork may modify (pairs, vectors, hash
+// tables and the frames captured by closures) is copied into the fork's own heap when it starts,
+// keeping shared structure shared. A memoized function is copied too, with an empty cache of its
+// own. Quoted constants inside compiled code stay shared, so modifying one is a RuntimeError in
+// a fork.
+class Snapshot {
+    std::unique_ptr<Interpreter> interpreter_;  // its heap is frozen
+
+public:
+    explicit Snapshot(std::unique_ptr<Interpreter> warmed);  // takes the interpreter over
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    const GlobalScope& GetGlobals() const {
+        return *interpreter_->GetScope();
+    }
+};
+
+// Forgets the variables of to and binds it to everything from's variables are bound to, in the
+// slots of from's layout, copying what a fork may modify into the current heap (see Snapshot).
+void CopyGlobals(const GlobalScope& from, GlobalScope* to);
+
+// Replaces values with copies in the current heap of everything they reach that belongs to from,
+// or to another heap nested as deeply (see Heap), keeping shared structure shared.
+void CopyOutOf(const Heap& from, std::vector<Value>* values);
+
+// Hands out interpreters forked from a snapshot and takes them back when the Lease ends,
+// resetting them for the next request. Reusing an interpreter is cheaper than forking a new one:
+// its heap keeps the memory it already reserved. Acquire may be called from any thread.
+class InterpreterPool {
+    std::shared_ptr<const Snapshot> snapshot_;
+    InterpreterOptions options_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Interpreter>> idle_;
+
+    void Release(std::unique_ptr<Interpreter>);
+
+public:
+    class Lease {
+        InterpreterPool* pool_;
+        std::unique_ptr<Interpreter> interpreter_;
+
+    public:
+        Lease(InterpreterPool* pool, std::unique_ptr<Interpreter> interpreter)
+            : pool_(pool), interpreter_(std::move(interpreter)) {
+        }
+
+        Lease(Lease&&) = default;
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease() {
+            if (interpreter_ != nullptr) {
+                pool_->Release(std::move(interpreter_));
+            }
+        }
+
+        Interpreter& operator*() const {
+            return *interpreter_;
+        }
+
+        Interpreter* operator->() const {
+            return interpreter_.get();
+        }
+    };
+
+    // Forks size interpreters up front; more are forked when all of them are in use.
+    InterpreterPool(std::shared_ptr<const Snapshot>, size_t size,
+                    const InterpreterOptions& options = InterpreterOptions());
+
+    Lease Acquire();
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// A minimal harness for the test programs: CHECK reports a condition that does not hold and
+// carries on, and main returns ExitStatus(), which fails if any did not.
+
+#include <cstdio>
+#include <cstdlib>
+
+inline int& GetFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,    \
+                         #condition);                                                 \
+            ++GetFailures();                                                          \
+        }                                                                             \
+    } while (false)
+
+// Checks that statement throws an exception of type Error.
+#define CHECK_THROWS(Error, statement) \
+    do {                               \
+        bool thrown = false;           \
+        try {                          \
+            statement;                 \
+        } catch (const Error&) {       \
+            thrown = true;             \
+        }                              \
+        CHECK(thrown);                 \
+    } while (false)
+
+inline int ExitStatus() {
+    if (GetFailures() != 0) {
+        std::fprintf(stderr, "%d checks failed\n", GetFailures());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
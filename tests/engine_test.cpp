@@ -0,0 +1,121 @@
+// The bytecode VM against the tree evaluator, the reference: the same forms must give the same
+// results, and fail with the same errors, in either engine.
+
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Each session runs in a fresh interpreter, form by form.
+static const std::vector<std::vector<const char*>> kSessions = {
+    {"(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))", "(fact 20)", "(fact 30)",
+     "(- (fact 25) (fact 24))", "(/ (fact 30) (fact 28))"},
+    {"(define (loop n acc) (if (= n 0) acc (loop (- n 1) (+ acc n))))", "(loop 100000 0)"},
+    {"(define (even? n) (if (= n 0) #t (odd? (- n 1))))",
+     "(define (odd? n) (if (= n 0) #f (even? (- n 1))))", "(even? 10001)", "(odd? 7)"},
+    {"(define (counter) (define n 0) (lambda () (set! n (+ n 1)) n))", "(define a (counter))",
+     "(define b (counter))", "(a)", "(a)", "(b)", "(a)"},
+    {"(define (adder x) (lambda (y) (lambda (z) (list x y z))))", "(((adder 1) 2) 3)",
+     "(define add1 (adder 1))", "((add1 5) 6)"},
+    {"(define (f x) (define y (* x 2)) (define (g) (+ x y)) (g))", "(f 4)"},
+    {"(define (f) (g) (define (g) 1) 2)", "(f)"},
+    {"(and 1 2 3)", "(and 1 #f 3)", "(or #f #f)", "(or #f 5)", "(and)", "(or)",
+     "(if #f #f)", "(if '() 1 2)", "(if 0 'zero 'nonzero)"},
+    {"'(1 (2 . 3) #t #\\a \"s\")", "(quote x)", "''x", "(car '(1 2))", "(cdr '(1 2))",
+     "(cons 1 2)", "(list)", "(list-ref '(a b c) 2)", "(list-tail '(a b c) 1)"},
+    {"(define v (make-vector 3 0))", "(vector-set! v 1 'x)", "v", "(vector-length v)",
+     "(vector->list (vector 1 2))", "(list->vector '(3 4))", "(vector-ref v 5)"},
+    {"(define s \"hello\")", "(string-length s)", "(string-ref s 1)", "(substring s 1 3)",
+     "(string-append s \" \" s)", "(string=? s \"hello\")", "(string->list \"ab\")",
+     "(list->string (list #\\a #\\b))", "(string->symbol \"sym\")", "(symbol->string 'abc)",
+     "(number->string 255)", "(char->integer #\\A)", "(integer->char 97)"},
+    {"(define h (make-hash-table))", "(hash-set! h 'a 1)", "(hash-set! h '(1 2) 2)",
+     "(hash-ref h 'a)", "(hash-ref h (list 1 2))", "(hash-ref h 'missing)", "(hash-count h)",
+     "(hash-remove! h 'a)", "(hash-count h)"},
+    {"(+ 4611686018427387903 1)", "(* 4611686018427387904 -2)", "(- -4611686018427387904 1)",
+     "(+ 1 2.5)", "(/ 7 2)", "(/ 7.0 2)", "(< 1 2.5 3)", "(= 1 1.0)", "(min 1 2.0)",
+     "(max 3 1 2)", "(abs -4611686018427387904)", "(* 1.5 2)", "1e400"},
+    {"(define-memo (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "(fib 80)"},
+    {"(define (tail-in-and n) (and #t (if (= n 0) 'done (tail-in-and (- n 1)))))",
+     "(tail-in-and 100000)",
+     "(define (tail-in-or n) (or #f (if (= n 0) 'done (tail-in-or (- n 1)))))",
+     "(tail-in-or 100000)"},
+    {"(define x 1)", "(set! x (+ x 1))", "x", "(define (get) x)", "(define x 10)", "(get)"},
+    // Errors
+    {"undefined-variable", "(set! undefined-variable 1)", "(undefined-function 1)"},
+    {"(define (f x) x)", "(f)", "(f 1 2)", "(1 2)", "((lambda (x) x))", "(car 1)",
+     "(+ 1 #t)", "(/ 1 0)", "(vector-ref (vector) 0)", "(string-ref \"\" 0)",
+     "(hash-ref 1 2)", "(< 'a 1)"},
+    {"(define (f) (g) (define g 1))", "(f)"},
+    {"(if)", "(if 1 2 3 4)", "(lambda)", "(lambda (1) 1)", "(define)", "(define 1 2)",
+     "(quote)", "(set! 1 2)", "(let)"},
+    {"(", ")", "(1 . )", "(. 1)", "#\\invalid-name", "\"unterminated"},
+};
+
+static std::string Evaluate(Interpreter* interpreter, const char* form) {
+    try {
+        return "= " + interpreter->Run(form);
+    } catch (const SyntaxError& error) {
+        return std::string("SyntaxError: ") + error.what();
+    } catch (const RuntimeError& error) {
+        return std::string("RuntimeError: ") + error.what();
+    } catch (const NameError& error) {
+        return std::string("NameError: ") + error.what();
+    }
+}
+
+// Each session, run in fresh interpreters of either engine, in heaps that also collect as often
+// as they may, to catch values that one engine forgets to root.
+static void TestParity() {
+    for (const auto& session : kSessions) {
+        for (size_t initial_size : {size_t(0), size_t(1)}) {
+            InterpreterOptions tree;
+            InterpreterOptions bytecode;
+            bytecode.engine = Engine::kBytecode;
+            if (initial_size != 0) {
+                tree.heap.initial_size = bytecode.heap.initial_size = initial_size;
+            }
+            Interpreter reference(tree);
+            Interpreter interpreter(bytecode);
+            for (const char* form : session) {
+                const std::string expected = Evaluate(&reference, form);
+                const std::string result = Evaluate(&interpreter, form);
+                if (result != expected) {
+                    std::fprintf(stderr, "%s\n  tree:     %s\n  bytecode: %s\n", form,
+                                 expected.c_str(), result.c_str());
+                }
+                CHECK(result == expected);
+            }
+        }
+    }
+}
+
+// Parity alone would not catch both engines being wrong in the same way.
+static void TestResults() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter interpreter(options);
+        interpreter.Run("(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))");
+        CHECK(interpreter.Run("(fact 25)") == "15511210043330985984000000");
+        interpreter.Run("(define (loop n acc) (if (= n 0) acc (loop (- n 1) (+ acc n))))");
+        CHECK(interpreter.Run("(loop 100000 0)") == "5000050000");
+        interpreter.Run("(define (counter) (define n 0) (lambda () (set! n (+ n 1)) n))");
+        interpreter.Run("(define c (counter))");
+        interpreter.Run("(c)");
+        CHECK(interpreter.Run("(c)") == "2");
+        CHECK(interpreter.Run("(((lambda (x) (lambda (y) (- x y))) 10) 3)") == "7");
+        CHECK_THROWS(NameError, interpreter.Run("undefined-variable"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(fact)"));
+        CHECK_THROWS(SyntaxError, interpreter.Run("(if)"));
+    }
+}
+
+int main() {
+    TestParity();
+    TestResults();
+    return ExitStatus();
+}
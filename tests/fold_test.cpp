@@ -0,0 +1,64 @@
+// Constant folding in the compiler: what it folds, and that what it folds away is never compiled.
+
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+
+#include <string>
+
+static size_t CountSlots(const Interpreter& interpreter) {
+    return interpreter.GetScope()->GetLayout()->GetSize();
+}
+
+static void TestFolds() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter interpreter(options);
+        CHECK(interpreter.Run("(* 60 60 24)") == "86400");
+        CHECK(interpreter.Run("(if #t 1 2)") == "1");
+        CHECK(interpreter.Run("(if (< 2 1) 1)") == "()");
+        CHECK(interpreter.Run("(and 1 #f x)") == "#f");
+        CHECK(interpreter.Run("(or #f 2 x)") == "2");
+        CHECK(interpreter.Run("(and)") == "#t");
+        CHECK(interpreter.Run("(or #f #f)") == "#f");
+        CHECK(interpreter.Run("(* 4611686018427387903 4)") == "18446744073709551612");
+        CHECK_THROWS(RuntimeError, interpreter.Run("(if #t (+ 1 #t))"));
+    }
+}
+
+// A lambda in a dead branch would mark the frame as captured, which keeps it from going back to
+// the FramePool: calling f would then allocate a frame each time.
+static void TestDeadBranchesKeepFramesReusable() {
+    for (const char* dead : {"(if #f (lambda () n) n)", "(if #t n (lambda () n))",
+                             "(if (< 1 0) (lambda () n) n)", "(or 1 (lambda () n))",
+                             "(and #f (lambda () n))"}) {
+        for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+            InterpreterOptions options;
+            options.engine = engine;
+            Interpreter interpreter(options);
+            interpreter.Run(std::string("(define (f n) ") + dead + ")");
+            interpreter.Run("(define (loop i) (if (= i 0) 0 (loop (- i (if (f i) 1 1)))))");
+            interpreter.Run("(loop 10)");
+            const size_t before = interpreter.GetHeap().GetStats().allocated_objects;
+            interpreter.Run("(loop 1000)");
+            CHECK(interpreter.GetHeap().GetStats().allocated_objects - before < 1000);
+        }
+    }
+}
+
+// Nor do the names in a dead branch take global slots.
+static void TestDeadBranchesTakeNoSlots() {
+    Interpreter interpreter;
+    const size_t builtins = CountSlots(interpreter);
+    interpreter.Run("(define (f) (if #f (never-defined 1) (and #f also-never-defined)))");
+    CHECK(CountSlots(interpreter) == builtins + 1);
+    CHECK(interpreter.Run("(f)") == "#f");
+}
+
+int main() {
+    TestFolds();
+    TestDeadBranchesKeepFramesReusable();
+    TestDeadBranchesTakeNoSlots();
+    return ExitStatus();
+}
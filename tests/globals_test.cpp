@@ -0,0 +1,63 @@
+// The global variables of an interpreter take one slot per name its own code uses (see
+// GlobalLayout), whatever other interpreters intern.
+
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+#include "snapshot.h"
+
+#include <memory>
+
+static size_t CountSlots(const Interpreter& interpreter) {
+    return interpreter.GetScope()->GetLayout()->GetSize();
+}
+
+// Symbols made at run time are not variables, here or in any other interpreter.
+static void TestSymbolsTakeNoSlots() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter other(options);
+        Interpreter interpreter(options);
+        const size_t builtins = CountSlots(interpreter);
+        other.Run(
+            "(define (intern i n) (if (< i n) ((lambda () (string->symbol (number->string i)) "
+            "(intern (+ i 1) n)))))");
+        other.Run("(intern 0 100000)");
+        CHECK(CountSlots(other) < builtins + 10);
+        interpreter.Run("(define x 1)");
+        CHECK(CountSlots(interpreter) == builtins + 1);
+        CHECK(interpreter.GetScope()->GetVariables().size() <= builtins + 1);
+        CHECK(interpreter.Run("(+ x 1)") == "2");
+        CHECK_THROWS(NameError, interpreter.Run("intern"));
+    }
+}
+
+// A fork adds its slots after the snapshot's, which its code shares, and drops them on Reset.
+static void TestForkSlots() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        auto warmed = std::make_unique<Interpreter>(options);
+        warmed->Run("(define base 10)");
+        warmed->Run("(define (get) base)");
+        const size_t shared = CountSlots(*warmed);
+        auto snapshot = std::make_shared<const Snapshot>(std::move(warmed));
+        Interpreter fork(snapshot, options);
+        CHECK(CountSlots(fork) == shared);
+        fork.Run("(define extra 1)");
+        fork.Run("(set! base (+ base extra))");
+        CHECK(fork.Run("(get)") == "11");
+        CHECK(CountSlots(fork) == shared + 1);
+        fork.Reset();
+        CHECK(CountSlots(fork) == shared);
+        CHECK(fork.Run("(get)") == "10");
+        CHECK_THROWS(NameError, fork.Run("extra"));
+    }
+}
+
+int main() {
+    TestSymbolsTakeNoSlots();
+    TestForkSlots();
+    return ExitStatus();
+}
@@ -0,0 +1,126 @@
+// Hash tables: open addressing with removed entries left behind as tombstones, which lookups must
+// probe past and rehashing must drop, and keys compared with Equal.
+
+#include "check.h"
+#include "error.h"
+#include "heap.h"
+#include "object.h"
+#include "scheme.h"
+
+#include <string>
+
+static const int kCount = 10000;
+
+static bool Has(HashTable* table, int64_t key, int64_t value) {
+    const Value* found = table->Find(GetNumberConstant(key));
+    return found != nullptr && found->IsFixnum() && found->GetFixnum() == value;
+}
+
+static bool Lacks(HashTable* table, int64_t key) {
+    return table->Find(GetNumberConstant(key)) == nullptr;
+}
+
+// Allocation never collects, so the tables need no roots here.
+static void TestInsertRemoveReinsert() {
+    Heap heap;
+    CurrentHeapGuard guard(&heap);
+    HashTable* table = Make<HashTable>();
+    for (int64_t key = 0; key != kCount; ++key) {
+        table->Set(GetNumberConstant(key), GetNumberConstant(key * 2));
+    }
+    CHECK(table->GetCount() == kCount);
+    table->Set(GetNumberConstant(7), GetNumberConstant(-7));  // replaces
+    CHECK(table->GetCount() == kCount);
+    CHECK(Has(table, 7, -7));
+    // Every other key goes, so that the ones left sit behind tombstones on their probe paths.
+    for (int64_t key = 0; key < kCount; key += 2) {
+        CHECK(table->Remove(GetNumberConstant(key)));
+    }
+    CHECK(!table->Remove(GetNumberConstant(0)));
+    CHECK(table->GetCount() == kCount / 2);
+    bool all = true;
+    for (int64_t key = 0; key != kCount; ++key) {
+        all = all && (key % 2 == 0 ? Lacks(table, key) : Has(table, key, key == 7 ? -7 : key * 2));
+    }
+    CHECK(all);
+    for (int64_t key = 0; key < kCount; key += 2) {
+        table->Set(GetNumberConstant(key), GetNumberConstant(key + 1));
+    }
+    CHECK(table->GetCount() == kCount);
+    all = true;
+    for (int64_t key = 0; key < kCount; key += 2) {
+        all = all && Has(table, key, key + 1);
+    }
+    CHECK(all);
+    size_t count = 0;
+    table->ForEach([&count](const Value&, const Value&) { ++count; });
+    CHECK(count == kCount);
+}
+
+// A window of keys sliding through many more: the tombstones it leaves fill the table, whose
+// rehashes must drop them rather than grow it without bound.
+static void TestTombstonesDoNotGrowTable() {
+    Heap heap;
+    CurrentHeapGuard guard(&heap);
+    HashTable* table = Make<HashTable>();
+    const int64_t window = 100;
+    for (int64_t key = 0; key != window; ++key) {
+        table->Set(GetNumberConstant(key), GetNumberConstant(key));
+    }
+    const size_t size = table->GetExternalSize();
+    for (int64_t key = window; key != 100 * kCount; ++key) {
+        table->Set(GetNumberConstant(key), GetNumberConstant(key));
+        CHECK(table->Remove(GetNumberConstant(key - window)));
+    }
+    CHECK(table->GetCount() == window);
+    CHECK(table->GetExternalSize() <= 2 * size);
+    bool all = true;
+    for (int64_t key = 100 * kCount - window; key != 100 * kCount; ++key) {
+        all = all && Has(table, key, key);
+    }
+    CHECK(all);
+    CHECK(Lacks(table, 100 * kCount - window - 1));
+}
+
+// Keys are compared with Equal, so the hash of equal keys of different representations agrees.
+static void TestEqualKeys() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.heap.initial_size = 1;  // collect at every chance, with the table's entries live
+        Interpreter interpreter(options);
+        interpreter.Run("(define h (make-hash-table))");
+        interpreter.Run("(hash-set! h (list 1 (vector 2 \"x\")) 'list)");
+        CHECK(interpreter.Run("(hash-ref h (list 1 (vector 2 (string-append \"\" \"x\"))))") ==
+              "list");
+        interpreter.Run("(hash-set! h 1 'one)");
+        CHECK(interpreter.Run("(hash-ref h 1.0)") == "one");
+        interpreter.Run("(hash-set! h (* 99999999999 99999999999) 'big)");
+        CHECK(interpreter.Run("(hash-ref h 9999999999800000000001)") == "big");
+        interpreter.Run("(hash-set! h 4611686018427387904 'just-past-fixnums)");
+        CHECK(interpreter.Run("(hash-ref h (+ 4611686018427387903 1))") == "just-past-fixnums");
+        interpreter.Run("(hash-set! h #\\a 'char)");
+        interpreter.Run("(hash-set! h 'a 'symbol)");
+        interpreter.Run("(hash-set! h \"a\" 'string)");
+        CHECK(interpreter.Run("(list (hash-ref h #\\a) (hash-ref h 'a) (hash-ref h \"a\"))") ==
+              "(char symbol string)");
+        CHECK(interpreter.Run("(hash-count h)") == "7");
+        interpreter.Run("(hash-remove! h 1.0)");
+        CHECK(interpreter.Run("(hash-count h)") == "6");
+        CHECK_THROWS(RuntimeError, interpreter.Run("(hash-ref h 1)"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(hash-set! 1 2 3)"));
+        interpreter.Run(
+            "(define (fill i n) (if (< i n) ((lambda () (hash-set! h (list i) (* i i)) "
+            "(fill (+ i 1) n)))))");
+        interpreter.Run("(fill 0 5000)");
+        CHECK(interpreter.Run("(hash-ref h (list 4999))") == "24990001");
+        CHECK(interpreter.Run("(hash-count h)") == std::to_string(6 + 5000));
+    }
+}
+
+int main() {
+    TestInsertRemoveReinsert();
+    TestTombstonesDoNotGrowTable();
+    TestEqualKeys();
+    return ExitStatus();
+}
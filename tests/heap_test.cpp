@@ -0,0 +1,68 @@
+// The collector's pacing and bounds, which must account for the memory objects hold outside
+// the heap as well as for the objects themselves.
+
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+
+// Vectors of 100000 elements, one alive at a time, in a heap whose threshold their headers
+// alone would never reach.
+static void TestVectorsTriggerCollections() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter interpreter(options);
+        interpreter.Run(
+            "(define (churn n) (if (= n 0) 0 ((lambda (v) (churn (- n 1))) "
+            "(make-vector 100000 0))))");
+        const size_t before = interpreter.GetHeap().GetStats().collections;
+        CHECK(interpreter.Run("(churn 200)") == "0");
+        const GcStats& stats = interpreter.GetHeap().GetStats();
+        CHECK(stats.collections > before + 10);
+        CHECK(stats.live_bytes < 16 * interpreter.GetHeap().GetOptions().initial_size);
+    }
+}
+
+static void TestVectorsCountTowardsMaxSize() {
+    InterpreterOptions options;
+    options.heap.max_size = 1 << 20;
+    Interpreter interpreter(options);
+    interpreter.Run("(define v (make-vector 1000000 0))");
+    CHECK_THROWS(RuntimeError, interpreter.GetHeap().Collect());
+}
+
+// A table grown to 100000 entries is counted in full, and goes when it is collected.
+static void TestHashTablesCountTowardsLiveBytes() {
+    Interpreter interpreter;
+    interpreter.Run(
+        "(define (fill h i n) (if (< i n) ((lambda () (hash-set! h i i) (fill h (+ i 1) n))) h))");
+    interpreter.Run("(define h (fill (make-hash-table) 0 100000))");
+    Heap& heap = interpreter.GetHeap();
+    heap.Collect();
+    const size_t with_table = heap.GetStats().live_bytes;
+    CHECK(with_table > 100000 * 2 * sizeof(Value));
+    interpreter.Run("(define h 0)");
+    heap.Collect();
+    CHECK(heap.GetStats().live_bytes < with_table - 100000 * 2 * sizeof(Value));
+}
+
+// Doubling a string twenty times allocates only a few objects, but megabytes of buffers.
+static void TestStringsTriggerCollections() {
+    Interpreter interpreter;
+    interpreter.Run(
+        "(define (grow s n) (if (= n 0) (string-length s) (grow (string-append s s) (- n 1))))");
+    const size_t before = interpreter.GetHeap().GetStats().collections;
+    CHECK(interpreter.Run("(grow \"abcdefghijklmnopq\" 20)") == "17825792");
+    CHECK(interpreter.Run("(grow \"abcdefghijklmnopq\" 20)") == "17825792");
+    const GcStats& stats = interpreter.GetHeap().GetStats();
+    CHECK(stats.collections > before);
+    CHECK(stats.allocated_bytes > 2 * 17825792);
+}
+
+int main() {
+    TestVectorsTriggerCollections();
+    TestVectorsCountTowardsMaxSize();
+    TestHashTablesCountTowardsLiveBytes();
+    TestStringsTriggerCollections();
+    return ExitStatus();
+}
@@ -0,0 +1,139 @@
+// Loading images back (see SaveImage), and rejecting malformed ones with a RuntimeError rather
+// than crashing or hanging.
+
+#include "check.h"
+#include "error.h"
+#include "image.h"
+#include "scheme.h"
+
+#include <random>
+#include <sstream>
+#include <string>
+
+static const char* const kDefinitions[] = {
+    "(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))",
+    "(define (counter) (define n 0) (lambda () (set! n (+ n 1)) n))",
+    "(define c (counter))",
+    "(define (adder x) (lambda (y) (lambda (z) (+ x y z))))",
+    "(define (q) '(1 (2 #t #f) \"text\" #\\a))",
+    "(define (sum l acc) (if (null? l) acc (sum (cdr l) (+ acc (car l)))))",
+    "(define l (list 1 2 3))",
+    "(define v (vector l l 5 'sym))",
+    "(define h (make-hash-table))",
+    "(hash-set! h l 7)",
+};
+
+static std::string MakeImage() {
+    Interpreter interpreter;
+    for (const char* definition : kDefinitions) {
+        interpreter.Run(definition);
+    }
+    std::ostringstream out;
+    SaveImage(interpreter, &out);
+    return out.str();
+}
+
+static void TestRoundTrip() {
+    Interpreter interpreter;
+    LoadImage(&interpreter, MakeImage());
+    CHECK(interpreter.Run("(fib 15)") == "610");
+    CHECK(interpreter.Run("(c)") == "1");
+    CHECK(interpreter.Run("(((adder 1) 2) 3)") == "6");
+    CHECK(interpreter.Run("(q)") == "(1 (2 #t #f) \"text\" #\\a)");
+    CHECK(interpreter.Run("(hash-ref h (list 1 2 3))") == "7");
+}
+
+// A quoted constant that was made circular is data, not code, so it loads.
+static void TestCircularConstant() {
+    Interpreter interpreter;
+    interpreter.Run("(define (q) '(1 2))");
+    interpreter.Run("(set-cdr! (cdr (q)) (q))");
+    std::ostringstream out;
+    SaveImage(interpreter, &out);
+    Interpreter loaded;
+    LoadImage(&loaded, out.str());
+    CHECK(loaded.Run("(car (cdr (cdr (q))))") == "1");
+}
+
+static void TestTruncated() {
+    const std::string image = MakeImage();
+    for (size_t size = 0; size != image.size(); ++size) {
+        Interpreter interpreter;
+        const std::string_view truncated = std::string_view(image).substr(0, size);
+        CHECK_THROWS(RuntimeError, LoadImage(&interpreter, truncated));
+    }
+}
+
+// What a corrupted image loads must fail, if at all, with an error rather than a crash, however
+// it is called: a lambda may have come back with the wrong frames around it, for one.
+static void LoadAndCall(const std::string& image) {
+    InterpreterOptions options;
+    options.limits.max_steps = 100000;
+    options.limits.max_depth = 1000;
+    Interpreter interpreter(options);
+    try {
+        LoadImage(&interpreter, image);
+    } catch (const RuntimeError&) {
+        CHECK(interpreter.Run("(+ 1 2)") == "3");
+        return;
+    }
+    for (const char* call : {"(fib 5)", "(c)", "(c)", "(((adder 1) 2) 3)", "(q)", "(sum l 0)",
+                             "(vector-ref v 2)", "(hash-ref h l)"}) {
+        try {
+            interpreter.Run(call);
+        } catch (const std::runtime_error&) {  // the errors of the interpreter
+        }
+    }
+    CHECK(interpreter.Run("(+ 1 2)") == "3");
+}
+
+// Every byte in turn, zeroed and incremented, which hits each reference to a scope and each size.
+static void TestEveryByte() {
+    const std::string image = MakeImage();
+    for (size_t i = 0; i != image.size(); ++i) {
+        std::string corrupted = image;
+        corrupted[i] = 0;
+        LoadAndCall(corrupted);
+        corrupted[i] = static_cast<char>(image[i] + 1);
+        LoadAndCall(corrupted);
+    }
+}
+
+// Corrupted bytes may make procedure bodies circular or improper, among other things.
+static void TestCorrupted() {
+    const std::string image = MakeImage();
+    std::mt19937 random(1);
+    std::uniform_int_distribution<size_t> position(0, image.size() - 1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int iteration = 0; iteration != 2000; ++iteration) {
+        std::string corrupted = image;
+        for (int i = 0; i != 3; ++i) {
+            corrupted[position(random)] = static_cast<char>(byte(random));
+        }
+        LoadAndCall(corrupted);
+    }
+}
+
+// A vector claims its size before its contents are read. An image of version 3 with no symbols,
+// no layouts and a thousand vectors of 3000 elements, each no longer than the image, must fail
+// before the reader allocates more than such a small image could hold.
+static void TestOversizedVectors() {
+    std::string image = std::string("SCMIMAGE") + '\x03' + '\x00' + '\x00' + "\xe8\x07";
+    for (int i = 0; i != 1000; ++i) {
+        image += "\x01\xb8\x17";
+    }
+    Interpreter interpreter;
+    const size_t before = interpreter.GetHeap().GetStats().allocated_bytes;
+    CHECK_THROWS(RuntimeError, LoadImage(&interpreter, image));
+    CHECK(interpreter.GetHeap().GetStats().allocated_bytes - before < (1 << 20));
+}
+
+int main() {
+    TestRoundTrip();
+    TestCircularConstant();
+    TestTruncated();
+    TestEveryByte();
+    TestCorrupted();
+    TestOversizedVectors();
+    return ExitStatus();
+}
@@ -0,0 +1,48 @@
+// Bounds on the evaluation of a form (see EvalLimits), which must hold even when a single
+// builtin call would exceed them.
+
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+
+// One call, so no step ever comes to check; the vector would take 400 MB.
+static void TestHugeVectorFails() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.limits.max_allocated_bytes = 10 << 20;
+        Interpreter interpreter(options);
+        CHECK_THROWS(RuntimeError, interpreter.Run("(make-vector 50000000 0)"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(make-vector 4611686018427387903 0)"));
+        CHECK(interpreter.Run("(vector-length (make-vector 1000 0))") == "1000");
+        CHECK(interpreter.GetHeap().GetStats().allocated_bytes < (10 << 20));
+    }
+}
+
+static void TestHugeStringsFail() {
+    InterpreterOptions options;
+    options.limits.max_allocated_bytes = 1 << 20;
+    Interpreter interpreter(options);
+    interpreter.Run("(define s \"0123456789abcdef0123456789abcdef\")");
+    interpreter.Run("(define (grow s n) (if (= n 0) s (grow (string-append s s) (- n 1))))");
+    CHECK_THROWS(RuntimeError, interpreter.Run("(grow s 20)"));
+    CHECK(interpreter.Run("(string-length (grow s 10))") == "32768");
+}
+
+// A table that grows past the budget fails on the insertion that would grow it.
+static void TestGrowingHashTableFails() {
+    InterpreterOptions options;
+    options.limits.max_allocated_bytes = 1 << 20;
+    Interpreter interpreter(options);
+    interpreter.Run(
+        "(define (fill h i n) (if (< i n) ((lambda () (hash-set! h i i) (fill h (+ i 1) n))) h))");
+    CHECK_THROWS(RuntimeError, interpreter.Run("(hash-count (fill (make-hash-table) 0 100000))"));
+    CHECK(interpreter.Run("(hash-count (fill (make-hash-table) 0 1000))") == "1000");
+}
+
+int main() {
+    TestHugeVectorFails();
+    TestHugeStringsFail();
+    TestGrowingHashTableFails();
+    return ExitStatus();
+}
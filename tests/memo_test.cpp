@@ -0,0 +1,113 @@
+// MemoCache: results by Equal arguments, at most capacity of them, the least recently used one
+// evicted first; and memoize, define-memo and memo-stats on top of it.
+
+#include "check.h"
+#include "error.h"
+#include "heap.h"
+#include "memo.h"
+#include "scheme.h"
+
+#include <string>
+#include <vector>
+
+static std::vector<Value> Args(int64_t arg) {
+    return {GetNumberConstant(arg)};
+}
+
+static bool Has(MemoCache* memo, int64_t arg, int64_t result) {
+    const Value* found = memo->Peek(Args(arg));
+    return found != nullptr && found->IsFixnum() && found->GetFixnum() == result;
+}
+
+// Allocation never collects, so the caches need no roots here.
+static void TestEvictsLeastRecentlyUsed() {
+    Heap heap;
+    CurrentHeapGuard guard(&heap);
+    MemoCache* memo = Make<MemoCache>(3);
+    for (int64_t arg : {1, 2, 3}) {
+        memo->Add(Args(arg), GetNumberConstant(10 * arg));
+    }
+    CHECK(memo->Find(Args(1)) != nullptr);  // 2 is now the oldest
+    CHECK(memo->Peek(Args(2)) != nullptr);  // which Peek leaves it
+    memo->Add(Args(4), GetNumberConstant(40));
+    CHECK(memo->GetCount() == 3);
+    CHECK(memo->Peek(Args(2)) == nullptr);
+    CHECK(Has(memo, 1, 10) && Has(memo, 3, 30) && Has(memo, 4, 40));
+    memo->Add(Args(3), GetNumberConstant(-30));  // replaces, and makes 3 the newest
+    CHECK(memo->GetCount() == 3);
+    memo->Add(Args(5), GetNumberConstant(50));
+    memo->Add(Args(6), GetNumberConstant(60));
+    CHECK(memo->Peek(Args(1)) == nullptr && memo->Peek(Args(4)) == nullptr);
+    CHECK(Has(memo, 3, -30) && Has(memo, 5, 50) && Has(memo, 6, 60));
+    CHECK(memo->Find(Args(1)) == nullptr);
+    CHECK(memo->GetHits() == 1);
+    CHECK(memo->GetMisses() == 1);
+}
+
+// Keys are compared with Equal, as in a HashTable.
+static void TestEqualArguments() {
+    Heap heap;
+    CurrentHeapGuard guard(&heap);
+    MemoCache* memo = Make<MemoCache>(MemoCache::kDefaultCapacity);
+    memo->Add({GetNumberConstant(1), Value(Make<String>("a"))}, GetNumberConstant(1));
+    CHECK(memo->Find({GetRealConstant(1.0), Value(Make<String>("a"))}) != nullptr);
+    CHECK(memo->Find({GetNumberConstant(1)}) == nullptr);
+    CHECK(memo->Find({GetNumberConstant(1), Value(Make<String>("b"))}) == nullptr);
+}
+
+// Many more keys than the capacity: the entries reused for new keys must move between buckets,
+// and the cache must keep exactly the last capacity of them.
+static void TestChurn() {
+    Heap heap;
+    CurrentHeapGuard guard(&heap);
+    const int64_t capacity = 100;
+    MemoCache* memo = Make<MemoCache>(capacity);
+    for (int64_t arg = 0; arg != 10000; ++arg) {
+        memo->Add(Args(arg), GetNumberConstant(arg));
+    }
+    CHECK(memo->GetCount() == capacity);
+    bool all = true;
+    for (int64_t arg = 0; arg != 10000; ++arg) {
+        all = all && (arg < 10000 - capacity ? memo->Peek(Args(arg)) == nullptr
+                                             : Has(memo, arg, arg));
+    }
+    CHECK(all);
+}
+
+static void TestMemoize() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.heap.initial_size = 1;  // collect at every chance, with the cached values live
+        Interpreter interpreter(options);
+        interpreter.Run("(define calls 0)");
+        interpreter.Run("(define (square n) (set! calls (+ calls 1)) (list n (* n n)))");
+        interpreter.Run("(define f (memoize square 2))");
+        for (const char* call : {"(f 1)", "(f 2)", "(f 1)", "(f 3)", "(f 1)", "(f 2)"}) {
+            interpreter.Run(call);
+        }
+        // 2 was evicted by 3, then 3 by 2.
+        CHECK(interpreter.Run("calls") == "4");
+        CHECK(interpreter.Run("(f 2)") == "(2 4)");
+        CHECK(interpreter.Run("(memo-stats f)") ==
+              "((hits . 3) (misses . 4) (count . 2) (capacity . 2))");
+        CHECK(interpreter.Run("(square 2)") == "(2 4)");
+        CHECK(interpreter.Run("calls") == "5");
+        interpreter.Run("(define-memo (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+        CHECK(interpreter.Run("(fib 90)") == "2880067194370816120");
+        CHECK(interpreter.Run("(memo-stats fib)") ==
+              "((hits . 88) (misses . 91) (count . 91) (capacity . 4096))");
+        CHECK_THROWS(RuntimeError, interpreter.Run("(memo-stats square)"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(memoize square 0)"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(memoize 1)"));
+        CHECK_THROWS(SyntaxError, interpreter.Run("(define-memo x 1)"));
+    }
+}
+
+int main() {
+    TestEvictsLeastRecentlyUsed();
+    TestEqualArguments();
+    TestChurn();
+    TestMemoize();
+    return ExitStatus();
+}
@@ -0,0 +1,185 @@
+// The numeric tower: fixnums, bignums and reals, and the literals that read as them.
+
+#include "bigint.h"
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+static bool Equal(const BigInt& lhs, const BigInt& rhs) {
+    return Compare(lhs, rhs) == 0;
+}
+
+static const BigInt kBase(int64_t(1) << 32);
+
+// Most significant limb first, by Horner's rule: each step multiplies by numbers of at most two
+// limbs, which never takes the Karatsuba path, so it can check it.
+static BigInt FromLimbs(const std::vector<uint32_t>& limbs) {
+    BigInt result;
+    for (uint32_t limb : limbs) {
+        result = result * kBase + BigInt(limb);
+    }
+    return result;
+}
+
+static BigInt ReferenceProduct(const BigInt& lhs, const std::vector<uint32_t>& rhs) {
+    BigInt result;
+    for (uint32_t limb : rhs) {
+        result = result * kBase + lhs * BigInt(limb);
+    }
+    return result;
+}
+
+// size limbs, the first nonzero; runs of all ones and of zeros make carries and borrows travel,
+// and top limbs of 0x80000000 or 0x7fffffff are the estimates that Knuth's algorithm D corrects.
+static std::vector<uint32_t> RandomLimbs(std::mt19937* random, size_t size) {
+    static const uint32_t kEdges[] = {0, 1, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff};
+    std::vector<uint32_t> limbs(size);
+    for (uint32_t& limb : limbs) {
+        const uint32_t choice = (*random)() % 8;
+        limb = (choice < 6 ? kEdges[choice] : static_cast<uint32_t>((*random)()));
+    }
+    if (!limbs.empty() && limbs[0] == 0) {
+        limbs[0] = 1 + (*random)() % 0xffffffff;
+    }
+    return limbs;
+}
+
+static const size_t kSizes[] = {1, 2, 3, 31, 32, 33, 63, 64, 65, 100, 257};
+
+// Around the Karatsuba threshold (32 limbs in the shorter operand), balanced or not.
+static void TestMultiplication() {
+    std::mt19937 random(1);
+    for (size_t n : kSizes) {
+        for (size_t m : kSizes) {
+            const std::vector<uint32_t> lhs_limbs = RandomLimbs(&random, n);
+            const std::vector<uint32_t> rhs_limbs = RandomLimbs(&random, m);
+            const BigInt lhs = FromLimbs(lhs_limbs);
+            const BigInt rhs = FromLimbs(rhs_limbs);
+            const BigInt product = lhs * rhs;
+            CHECK(Equal(product, ReferenceProduct(lhs, rhs_limbs)));
+            CHECK(Equal(product, rhs * lhs));
+            CHECK(Equal(-lhs * rhs, -product));
+            CHECK(Equal(-lhs * -rhs, product));
+        }
+    }
+    // (2^k - 1)^2 = 2^2k - 2^(k+1) + 1, where every partial sum carries.
+    for (size_t n : kSizes) {
+        const BigInt ones = FromLimbs(std::vector<uint32_t>(n, 0xffffffff));
+        std::vector<uint32_t> power(n + 1, 0);
+        power[0] = 1;
+        const BigInt half = FromLimbs(power);  // 2^k
+        CHECK(Equal(ones * ones, half * half - half - half + BigInt(1)));
+    }
+}
+
+// dividend = quotient * divisor + remainder, with 0 <= remainder < divisor, must come apart again.
+static void TestDivision() {
+    std::mt19937 random(2);
+    for (size_t n : kSizes) {
+        for (size_t m : kSizes) {
+            const BigInt quotient = FromLimbs(RandomLimbs(&random, n));
+            const BigInt divisor = FromLimbs(RandomLimbs(&random, m));
+            for (const BigInt& remainder :
+                 {BigInt(), FromLimbs(RandomLimbs(&random, m - 1)), divisor - BigInt(1)}) {
+                const BigInt dividend = quotient * divisor + remainder;
+                CHECK(Equal(dividend / divisor, quotient));
+                CHECK(Equal(dividend % divisor, remainder));
+            }
+        }
+    }
+    // Signs: truncation towards zero, and the remainder takes the sign of the dividend.
+    for (int i = 0; i != 200; ++i) {
+        BigInt dividend = FromLimbs(RandomLimbs(&random, 1 + random() % 70));
+        BigInt divisor = FromLimbs(RandomLimbs(&random, 1 + random() % 40));
+        dividend = (random() % 2 ? -dividend : dividend);
+        divisor = (random() % 2 ? -divisor : divisor);
+        const BigInt quotient = dividend / divisor;
+        const BigInt remainder = dividend % divisor;
+        CHECK(Equal(quotient * divisor + remainder, dividend));
+        CHECK(remainder.IsZero() || remainder.IsNegative() == dividend.IsNegative());
+        const BigInt magnitude = (divisor.IsNegative() ? -divisor : divisor);
+        CHECK(Compare(remainder.IsNegative() ? -remainder : remainder, magnitude) < 0);
+    }
+    CHECK(Equal(BigInt(-7) / BigInt(2), BigInt(-3)));
+    CHECK(Equal(BigInt(-7) % BigInt(2), BigInt(-1)));
+    CHECK(Equal(BigInt(7) % BigInt(-2), BigInt(1)));
+}
+
+static void TestConversions() {
+    std::mt19937 random(3);
+    for (size_t length : {1, 9, 10, 19, 20, 40, 200, 1000}) {
+        std::string digits(1, static_cast<char>('1' + random() % 9));
+        while (digits.size() != length) {
+            digits.push_back(static_cast<char>('0' + random() % 10));
+        }
+        CHECK(BigInt::Parse(digits).ToString() == digits);
+        CHECK(BigInt::Parse("-" + digits).ToString() == "-" + digits);
+        CHECK(BigInt::Parse("+" + digits).ToString() == digits);
+    }
+    CHECK(BigInt::Parse("-0").ToString() == "0");
+    CHECK(!BigInt::Parse("-0").IsNegative());
+    CHECK(BigInt::Parse("000123").ToString() == "123");
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    const int64_t min = std::numeric_limits<int64_t>::min();
+    CHECK(BigInt(max).FitsInt64() && BigInt(max).ToInt64() == max);
+    CHECK(BigInt(min).FitsInt64() && BigInt(min).ToInt64() == min);
+    CHECK(BigInt(min).ToString() == "-9223372036854775808");
+    CHECK(!(BigInt(max) + BigInt(1)).FitsInt64());
+    CHECK(!(BigInt(min) - BigInt(1)).FitsInt64());
+    CHECK((kBase * kBase).ToDouble() == 18446744073709551616.0);
+    CHECK(Compare(BigInt(-5), BigInt(3)) < 0 && Compare(kBase, BigInt(max)) < 0);
+}
+
+// In the interpreter, fixnums overflow into bignums and bignums that fit come back as fixnums.
+static void TestPromotion() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter interpreter(options);
+        CHECK(interpreter.Run("(+ 4611686018427387903 1)") == "4611686018427387904");
+        CHECK(interpreter.Run("(- -4611686018427387904 1)") == "-4611686018427387905");
+        CHECK(interpreter.Run("(* 99999999999 99999999999)") == "9999999999800000000001");
+        CHECK(interpreter.Run("(- (+ 4611686018427387903 1) 1)") == "4611686018427387903");
+        interpreter.Run("(define big (* 123456789012345678901234567890 98765432109876543210))");
+        CHECK(interpreter.Run("(/ big 98765432109876543210)") == "123456789012345678901234567890");
+        CHECK(interpreter.Run("(= (/ big big) 1)") == "#t");
+        CHECK(interpreter.Run("(< 4611686018427387903 4611686018427387904)") == "#t");
+        CHECK_THROWS(RuntimeError, interpreter.Run("(/ big 0)"));
+    }
+}
+
+// Out of the range of a double, a real literal reads as the infinity or the zero that IEEE
+// arithmetic would give, never as whatever from_chars left behind.
+static void TestRealLiteralsOutOfRange() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter interpreter(options);
+        CHECK(interpreter.Run("1e400") == "+inf.0");
+        CHECK(interpreter.Run("-1e400") == "-inf.0");
+        CHECK(interpreter.Run("+1e99999999999999999999") == "+inf.0");
+        CHECK(interpreter.Run("1e-400") == "0.0");
+        CHECK(interpreter.Run("-1e-400") == "-0.0");
+        CHECK(interpreter.Run("123.e-99999999999999999999") == "0.0");
+        CHECK(interpreter.Run("1e-310") == "1e-310");  // subnormal, still in range
+        CHECK(interpreter.Run("(< 1e308 1e400)") == "#t");
+        CHECK(interpreter.Run("(+ 1 1e400)") == "+inf.0");
+        CHECK(interpreter.Run(std::string(400, '9') + ".5") == "+inf.0");
+        CHECK(interpreter.Run("0." + std::string(400, '0') + "1") == "0.0");
+    }
+}
+
+int main() {
+    TestMultiplication();
+    TestDivision();
+    TestConversions();
+    TestPromotion();
+    TestRealLiteralsOutOfRange();
+    return ExitStatus();
+}
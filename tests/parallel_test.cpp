@@ -0,0 +1,112 @@
+// parallel-map and parallel-for-each: results in order, the first error of any call, and other
+// calls stopped by it, by a cancellation or by the limits of the caller.
+
+#include "check.h"
+#include "error.h"
+#include "parallel.h"
+#include "scheme.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+static void Define(Interpreter* interpreter) {
+    interpreter->Run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    interpreter->Run("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons (- n 1) acc))))");
+    interpreter->Run("(define (spin) (spin))");
+}
+
+static void TestResults(WorkStealingPool* pool) {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.pool = pool;
+        options.heap.initial_size = 1;  // collect at every chance, in the workers too
+        Interpreter interpreter(options);
+        Define(&interpreter);
+        CHECK(interpreter.Run("(parallel-map fib (list 1 2 3 4 5 6 7 8 9 10))") ==
+              "(1 1 2 3 5 8 13 21 34 55)");
+        CHECK(interpreter.Run("(parallel-map (lambda (x) (list x (* 2 x))) (vector 1 2))") ==
+              "#((1 2) (2 4))");
+        CHECK(interpreter.Run("(list-ref (parallel-map (lambda (x) (* x x)) (range 1000 '())) "
+                              "999)") == "998001");
+        CHECK(interpreter.Run("(parallel-map (lambda (x) (* x 100000000000000000000)) '(2))") ==
+              "(200000000000000000000)");
+        CHECK(interpreter.Run("(parallel-map fib '())") == "()");
+        CHECK(interpreter.Run("(parallel-for-each fib (range 20 '()))") == "()");
+        // Closures made in the workers outlive them, with the state they captured.
+        interpreter.Run(
+            "(define counters (parallel-map (lambda (x) (define n x) (lambda () (set! n (+ n 1)) "
+            "n)) '(10 20)))");
+        interpreter.Run("((car counters))");
+        CHECK(interpreter.Run("((car counters))") == "12");
+        CHECK(interpreter.Run("((car (cdr counters)))") == "21");
+    }
+}
+
+static void TestErrors(WorkStealingPool* pool) {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.pool = pool;
+        Interpreter interpreter(options);
+        Define(&interpreter);
+        interpreter.Run("(define shared (list 1 2))");
+        CHECK_THROWS(RuntimeError,
+                     interpreter.Run("(parallel-map (lambda (x) (car x)) '((1) 2 (3)))"));
+        CHECK_THROWS(RuntimeError,
+                     interpreter.Run("(parallel-map (lambda (x) (set-car! shared x)) '(1 2))"));
+        CHECK_THROWS(RuntimeError,
+                     interpreter.Run("(parallel-map (lambda (x) (set! fib x)) '(1))"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(parallel-map fib 5)"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(parallel-map (lambda (x y) x) '(1))"));
+        // Only one call spins, so another worker always reaches an error, which must stop it.
+        if (pool->GetNumThreads() != 0) {
+            try {
+                interpreter.Run("(parallel-map (lambda (x) (if (= x 0) (spin) (car x))) "
+                                "'(0 1 2 3 4))");
+                CHECK(false);
+            } catch (const RuntimeError& error) {
+                CHECK(std::string(error.what()).find("(car ") != std::string::npos);
+            }
+        }
+        CHECK(interpreter.Run("shared") == "(1 2)");
+        CHECK(interpreter.Run("(parallel-map fib '(10 11))") == "(55 89)");
+    }
+}
+
+static void TestCancel(WorkStealingPool* pool) {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.pool = pool;
+        Interpreter interpreter(options);
+        Define(&interpreter);
+        std::thread canceller([&interpreter] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            interpreter.Cancel();
+        });
+        CHECK_THROWS(RuntimeError, interpreter.Run("(parallel-for-each spin '(1 2 3 4 5 6 7 8))"));
+        canceller.join();
+        CHECK(interpreter.Run("(parallel-map fib '(10))") == "(55)");
+
+        // The limits of the caller apply to each call on its own.
+        EvalLimits limits;
+        limits.max_steps = 100000;
+        interpreter.SetLimits(limits);
+        CHECK_THROWS(RuntimeError, interpreter.Run("(parallel-for-each spin '(1 2))"));
+        CHECK(interpreter.Run("(parallel-map fib '(15 15 15 15 15 15 15 15))") ==
+              "(610 610 610 610 610 610 610 610)");
+    }
+}
+
+int main() {
+    WorkStealingPool pool(3);
+    TestResults(&pool);
+    TestErrors(&pool);
+    TestCancel(&pool);
+    // Without threads of its own, the pool runs every call on the calling thread.
+    WorkStealingPool single(0);
+    TestErrors(&single);
+    return ExitStatus();
+}
@@ -0,0 +1,160 @@
+// String and character literals, as the Tokenizer reads them from buffers and from streams; and
+// strings on either side of the size up to which a String keeps its bytes in itself.
+
+#include "check.h"
+#include "error.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+#include <sstream>
+#include <string>
+#include <variant>
+
+// The one token of text, read from a buffer or from a stream, whose code differs.
+static Token ReadToken(const std::string& text, bool stream, std::string* string_text) {
+    std::istringstream in(text);
+    Tokenizer buffer_tokenizer(text);
+    Tokenizer stream_tokenizer(&in);
+    Tokenizer* tokenizer = (stream ? &stream_tokenizer : &buffer_tokenizer);
+    const Token token = tokenizer->GetToken();
+    if (const StringToken* string_token = std::get_if<StringToken>(&token)) {
+        *string_text = std::string(string_token->text);  // which the next token may overwrite
+    }
+    tokenizer->Next();
+    CHECK(tokenizer->IsEnd());
+    return token;
+}
+
+static bool ReadsString(const std::string& text, const std::string& expected) {
+    for (bool stream : {false, true}) {
+        std::string result;
+        const Token token = ReadToken(text, stream, &result);
+        if (!std::holds_alternative<StringToken>(token) || result != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ReadsChar(const std::string& text, char expected) {
+    for (bool stream : {false, true}) {
+        std::string unused;
+        const Token token = ReadToken(text, stream, &unused);
+        const CharToken* char_token = std::get_if<CharToken>(&token);
+        if (char_token == nullptr || char_token->value != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool FailsToRead(const std::string& text) {
+    for (bool stream : {false, true}) {
+        try {
+            std::string unused;
+            ReadToken(text, stream, &unused);
+            return false;
+        } catch (const SyntaxError&) {
+        }
+    }
+    return true;
+}
+
+static void TestStringLiterals() {
+    CHECK(ReadsString(R"("")", ""));
+    CHECK(ReadsString(R"("plain text")", "plain text"));
+    CHECK(ReadsString(R"("a\nb\tc\rd")", "a\nb\tc\rd"));
+    CHECK(ReadsString(R"("\"quoted\" \\ back")", "\"quoted\" \\ back"));
+    CHECK(ReadsString(R"("\x41;\x7e;\x0;")", std::string("A~\0", 3)));
+    CHECK(ReadsString("\"two\nlines\"", "two\nlines"));
+    // Escapes past the end of a view of the buffer.
+    CHECK(ReadsString(R"("0123456789abcdefghij\n")", "0123456789abcdefghij\n"));
+    CHECK(FailsToRead(R"("unterminated)"));
+    CHECK(FailsToRead(R"("escaped end\")"));
+    CHECK(FailsToRead(R"("\q")"));
+    CHECK(FailsToRead(R"("\x41")"));
+    CHECK(FailsToRead(R"("\x;")"));
+    CHECK(FailsToRead(R"("\)"));
+}
+
+static void TestCharLiterals() {
+    CHECK(ReadsChar("#\\a", 'a'));
+    CHECK(ReadsChar("#\\(", '('));
+    CHECK(ReadsChar("#\\x", 'x'));
+    CHECK(ReadsChar("#\\space", ' '));
+    CHECK(ReadsChar("#\\newline", '\n'));
+    CHECK(ReadsChar("#\\tab", '\t'));
+    CHECK(ReadsChar("#\\return", '\r'));
+    CHECK(ReadsChar("#\\nul", '\0'));
+    CHECK(ReadsChar("#\\x41", 'A'));
+    CHECK(ReadsChar("#\\x7e", '~'));
+    CHECK(FailsToRead("#\\"));
+    CHECK(FailsToRead("#\\invalid-name"));
+    CHECK(FailsToRead("#\\x123"));
+    CHECK(FailsToRead("#\\xg"));
+}
+
+// Literals as the interpreter reads, evaluates and writes them: what it writes reads back the same.
+static void TestWrittenLiterals() {
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        Interpreter interpreter(options);
+        for (const char* literal : {R"("a\nb\t\"q\"\\")", R"("")", "#\\a", "#\\space",
+                                    "#\\newline", "#\\tab", "#\\nul"}) {
+            const std::string written = interpreter.Run(literal);
+            CHECK(interpreter.Run(written) == written);
+        }
+        CHECK(interpreter.Run(R"("\x41;")") == R"("A")");
+        CHECK(interpreter.Run("#\\x41") == "#\\A");
+        CHECK(interpreter.Run(R"((string-length "a\nb"))") == "3");
+        CHECK(interpreter.Run("(string->list \"a\\tb\")") == "(#\\a #\\tab #\\b)");
+        CHECK(interpreter.Run("(char->integer #\\newline)") == "10");
+        CHECK(interpreter.Run("(integer->char 32)") == "#\\space");
+        CHECK_THROWS(SyntaxError, interpreter.Run(R"("\q")"));
+        CHECK_THROWS(SyntaxError, interpreter.Run("#\\invalid-name"));
+    }
+}
+
+// Strings of up to String::kInlineSize bytes are stored in the String itself, longer ones in a
+// buffer.
+static void TestInlineBoundary() {
+    const size_t inline_size = 16;
+    for (Engine engine : {Engine::kTree, Engine::kBytecode}) {
+        InterpreterOptions options;
+        options.engine = engine;
+        options.heap.initial_size = 1;  // collect at every chance, which must keep both kinds
+        Interpreter interpreter(options);
+        for (size_t size : {inline_size - 1, inline_size, inline_size + 1, 4 * inline_size}) {
+            std::string text;
+            for (size_t i = 0; i != size; ++i) {
+                text.push_back('a' + i % 26);
+            }
+            const std::string literal = '"' + text + '"';
+            const std::string length = std::to_string(size);
+            interpreter.Run("(define s " + literal + ")");
+            CHECK(interpreter.Run("s") == literal);
+            CHECK(interpreter.Run("(string-length s)") == length);
+            CHECK(interpreter.Run("(string-ref s " + std::to_string(size - 1) + ")") ==
+                  std::string("#\\") + text.back());
+            CHECK(interpreter.Run("(string=? s (string-append (substring s 0 1) (substring s 1 " +
+                                  length + ")))") == "#t");
+            CHECK(interpreter.Run("(string=? s (list->string (string->list s)))") == "#t");
+            CHECK(interpreter.Run("(string-length (string-append s s))") ==
+                  std::to_string(2 * size));
+            CHECK(interpreter.Run("(symbol->string (string->symbol s))") == literal);
+            CHECK(interpreter.Run("(string=? s (substring s 0 " + std::to_string(size - 1) +
+                                  "))") == "#f");
+        }
+        CHECK_THROWS(RuntimeError, interpreter.Run("(string-ref s 1000)"));
+        CHECK_THROWS(RuntimeError, interpreter.Run("(substring s 2 1)"));
+    }
+}
+
+int main() {
+    TestStringLiterals();
+    TestCharLiterals();
+    TestWrittenLiterals();
+    TestInlineBoundary();
+    return ExitStatus();
+}
@@ -1,13 +1,10 @@
 #include "tokenizer.h"
 #include "error.h"
+#include <algorithm>
 #include <cctype>
 #include <stdexcept>
 
-SymbolToken::SymbolToken(char chr) {
-    name.push_back(chr);
-}
-
-SymbolToken::SymbolToken(const std::string& str) : name(str) {
+SymbolToken::SymbolToken(std::string_view str) : name(str) {
 }
 
 bool SymbolToken::operator==(const SymbolToken& other) const {
@@ -22,77 +19,276 @@ bool DotToken::operator==(const DotToken&) const {
     return true;
 }
 
-ConstantToken::ConstantToken(int x) : value(x) {
+ConstantToken::ConstantToken(std::string_view str) : text(str) {
 }
 
 bool ConstantToken::operator==(const ConstantToken& other) const {
+    return text == other.text;
+}
+
+StringToken::StringToken(std::string_view str) : text(str) {
+}
+
+bool StringToken::operator==(const StringToken& other) const {
+    return text == other.text;
+}
+
+bool CharToken::operator==(const CharToken& other) const {
     return value == other.value;
 }
 
+// Built at compile time, so that tokenizers on different threads can share them without any
+// initialization or synchronization.
+struct CharTable {
+    bool contains[256] = {};
+};
+
+// [a-zA-Z], [0-9] if with_digits, and the characters of extra.
+static constexpr CharTable MakeCharTable(const char* extra, bool with_digits) {
+    CharTable table;
+    for (int i = 'a'; i <= 'z'; ++i) {
+        table.contains[i] = true;
+    }
+    for (int i = 'A'; i <= 'Z'; ++i) {
+        table.contains[i] = true;
+    }
+    for (int i = '0'; with_digits && i <= '9'; ++i) {
+        table.contains[i] = true;
+    }
+    for (; *extra != '\0'; ++extra) {
+        table.contains[static_cast<unsigned char>(*extra)] = true;
+    }
+    return table;
+}
+
+static constexpr CharTable kSymbolStart = MakeCharTable("<=>*#", false);
+static constexpr CharTable kSymbol = MakeCharTable("<=>*#?!-", true);
+
 // [a-zA-Z<=>*#]
 static bool IsSymbolStart(unsigned char chr) {
-    static bool table[256];
-    if (!table[static_cast<int>('a')]) {
-        for (int i = 'a'; i <= 'z'; ++i) {
-            table[i] = true;
-        }
-        for (int i = 'A'; i <= 'Z'; ++i) {
-            table[i] = true;
-        }
-        for (char chr : std::string("<=>*#")) {
-            table[static_cast<int>(chr)] = true;
-        }
-    }
-    return table[static_cast<int>(chr)];
+    return kSymbolStart.contains[chr];
 }
 
 // [a-zA-Z<=>*#0-9?!-]
 static bool IsSymbol(unsigned char chr) {
-    static bool table[256];
-    if (!table[static_cast<int>('a')]) {
-        for (int i = 'a'; i <= 'z'; ++i) {
-            table[i] = true;
-        }
-        for (int i = 'A'; i <= 'Z'; ++i) {
-            table[i] = true;
-        }
-        for (int i = '0'; i <= '9'; ++i) {
-            table[i] = true;
-        }
-        for (char chr : std::string("<=>*#?!-")) {
-            table[static_cast<int>(chr)] = true;
-        }
-    }
-    return table[static_cast<int>(chr)];
+    return kSymbol.contains[chr];
+}
+
+// The <cctype> functions take an unsigned char (or EOF), so a plain char above 0x7f cannot be
+// passed to them directly.
+static bool IsSpace(unsigned char chr) {
+    return isspace(chr) != 0;
+}
+
+static bool IsDigit(unsigned char chr) {
+    return isdigit(chr) != 0;
+}
+
+static bool IsHexDigit(unsigned char chr) {
+    return isxdigit(chr) != 0;
 }
 
 bool Tokenizer::IsEof() {
-    return in_->eof();
+    if (in_ == nullptr) {
+        return pos_ == end_;
+    }
+    return in_->peek() == std::istream::traits_type::eof();
 }
 
 char Tokenizer::Peek() {
-    return in_->peek();
+    return (in_ == nullptr ? *pos_ : in_->peek());
 }
 
 char Tokenizer::Get() {
-    return in_->get();
+    return (in_ == nullptr ? *pos_++ : in_->get());
 }
 
 void Tokenizer::SkipWhitespace() {
-    while (!IsEof() && isspace(Peek())) {
+    while (!IsEof() && IsSpace(Peek())) {
         Get();
     }
 }
 
+std::string_view Tokenizer::ReadName(char first) {
+    if (in_ == nullptr) {
+        const char* begin = pos_ - 1;
+        while (pos_ != end_ && IsSymbol(*pos_)) {
+            ++pos_;
+        }
+        return std::string_view(begin, pos_ - begin);
+    }
+    name_.assign(1, first);
+    while (!IsEof() && IsSymbol(Peek())) {
+        name_.push_back(Get());
+    }
+    return name_;
+}
+
+std::string_view Tokenizer::ReadNumber(char first) {
+    const char* begin = (in_ == nullptr ? pos_ - 1 : nullptr);
+    if (in_ != nullptr) {
+        name_.assign(1, first);
+    }
+    // Consumes the next character if it satisfies the predicate.
+    const auto accept = [this](auto predicate) {
+        if (IsEof() || !predicate(Peek())) {
+            return false;
+        }
+        const char chr = Get();
+        if (in_ != nullptr) {
+            name_.push_back(chr);
+        }
+        return true;
+    };
+    while (accept(IsDigit)) {
+    }
+    if (accept([](char chr) { return chr == '.'; })) {
+        while (accept(IsDigit)) {
+        }
+    }
+    if (accept([](char chr) { return chr == 'e' || chr == 'E'; })) {
+        accept([](char chr) { return chr == '+' || chr == '-'; });
+        if (!accept(IsDigit)) {
+            throw SyntaxError("Tokenizer::Next(): invalid number");
+        }
+        while (accept(IsDigit)) {
+        }
+    }
+    if (in_ == nullptr) {
+        return std::string_view(begin, pos_ - begin);
+    }
+    return name_;
+}
+
+std::string_view Tokenizer::OneCharName(char chr) {
+    if (in_ == nullptr) {
+        return std::string_view(pos_ - 1, 1);
+    }
+    name_.assign(1, chr);
+    return name_;
+}
+
+static int HexDigit(unsigned char chr) {  // chr must be one
+    return (IsDigit(chr) ? chr - '0' : tolower(chr) - 'a' + 10);
+}
+
+// Without escapes, the text of a string in a buffer is a view of it.
+std::string_view Tokenizer::ReadString() {
+    if (in_ == nullptr) {
+        const char* end = pos_;
+        while (end != end_ && *end != '"' && *end != '\\') {
+            ++end;
+        }
+        if (end != end_ && *end == '"') {
+            const std::string_view text(pos_, end - pos_);
+            pos_ = end + 1;
+            return text;
+        }
+        name_.assign(pos_, end);
+        pos_ = end;
+    } else {
+        name_.clear();
+    }
+    for (;;) {
+        if (IsEof()) {
+            throw SyntaxError("Tokenizer::Next(): unterminated string");
+        }
+        const char chr = Get();
+        if (chr == '"') {
+            return name_;
+        }
+        name_.push_back(chr == '\\' ? ReadEscape() : chr);
+    }
+}
+
+char Tokenizer::ReadEscape() {
+    const char chr = (IsEof() ? '\0' : Get());
+    switch (chr) {
+        case '"':
+        case '\\':
+            return chr;
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'r':
+            return '\r';
+        case 'x': {
+            const int value = ReadHex(2);
+            if (!IsEof() && Get() == ';') {
+                return static_cast<char>(value);
+            }
+            break;
+        }
+    }
+    throw SyntaxError("Tokenizer::Next(): invalid escape in string");
+}
+
+char Tokenizer::ReadChar() {
+    if (IsEof()) {
+        throw SyntaxError("Tokenizer::Next(): invalid character");
+    }
+    const char first = Get();
+    if (!isalpha(static_cast<unsigned char>(first)) || IsEof() || !IsSymbol(Peek())) {
+        return first;
+    }
+    const std::string_view name = ReadName(first);
+    static constexpr std::pair<std::string_view, char> kNames[] = {
+        {"space", ' '}, {"newline", '\n'}, {"tab", '\t'}, {"return", '\r'}, {"nul", '\0'},
+    };
+    for (const auto& [char_name, value] : kNames) {
+        if (name == char_name) {
+            return value;
+        }
+    }
+    if (name[0] == 'x' && name.size() <= 3 &&
+        std::all_of(name.begin() + 1, name.end(), IsHexDigit)) {
+        int value = 0;
+        for (char chr : name.substr(1)) {
+            value = 16 * value + HexDigit(chr);
+        }
+        return static_cast<char>(value);
+    }
+    throw SyntaxError("Tokenizer::Next(): invalid character name: " + std::string(name));
+}
+
+int Tokenizer::ReadHex(size_t max_digits) {
+    int value = 0;
+    size_t num_digits = 0;
+    for (; num_digits != max_digits && !IsEof() && IsHexDigit(Peek()); ++num_digits) {
+        value = 16 * value + HexDigit(Get());
+    }
+    if (num_digits == 0) {
+        throw SyntaxError("Tokenizer::Next(): expected a hexadecimal digit");
+    }
+    return value;
+}
+
 Tokenizer::Tokenizer(std::istream* in) : in_(in) {
-    Next();
+}
+
+Tokenizer::Tokenizer(std::string_view buffer)
+    : pos_(buffer.data()), end_(buffer.data() + buffer.size()) {
+}
+
+void Tokenizer::Fill() {
+    if (!scanned_) {
+        Scan();
+        scanned_ = true;
+    }
 }
 
 bool Tokenizer::IsEnd() {
+    Fill();
     return !token_;
 }
 
 void Tokenizer::Next() {
+    Fill();
+    scanned_ = false;
+}
+
+void Tokenizer::Scan() {
     token_ = {};
     SkipWhitespace();
     if (IsEof()) {
@@ -121,43 +317,39 @@ void Tokenizer::Next() {
         }
 
         case '/': {
-            token_ = SymbolToken(chr);
+            token_ = SymbolToken(OneCharName(chr));
             return;
         }
 
+        case '"': {
+            token_ = StringToken(ReadString());
+            return;
+        }
+
+        case '#': {
+            if (!IsEof() && Peek() == '\\') {
+                Get();
+                token_ = CharToken{ReadChar()};
+                return;
+            }
+            break;
+        }
+
         case '+':
         case '-': {
-            if (IsEof() || !isdigit(Peek())) {
-                token_ = SymbolToken(chr);
+            if (IsEof() || !IsDigit(Peek())) {
+                token_ = SymbolToken(OneCharName(chr));
                 return;
             }
             break;
         }
     }
-    if (isdigit(chr) || chr == '+' || chr == '-') {
-        bool is_negative = false;
-        int value = 0;
-        if (chr == '+' || chr == '-') {
-            is_negative = (chr == '-');
-            chr = Get();
-        }
-        while (true) {
-            value = 10 * value + (chr - '0');
-            if (!IsEof() && isdigit(Peek())) {
-                chr = Get();
-            } else {
-                break;
-            }
-        }
-        token_ = ConstantToken(is_negative ? -value : value);
+    if (IsDigit(chr) || chr == '+' || chr == '-') {
+        token_ = ConstantToken(ReadNumber(chr));
         return;
     }
     if (IsSymbolStart(chr)) {
-        std::string name;
-        name.push_back(chr);
-        while (!IsEof() && IsSymbol(Peek())) {
-            name.push_back(Get());
-        }
+        const std::string_view name = ReadName(chr);
         if (name == "#f") {
             token_ = BooleanToken::FALSE;
         } else if (name == "#t") {
@@ -172,5 +364,6 @@ void Tokenizer::Next() {
 }
 
 Token Tokenizer::GetToken() {
+    Fill();
     return token_.value();
 }
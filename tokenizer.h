@@ -3,12 +3,15 @@
 #include <variant>
 #include <optional>
 #include <istream>
+#include <string>
+#include <string_view>
 
+// The name points into the tokenizer's input, or into the tokenizer itself when it reads a
+// stream, and is only valid until the next call to Next().
 struct SymbolToken {
-    std::string name;
+    std::string_view name;
 
-    SymbolToken(char);
-    SymbolToken(const std::string&);
+    SymbolToken(std::string_view);
 
     bool operator==(const SymbolToken& other) const;
 };
@@ -24,29 +27,65 @@ struct DotToken {
 enum class BracketToken { OPEN, CLOSE };
 enum class BooleanToken { FALSE, TRUE };
 
+// A number literal: [+-]?[0-9]+(.[0-9]*)?([eE][+-]?[0-9]+)?, converted by ParseNumber. The
+// text is only valid until the next call to Next(), like the name of a SymbolToken.
 struct ConstantToken {
-    int value;
+    std::string_view text;
 
-    ConstantToken(int);
+    ConstantToken(std::string_view);
 
     bool operator==(const ConstantToken& other) const;
 };
 
-using Token =
-    std::variant<ConstantToken, BracketToken, BooleanToken, SymbolToken, QuoteToken, DotToken>;
+// A string literal, with its escapes (\" \\ \n \t \r and \xHH;) replaced by what they stand
+// for. The text is only valid until the next call to Next(), like the name of a SymbolToken.
+struct StringToken {
+    std::string_view text;
 
+    StringToken(std::string_view);
+
+    bool operator==(const StringToken& other) const;
+};
+
+// #\c for any character c, or one of #\space, #\newline, #\tab, #\return, #\nul and #\xHH.
+struct CharToken {
+    char value;
+
+    bool operator==(const CharToken& other) const;
+};
+
+using Token = std::variant<ConstantToken, BracketToken, BooleanToken, SymbolToken, QuoteToken,
+                           DotToken, StringToken, CharToken>;
+
+// Scans either a contiguous buffer, without copying anything out of it, or a stream, one
+// character at a time. A token is only scanned when it is asked for, so a reader that has
+// consumed a complete datum does not wait for more input from a stream.
 class Tokenizer {
     std::optional<Token> token_;
-    std::istream* in_;
+    bool scanned_ = false;  // whether token_ is the current token
+    std::istream* in_ = nullptr;  // nullptr when scanning a buffer
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+    std::string name_;  // the last symbol or number read from in_, or string with escapes
 
     bool IsEof();
     char Peek();
     char Get();
 
     void SkipWhitespace();
+    void Scan();
+    void Fill();
+    std::string_view ReadName(char first);  // first has already been consumed
+    std::string_view ReadNumber(char first);  // likewise
+    std::string_view OneCharName(char chr);  // likewise
+    std::string_view ReadString();  // the opening quote has been consumed
+    char ReadEscape();  // likewise the backslash
+    char ReadChar();  // likewise "#\"
+    int ReadHex(size_t max_digits);  // at least one digit
 
 public:
     Tokenizer(std::istream* in);
+    Tokenizer(std::string_view buffer);  // the buffer must outlive the tokenizer
 
     bool IsEnd();
 
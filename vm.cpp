@@ -0,0 +1,360 @@
+#include "vm.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "error.h"
+#include "profiler.h"
+#include "scheme.h"
+
+// Threaded dispatch through a table of labels where the compiler supports it, a switch
+// otherwise.
+#if defined(__GNUC__)
+#define SCHEME_COMPUTED_GOTO 1
+#endif
+
+static void CheckArity(Lambda* lambda, size_t argc) {
+    if (argc != lambda->GetProcedure().arg_names.size()) {
+        throw RuntimeError(std::string("Invalid number of arguments in for lambda: ") +
+                           lambda->ToString());
+    }
+}
+
+static void CopyArgs(Scope* frame, const Value* args, size_t argc) {
+    for (size_t i = 0; i != argc; ++i) {
+        frame->GetSlot(i) = args[i];
+    }
+}
+
+static Scope* FindFrame(Scope* scope, int32_t depth) {
+    for (; depth != 0; --depth) {
+        scope = scope->GetParent();
+    }
+    return scope;
+}
+
+void VirtualMachine::Trace(Heap* heap) const {
+    for (const Value& value : stack_) {
+        heap->Mark(value);
+    }
+    for (const CallFrame& frame : frames_) {
+        heap->Mark(frame.scope);
+        heap->Mark(frame.lambda);
+    }
+}
+
+Value VirtualMachine::Execute(Interpreter* interpreter, const Code& code) {
+    const size_t entry = frames_.size();
+    const size_t stack_size = stack_.size();
+    ProfileUnwinder unwinder(interpreter->GetProfiler());
+    frames_.push_back({&code, code.words.data(), nullptr, nullptr, stack_size});
+    try {
+        return Run(interpreter, entry);
+    } catch (...) {
+        frames_.resize(entry);
+        stack_.resize(stack_size);
+        throw;
+    }
+}
+
+Value VirtualMachine::Call(Interpreter* interpreter, Lambda* lambda,
+                           const std::vector<Value>& args) {
+    CheckArity(lambda, args.size());
+    interpreter->Step();
+    interpreter->CheckDepth(frames_.size() + 1);
+    const Procedure& procedure = lambda->GetProcedure();
+    Scope* frame = interpreter->GetFramePool().Take(lambda->GetScope(), procedure.num_slots);
+    CopyArgs(frame, args.data(), args.size());
+    const size_t entry = frames_.size();
+    const size_t stack_size = stack_.size();
+    Profiler* const profiler = interpreter->GetProfiler();
+    ProfileUnwinder unwinder(profiler);
+    if (profiler != nullptr) {
+        profiler->Enter(lambda);
+    }
+    frames_.push_back({procedure.code.get(), procedure.code->words.data(), frame, lambda,
+                       stack_size});
+    try {
+        interpreter->GetHeap().MaybeCollect();  // the caller roots the arguments
+        return Run(interpreter, entry);
+    } catch (...) {
+        frames_.resize(entry);
+        stack_.resize(stack_size);
+        throw;
+    }
+}
+
+Value VirtualMachine::Run(Interpreter* interpreter, size_t entry) {
+    Heap& heap = interpreter->GetHeap();
+    FramePool& frame_pool = interpreter->GetFramePool();
+    Profiler* const profiler = interpreter->GetProfiler();
+    const Code* code = frames_.back().code;
+    const int32_t* pc = frames_.back().pc;
+    Scope* scope = frames_.back().scope;
+
+    // Calls the command of a fast-path instruction with the argc values on top of the stack,
+    // leaving them there.
+    const auto call_command = [&](Command command, size_t argc) {
+        std::vector<Value> args = interpreter->TakeArgs();
+        args.assign(stack_.end() - argc, stack_.end());
+        const Value result = command(interpreter, args);
+        interpreter->GiveBackArgs(&args);
+        return result;
+    };
+    // Calls a memoized lambda, below its argc arguments on the stack, through Lambda::Call, which
+    // keeps what it returns, and replaces it and them with the result.
+    const auto call_memoized = [&](Lambda* lambda, size_t argc) {
+        std::vector<Value> args = interpreter->TakeArgs();
+        args.assign(stack_.end() - argc, stack_.end());
+        const Value result = lambda->Call(interpreter, args);
+        interpreter->GiveBackArgs(&args);
+        stack_.resize(stack_.size() - argc - 1);
+        stack_.push_back(result);
+    };
+
+#ifdef SCHEME_COMPUTED_GOTO
+    static void* const kLabels[] = {
+        &&op_kConst,        &&op_kLocal,          &&op_kGlobal,
+        &&op_kDefineLocal,  &&op_kDefineGlobal,   &&op_kSetLocal,
+        &&op_kSetGlobal,    &&op_kPop,            &&op_kJump,
+        &&op_kJumpIfFalse,  &&op_kJumpIfFalseElsePop, &&op_kJumpIfTrueElsePop,
+        &&op_kClosure,      &&op_kCall,           &&op_kTailCall,
+        &&op_kBuiltin,      &&op_kReturn,         &&op_kAdd,
+        &&op_kSubtract,     &&op_kMultiply,       &&op_kNumEqual,
+        &&op_kLess,         &&op_kGreater,        &&op_kLessOrEqual,
+        &&op_kGreaterOrEqual,
+    };
+    static_assert(sizeof(kLabels) / sizeof(kLabels[0]) == kNumOps, "a label for every Op");
+#define CASE(op) op_##op
+#define DISPATCH() goto* kLabels[*pc++]
+    DISPATCH();
+#else
+#define CASE(op) case op
+#define DISPATCH() continue
+    for (;;) switch (*pc++) {
+#endif
+
+    CASE(kConst) : {
+        stack_.push_back(code->constants[pc[0]]);
+        pc += 1;
+        DISPATCH();
+    }
+    CASE(kLocal) : {
+        const Value& value = FindFrame(scope, pc[0])->GetSlot(pc[1]);
+        if (value.IsUnbound()) {
+            throw NameError(std::string("No such variable: ") + code->symbols[pc[2]]->GetName());
+        }
+        stack_.push_back(value);
+        pc += 3;
+        DISPATCH();
+    }
+    CASE(kGlobal) : {
+        const Value* binding = interpreter->GetScope()->FindVariable(pc[0]);
+        if (binding == nullptr) {
+            throw NameError(std::string("No such variable: ") + code->symbols[pc[1]]->GetName());
+        }
+        stack_.push_back(*binding);
+        pc += 2;
+        DISPATCH();
+    }
+    CASE(kDefineLocal) : {
+        scope->GetSlot(pc[0]) = stack_.back();
+        stack_.back() = Value();
+        pc += 1;
+        DISPATCH();
+    }
+    CASE(kDefineGlobal) : {
+        interpreter->CheckModifiable(interpreter->GetScope(), "define");
+        interpreter->GetScope()->SetVariable(pc[0], stack_.back());
+        stack_.back() = Value();
+        pc += 1;
+        DISPATCH();
+    }
+    CASE(kSetLocal) : {
+        Scope* frame = FindFrame(scope, pc[0]);
+        if (pc[0] != 0) {
+            interpreter->CheckModifiable(frame, "set!");
+        }
+        frame->GetSlot(pc[1]) = stack_.back();
+        stack_.back() = Value();
+        pc += 2;
+        DISPATCH();
+    }
+    CASE(kSetGlobal) : {
+        interpreter->CheckModifiable(interpreter->GetScope(), "set!");
+        Value* variable = interpreter->GetScope()->FindVariable(pc[0]);
+        if (variable == nullptr) {
+            throw NameError(std::string("Variable doesn't yet exist: ") +
+                            code->symbols[pc[1]]->GetName());
+        }
+        *variable = stack_.back();
+        stack_.back() = Value();
+        pc += 2;
+        DISPATCH();
+    }
+    CASE(kPop) : {
+        stack_.pop_back();
+        DISPATCH();
+    }
+    CASE(kJump) : {
+        pc = code->words.data() + pc[0];
+        DISPATCH();
+    }
+    CASE(kJumpIfFalse) : {
+        const bool is_false = stack_.back().IsFalse();
+        stack_.pop_back();
+        pc = (is_false ? code->words.data() + pc[0] : pc + 1);
+        DISPATCH();
+    }
+    CASE(kJumpIfFalseElsePop) : {
+        if (stack_.back().IsFalse()) {
+            pc = code->words.data() + pc[0];
+        } else {
+            stack_.pop_back();
+            pc += 1;
+        }
+        DISPATCH();
+    }
+    CASE(kJumpIfTrueElsePop) : {
+        if (!stack_.back().IsFalse()) {
+            pc = code->words.data() + pc[0];
+        } else {
+            stack_.pop_back();
+            pc += 1;
+        }
+        DISPATCH();
+    }
+    CASE(kClosure) : {
+        stack_.push_back(Value(Make<Lambda>(code->procedures[pc[0]], scope)));
+        pc += 1;
+        DISPATCH();
+    }
+    CASE(kCall) : {
+        const size_t argc = pc[0];
+        Lambda* lambda = As<Lambda>(stack_[stack_.size() - argc - 1]);
+        if (lambda == nullptr) {
+            throw RuntimeError(std::string("Cannot evaluate: ") + ToString(code->constants[pc[1]]));
+        }
+        if (lambda->GetMemo() != nullptr) {
+            call_memoized(lambda, argc);
+            pc += 2;
+            DISPATCH();
+        }
+        CheckArity(lambda, argc);
+        interpreter->Step();
+        interpreter->CheckDepth(frames_.size());  // the bottom frame is a top-level form's
+        const Procedure& procedure = lambda->GetProcedure();
+        Scope* frame = frame_pool.Take(lambda->GetScope(), procedure.num_slots);
+        CopyArgs(frame, stack_.data() + stack_.size() - argc, argc);
+        stack_.resize(stack_.size() - argc - 1);
+        frames_.back().pc = pc + 2;
+        code = procedure.code.get();
+        pc = code->words.data();
+        scope = frame;
+        frames_.push_back({code, pc, scope, lambda, stack_.size()});
+        if (profiler != nullptr) {
+            profiler->Enter(lambda);
+        }
+        heap.MaybeCollect();
+        DISPATCH();
+    }
+    CASE(kTailCall) : {
+        // The frame being left is reused when its procedure creates no closures.
+        const size_t argc = pc[0];
+        Lambda* lambda = As<Lambda>(stack_[stack_.size() - argc - 1]);
+        if (lambda == nullptr) {
+            throw RuntimeError(std::string("Cannot evaluate: ") + ToString(code->constants[pc[1]]));
+        }
+        if (lambda->GetMemo() != nullptr) {
+            call_memoized(lambda, argc);
+            pc += 2;
+            DISPATCH();
+        }
+        CheckArity(lambda, argc);
+        interpreter->Step();
+        CallFrame& current = frames_.back();
+        const Procedure& procedure = lambda->GetProcedure();
+        if (current.lambda->GetProcedure().makes_closures) {
+            scope = frame_pool.Take(lambda->GetScope(), procedure.num_slots);
+        } else {
+            scope->Reset(lambda->GetScope(), procedure.num_slots);
+        }
+        CopyArgs(scope, stack_.data() + stack_.size() - argc, argc);
+        stack_.resize(current.base);
+        code = procedure.code.get();
+        pc = code->words.data();
+        current.code = code;
+        current.scope = scope;
+        current.lambda = lambda;
+        if (profiler != nullptr) {
+            profiler->Replace(lambda);
+        }
+        heap.MaybeCollect();
+        DISPATCH();
+    }
+    CASE(kBuiltin) : {
+        const size_t argc = pc[1];
+        if (profiler != nullptr) {
+            profiler->CountBuiltin(code->commands[pc[0]]);
+        }
+        const Value result = call_command(code->commands[pc[0]], argc);
+        stack_.resize(stack_.size() - argc);
+        stack_.push_back(result);
+        pc += 2;
+        DISPATCH();
+    }
+    CASE(kReturn) : {
+        const Value result = stack_.back();
+        if (const Lambda* lambda = frames_.back().lambda) {
+            if (profiler != nullptr) {
+                profiler->Leave();
+            }
+            if (!lambda->GetProcedure().makes_closures) {  // see FramePool
+                frame_pool.Give(frames_.back().scope);
+            }
+        }
+        stack_.resize(frames_.back().base);
+        frames_.pop_back();
+        if (frames_.size() == entry) {
+            return result;
+        }
+        stack_.push_back(result);
+        code = frames_.back().code;
+        pc = frames_.back().pc;
+        scope = frames_.back().scope;
+        DISPATCH();
+    }
+
+#define BINARY_OP(op)                                                                      \
+    CASE(op) : {                                                                          \
+        const Value rhs = stack_.back();                                                  \
+        const Value lhs = stack_[stack_.size() - 2];                                      \
+        if (profiler != nullptr) {                                                        \
+            profiler->CountBuiltin(code->commands[pc[0]]);                                \
+        }                                                                                 \
+        Value result;                                                                     \
+        if (!TryFixnumOp(op, lhs, rhs, &result)) {                                        \
+            result = call_command(code->commands[pc[0]], 2);                              \
+        }                                                                                 \
+        stack_.pop_back();                                                                \
+        stack_.back() = result;                                                           \
+        pc += 1;                                                                          \
+        DISPATCH();                                                                       \
+    }
+
+    BINARY_OP(kAdd)
+    BINARY_OP(kSubtract)
+    BINARY_OP(kMultiply)
+    BINARY_OP(kNumEqual)
+    BINARY_OP(kLess)
+    BINARY_OP(kGreater)
+    BINARY_OP(kLessOrEqual)
+    BINARY_OP(kGreaterOrEqual)
+
+#undef BINARY_OP
+#ifndef SCHEME_COMPUTED_GOTO
+    default:
+        throw RuntimeError("Invalid instruction");
+    }
+#endif
+#undef CASE
+#undef DISPATCH
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "heap.h"
+#include "object.h"
+
+class Interpreter;
+class Scope;
+struct Code;
+
+// Executes bytecode (see bytecode.h). Scheme calls do not recurse on the C++ stack: each call
+// pushes a frame onto frames_ and the dispatch loop carries on with the callee's code.
+class VirtualMachine : public RootSet {
+    struct CallFrame {
+        const Code* code;
+        const int32_t* pc;  // where to continue once the callee returns
+        Scope* scope;       // nullptr at the top level
+        Lambda* lambda;     // keeps the code alive; nullptr at the top level
+        size_t base;        // stack size when the frame was entered
+    };
+
+    std::vector<Value> stack_;
+    std::vector<CallFrame> frames_;
+    Value Run(Interpreter*, size_t entry);  // until the frame above entry returns
+
+public:
+    Value Execute(Interpreter*, const Code&);  // a top-level form
+    Value Call(Interpreter*, Lambda*, const std::vector<Value>& args);
+
+    virtual void Trace(Heap*) const override;
+};
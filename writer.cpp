@@ -0,0 +1,246 @@
+#include "writer.h"
+#include "compiler.h"
+#include <charconv>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class StringSink {
+    std::string* out_;
+
+public:
+    explicit StringSink(std::string* out) : out_(out) {
+    }
+
+    void Put(char chr) {
+        out_->push_back(chr);
+    }
+
+    void Put(std::string_view text) {
+        out_->append(text);
+    }
+};
+
+class StreamSink {
+    std::ostream* out_;
+    char buffer_[4096];
+    size_t size_ = 0;
+
+public:
+    explicit StreamSink(std::ostream* out) : out_(out) {
+    }
+
+    StreamSink(const StreamSink&) = delete;
+    StreamSink& operator=(const StreamSink&) = delete;
+
+    ~StreamSink() {
+        Flush();
+    }
+
+    void Flush() {
+        out_->write(buffer_, size_);
+        size_ = 0;
+    }
+
+    void Put(char chr) {
+        if (size_ == sizeof(buffer_)) {
+            Flush();
+        }
+        buffer_[size_++] = chr;
+    }
+
+    void Put(std::string_view text) {
+        if (text.size() > sizeof(buffer_) - size_) {
+            Flush();
+            if (text.size() > sizeof(buffer_)) {
+                out_->write(text.data(), text.size());
+                return;
+            }
+        }
+        text.copy(buffer_ + size_, text.size());
+        size_ += text.size();
+    }
+};
+
+static constexpr char kHexDigits[] = "0123456789abcdef";
+
+// #\c for a visible ASCII character c, by name for whitespace and nul, in hexadecimal for any
+// other byte.
+template <class Sink>
+static void WriteChar(unsigned char chr, Sink* sink) {
+    static constexpr std::pair<char, std::string_view> kNames[] = {
+        {' ', "space"}, {'\n', "newline"}, {'\t', "tab"}, {'\r', "return"}, {'\0', "nul"},
+    };
+    sink->Put("#\\");
+    if (chr > ' ' && chr < 0x7f) {
+        sink->Put(static_cast<char>(chr));
+        return;
+    }
+    for (const auto& [value, name] : kNames) {
+        if (chr == static_cast<unsigned char>(value)) {
+            sink->Put(name);
+            return;
+        }
+    }
+    const char hex[] = {'x', kHexDigits[chr >> 4], kHexDigits[chr & 0xf]};
+    sink->Put(std::string_view(hex, sizeof(hex)));
+}
+
+// Between double quotes, escaping the quote, the backslash and control characters. Bytes
+// above 0x7f are put as they are, so that UTF-8 text stays readable, and runs of characters
+// that need no escape are put whole.
+template <class Sink>
+static void WriteString(std::string_view text, Sink* sink) {
+    sink->Put('"');
+    size_t begin = 0;
+    for (size_t i = 0; i != text.size(); ++i) {
+        const unsigned char chr = text[i];
+        if (chr >= ' ' && chr != 0x7f && chr != '"' && chr != '\\') {
+            continue;
+        }
+        sink->Put(text.substr(begin, i - begin));
+        begin = i + 1;
+        if (chr == '"' || chr == '\\') {
+            const char escape[] = {'\\', static_cast<char>(chr)};
+            sink->Put(std::string_view(escape, sizeof(escape)));
+        } else if (chr == '\n') {
+            sink->Put("\\n");
+        } else if (chr == '\t') {
+            sink->Put("\\t");
+        } else if (chr == '\r') {
+            sink->Put("\\r");
+        } else {
+            const char escape[] = {'\\', 'x', kHexDigits[chr >> 4], kHexDigits[chr & 0xf], ';'};
+            sink->Put(std::string_view(escape, sizeof(escape)));
+        }
+    }
+    sink->Put(text.substr(begin));
+    sink->Put('"');
+}
+
+// A list, vector or lambda body that has been opened but not closed yet.
+struct WriteFrame {
+    enum Kind { kList, kVector, kBody } kind;
+    Value rest;                             // kList: what is left of the list
+    const std::vector<Value>* elements;     // kVector, kBody
+    size_t index = 0;                       // of the next element, the number written so far
+};
+
+// Writes an atom whole, or opens a container and pushes the frame that writes its elements.
+template <class Sink>
+static void Open(const Value& value, Sink* sink, std::vector<WriteFrame>* stack) {
+    if (value.IsNull()) {
+        sink->Put("()");
+    } else if (value.IsFixnum()) {
+        char buffer[24];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value.GetFixnum());
+        sink->Put(std::string_view(buffer, result.ptr - buffer));
+    } else if (value.IsBoolean()) {
+        sink->Put(value.IsFalse() ? "#f" : "#t");
+    } else if (value.IsChar()) {
+        WriteChar(value.GetChar(), sink);
+    } else if (value.IsUnbound()) {
+        sink->Put("#<unbound>");
+    } else if (const Symbol* symbol = As<Symbol>(value)) {
+        sink->Put(symbol->GetName());
+    } else if (const String* string = As<String>(value)) {
+        WriteString(string->GetView(), sink);
+    } else if (Is<Cell>(value)) {
+        sink->Put('(');
+        stack->push_back({WriteFrame::kList, value, nullptr});
+    } else if (const Vector* vector = As<Vector>(value)) {
+        sink->Put("#(");
+        stack->push_back({WriteFrame::kVector, Value(), &vector->GetElements()});
+    } else if (const Lambda* lambda = As<Lambda>(value)) {
+        const Procedure& procedure = lambda->GetProcedure();
+        sink->Put("(lambda ");
+        if (!procedure.arg_names.empty()) {
+            sink->Put('(');
+            for (size_t i = 0; i != procedure.arg_names.size(); ++i) {
+                if (i != 0) {
+                    sink->Put(' ');
+                }
+                sink->Put(procedure.arg_names[i]);
+            }
+        }
+        sink->Put(')');
+        stack->push_back({WriteFrame::kBody, Value(), &procedure.expressions});
+    } else {
+        sink->Put(value.GetObject()->ToString());
+    }
+}
+
+// Writes what separates the next element of the frame from the previous one and returns the
+// element, or returns false once the frame has none left.
+template <class Sink>
+static bool Advance(WriteFrame* frame, Sink* sink, Value* next) {
+    if (frame->kind == WriteFrame::kList) {
+        if (frame->rest.IsNull()) {
+            return false;
+        }
+        const Cell* cell = As<Cell>(frame->rest);
+        if (cell == nullptr) {
+            sink->Put(" . ");
+            *next = frame->rest;
+            frame->rest = Value();
+            return true;
+        }
+        if (frame->index++ != 0) {
+            sink->Put(' ');
+        }
+        *next = cell->GetFirst();
+        frame->rest = cell->GetSecond();
+        return true;
+    }
+    if (frame->index == frame->elements->size()) {
+        return false;
+    }
+    if (frame->kind == WriteFrame::kBody || frame->index != 0) {
+        sink->Put(' ');
+    }
+    *next = (*frame->elements)[frame->index++];
+    return true;
+}
+
+template <class Sink>
+static void WriteValue(const Value& value, Sink* sink) {
+    std::vector<WriteFrame> stack;
+    Value next = value;
+    for (;;) {
+        Open(next, sink, &stack);
+        for (;;) {
+            if (stack.empty()) {
+                return;
+            }
+            if (Advance(&stack.back(), sink, &next)) {
+                break;
+            }
+            sink->Put(')');
+            stack.pop_back();
+        }
+    }
+}
+
+void Write(const Value& value, std::ostream* out) {
+    StreamSink sink(out);
+    WriteValue(value, &sink);
+}
+
+void Write(const Value& value, std::string* out) {
+    StringSink sink(out);
+    WriteValue(value, &sink);
+}
+
+std::string ToString(const Value& value) {
+    std::string result;
+    Write(value, &result);
+    return result;
+}
+
+// The elements of a list between parentheses; anything but a list is written as a dotted tail.
+std::string ListToString(Value object) {
+    if (object.IsNull() || Is<Cell>(object)) {
+        return ToString(object);
+    }
+    return "( . " + ToString(object) + ")";
+}
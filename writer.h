@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "object.h"
+
+// Print the external representation of a value, the same text as ToString, without recursion:
+// lists, vectors and lambda bodies of any length or depth are walked with an explicit stack,
+// and no intermediate strings are built for them. Output to a stream is buffered internally.
+void Write(const Value&, std::ostream* out);
+void Write(const Value&, std::string* out);  // appends